@@ -1,28 +1,134 @@
 #include <raylib.h>
 
 #include "./src/mapgen.c"
+#include "./src/levelgen.c"
+#include "./src/overlay.c"
+#include "./src/profile.h"
+#include "./src/query.c"
+#include "./src/render.c"
+#include "./src/reroll.c"
 #include "./src/utils.h"
 
-#define ROOMNUMBER  10
-#define MINCELLSIZE  10
+// Share of a 60 FPS frame spent on time-sliced generation
+#define GEN_FRAME_BUDGET (0.5 / 60.0)
 
 int main(void) {
-  InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Rogventure");
+  MapConfig config = MAP_CONFIG_DEFAULT;
+
+  InitWindow(config.width * config.cellSize, config.height * config.cellSize, "Rogventure");
   SetTargetFPS(60);
 
-  srand(time(NULL)); 
+  LevelQueue levels;
+  levelQueueStart(&levels, &config, time(NULL));
+
+  // Press V to watch a level being generated across frames
+  Map preview = {0};
+  MapGenTask previewTask = {0};
+  bool previewing = false;
 
-  Map map = initMap(30, ROOMNUMBER, MINCELLSIZE);
-  generateMap(&map);
+  // F1 toggles the performance overlay, F2 exports it to CSV
+  static PerfOverlay overlay = {0};
+  // mapMemoryUsage() walks every room, so it is only re-measured when the
+  // shown map changes, gains a stage or is rerolled
+  const Map *measuredMap = NULL;
+  uint64_t measuredSeed = 0;
+  uint8_t measuredStages = 0;
+  size_t measuredMemory = 0;
+  double frameStart = GetTime();
   
   while (!WindowShouldClose()) {
+    PROFILE_ZONE("frame");
+    uint64_t updateStart = PROFILE_NOW();
+    double now = GetTime();
+    FrameSample sample = { .frameMs = (now - frameStart) * 1000 };
+    frameStart = now;
+    renderStats = (RenderStats){0};
+
+    if (IsKeyPressed(KEY_F1)) {
+      overlay.visible = !overlay.visible;
+    }
+
+    if (IsKeyPressed(KEY_F2)) {
+      uint64_t seed = levels.current->seed;
+      if (!overlayExportCsv(&overlay, TextFormat("perf_%llu.csv", (unsigned long long)seed), seed)) {
+        TraceLog(LOG_WARNING, "could not export performance CSV");
+      }
+    }
+
+    if (IsKeyPressed(KEY_SPACE)) {
+      levelQueueDescend(&levels);
+    }
+
+    // R rerolls the region around the room under the mouse
+    if (IsKeyPressed(KEY_R) && !previewing) {
+      Map *map = levels.current;
+      Vector2 mouse = GetMousePosition();
+      int32_t x = mouse.x / config.cellSize, y = mouse.y / config.cellSize;
+      rerollSubtree(map, rerollRegionAt(map, x, y), (uint64_t)time(NULL) ^ GetRandomValue(0, 1 << 30));
+      mapWalls(map);
+      measuredMap = NULL;
+    }
+
+    if (IsKeyPressed(KEY_V)) {
+      if (previewing) {
+        mapGenAbort(&previewTask);
+        freeMap(&preview);
+      } else {
+        preview = initMap(&config, time(NULL));
+        mapGenBegin(&previewTask, &preview);
+      }
+      previewing = !previewing;
+    }
+
+    if (previewing) {
+      mapGenStep(&previewTask, GEN_FRAME_BUDGET);
+    }
+    PROFILE_RECORD("update", updateStart, PROFILE_NOW());
+    sample.updateMs = (GetTime() - now) * 1000;
+
+    Map *shown = previewing ? &preview : levels.current;
     BeginDrawing();
-    drawMap(&map);
+    drawMap(shown, &config);
+
+    if (previewing) {
+      DrawText(TextFormat("%s %3.0f%%", mapGenPhaseName(previewTask.phase),
+                          mapGenProgress(&previewTask) * 100),
+               10, 10, 20, WHITE);
+    }
+
+    overlayDraw(&overlay);
 
     ClearBackground(RED);
+
+    uint64_t presentStart = PROFILE_NOW();
+    double present = GetTime();
     EndDrawing();
+    PROFILE_RECORD("EndDrawing", presentStart, PROFILE_NOW());
+
+    sample.mapMs = renderStats.mapSeconds * 1000;
+    sample.gridMs = renderStats.gridSeconds * 1000;
+    sample.presentMs = (GetTime() - present) * 1000;
+    sample.drawCalls = renderStats.drawCalls;
+    if (shown != measuredMap || shown->seed != measuredSeed || shown->stages != measuredStages) {
+      measuredMap = shown;
+      measuredSeed = shown->seed;
+      measuredStages = shown->stages;
+      measuredMemory = mapMemoryUsage(shown);
+    }
+    sample.memory = measuredMemory;
+    overlayPush(&overlay, sample);
+  }
+
+  if (previewing) {
+    mapGenAbort(&previewTask);
+    freeMap(&preview);
   }
+  levelQueueStop(&levels);
 
+  if (!PROFILE_EXPORT("trace.json")) {
+    fprintf(stderr, "ERROR: could not write trace.json\n");
+  }
+  PROFILE_SHUTDOWN();
   CloseWindow();
   return 0;
 }
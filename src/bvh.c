@@ -0,0 +1,434 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./bvh.h"
+#include "./mapgen.h"
+#include "./utils.h"
+
+#define BVH_BINS 16
+#define BVH_LEAF_SIZE 4
+// Traversal stack entries kept on the C stack before spilling to the heap
+#define BVH_STACK 64
+
+static Rect emptyRect(void) {
+  return (Rect){ INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+}
+
+static Rect unionRect(Rect a, Rect b) {
+  return (Rect){ MIN(a.x1, b.x1), MIN(a.y1, b.y1), MAX(a.x2, b.x2), MAX(a.y2, b.y2) };
+}
+
+// Half perimeter stands in for surface area in 2D
+static float rectCost(Rect r) {
+  if (r.x2 < r.x1) return 0;
+  return (float)(r.x2 - r.x1) + (float)(r.y2 - r.y1);
+}
+
+static bool overlaps(Rect a, Rect b) {
+  return a.x1 < b.x2 && b.x1 < a.x2 && a.y1 < b.y2 && b.y1 < a.y2;
+}
+
+static float centroid(const BvhItem *item, bool onX) {
+  return onX ? 0.5f * (item->rect.x1 + item->rect.x2) : 0.5f * (item->rect.y1 + item->rect.y2);
+}
+
+typedef struct {
+  Rect bounds;
+  size_t count;
+} BvhBin;
+
+static size_t binIndex(float c, float lo, float scale) {
+  size_t bin = (size_t)((c - lo) * scale);
+  return MIN(bin, (size_t)BVH_BINS - 1);
+}
+
+typedef struct {
+  uint32_t node;
+  size_t first;
+  size_t count;
+} BvhPending;
+
+typedef struct {
+  BvhPending *items;
+  size_t count;
+  size_t capacity;
+} BvhPendingArray;
+
+// Fills in one node over items[first, first + count) and queues its
+// children, if splitting pays.
+static void buildNode(Bvh *bvh, BvhPendingArray *pending, uint32_t nodeIndex, size_t first, size_t count) {
+  BvhItem *items = bvh->items.items;
+  Rect bounds = emptyRect();
+  float cx1 = FLT_MAX, cy1 = FLT_MAX, cx2 = -FLT_MAX, cy2 = -FLT_MAX;
+
+  for (size_t i = first; i < first + count; i++) {
+    bounds = unionRect(bounds, items[i].rect);
+    cx1 = MIN(cx1, centroid(&items[i], true)); cx2 = MAX(cx2, centroid(&items[i], true));
+    cy1 = MIN(cy1, centroid(&items[i], false)); cy2 = MAX(cy2, centroid(&items[i], false));
+  }
+  bvh->nodes.items[nodeIndex] = (BvhNode){ bounds, first, count };
+  if (count <= BVH_LEAF_SIZE) return;
+
+  // Pick the cheapest bin boundary on either axis
+  float bestCost = rectCost(bounds) * count;
+  bool bestOnX = true;
+  size_t bestSplit = 0;
+
+  for (int axis = 0; axis < 2; axis++) {
+    bool onX = axis == 0;
+    float lo = onX ? cx1 : cy1, hi = onX ? cx2 : cy2;
+    if (hi <= lo) continue;
+
+    float scale = BVH_BINS / (hi - lo);
+    BvhBin bins[BVH_BINS];
+    for (int b = 0; b < BVH_BINS; b++) bins[b] = (BvhBin){ emptyRect(), 0 };
+    for (size_t i = first; i < first + count; i++) {
+      BvhBin *bin = &bins[binIndex(centroid(&items[i], onX), lo, scale)];
+      bin->bounds = unionRect(bin->bounds, items[i].rect);
+      bin->count++;
+    }
+
+    float rightCost[BVH_BINS];
+    Rect acc = emptyRect();
+    size_t accCount = 0;
+    for (int b = BVH_BINS - 1; b > 0; b--) {
+      acc = unionRect(acc, bins[b].bounds);
+      accCount += bins[b].count;
+      rightCost[b] = rectCost(acc) * accCount;
+    }
+
+    acc = emptyRect();
+    accCount = 0;
+    for (int b = 0; b < BVH_BINS - 1; b++) {
+      acc = unionRect(acc, bins[b].bounds);
+      accCount += bins[b].count;
+      if (accCount == 0 || accCount == count) continue;
+
+      float cost = rectCost(acc) * accCount + rightCost[b + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestOnX = onX;
+        bestSplit = b + 1;
+      }
+    }
+  }
+
+  size_t mid = first;
+  if (bestSplit > 0) {
+    float lo = bestOnX ? cx1 : cy1, hi = bestOnX ? cx2 : cy2;
+    float scale = BVH_BINS / (hi - lo);
+    for (size_t i = first; i < first + count; i++) {
+      if (binIndex(centroid(&items[i], bestOnX), lo, scale) < bestSplit) {
+        swap(BvhItem, items[i], items[mid]);
+        mid++;
+      }
+    }
+  } else if (count > 2 * BVH_LEAF_SIZE) {
+    // No split beats a leaf but the leaf would be big: halve in place
+    mid = first + count / 2;
+  } else {
+    return;
+  }
+
+  uint32_t children = bvh->nodes.count;
+  bvh->nodes.count += 2;
+  bvh->nodes.items[nodeIndex].first = children;
+  bvh->nodes.items[nodeIndex].count = 0;
+
+  // Right first so the left subtree is built first
+  da_append(pending, ((BvhPending){ children + 1, mid, first + count - mid }));
+  da_append(pending, ((BvhPending){ children, first, mid - first }));
+}
+
+// Builds the tree over bvh->items, which it reorders. An empty item list
+// gives an empty tree rather than a root with nothing below it.
+void buildBvhFromItems(Bvh *bvh) {
+  bvh->nodes.count = 0;
+  if (bvh->items.count == 0) return;
+
+  da_reserve(&bvh->nodes, 2 * bvh->items.count);
+  bvh->nodes.count = 1;
+
+  BvhPendingArray pending = {0};
+  da_append(&pending, ((BvhPending){ 0, 0, bvh->items.count }));
+  while (pending.count > 0) {
+    BvhPending next = pending.items[--pending.count];
+    buildNode(bvh, &pending, next.node, next.first, next.count);
+  }
+  free(pending.items);
+}
+
+void buildBvh(Bvh *bvh, Map *map) {
+  *bvh = (Bvh){0};
+
+  for (size_t i = 0; i < map->cells.count; i++) {
+    Cell *cell = map->cells.items[i];
+    BvhItem room = { { cell->x1, cell->y1, cell->x2, cell->y2 }, BVH_ROOM, cell };
+    da_append(&bvh->items, room);
+
+    HallArray halls = cellHalls(map, cell);
+    da_foreach(Hall, hall, &halls) {
+      BvhItem item = { { hall->x1, hall->y1, hall->x2, hall->y2 }, BVH_HALL, hall };
+      da_append(&bvh->items, item);
+    }
+  }
+
+  buildBvhFromItems(bvh);
+}
+
+void freeBvh(Bvh *bvh) {
+  free(bvh->nodes.items);
+  free(bvh->items.items);
+  *bvh = (Bvh){0};
+}
+
+// One node per cell, laid out then bounded
+size_t bvhBuildUnits(size_t leafCount) {
+  return 2 * (2 * leafCount - 1);
+}
+
+void bvhBuildBegin(BvhBuild *build, Bvh *bvh, Cell *root, size_t leafCount) {
+  *bvh = (Bvh){0};
+  da_reserve(&bvh->nodes, 2 * leafCount - 1);
+  da_reserve(&bvh->items, leafCount);
+  bvh->nodes.count = 1;
+
+  *build = (BvhBuild){ .bvh = bvh };
+  da_append(&build->pending, ((BvhCellNode){ root, 0 }));
+}
+
+bool bvhBuildStep(BvhBuild *build) {
+  Bvh *bvh = build->bvh;
+
+  if (build->pending.count > 0) {
+    BvhCellNode next = build->pending.items[--build->pending.count];
+    Cell *cell = next.cell;
+    BvhNode *node = &bvh->nodes.items[next.node];
+
+    if (cell->left == NULL) {
+      Rect room = { cell->x1, cell->y1, cell->x2, cell->y2 };
+      *node = (BvhNode){ room, bvh->items.count, 1 };
+      da_append(&bvh->items, ((BvhItem){ room, BVH_ROOM, cell }));
+    } else {
+      uint32_t children = bvh->nodes.count;
+      bvh->nodes.count += 2;
+      *node = (BvhNode){ emptyRect(), children, 0 };
+      da_append(&build->pending, ((BvhCellNode){ cell->right, children + 1 }));
+      da_append(&build->pending, ((BvhCellNode){ cell->left, children }));
+    }
+
+    if (build->pending.count == 0) build->unbounded = bvh->nodes.count;
+    return true;
+  }
+
+  if (build->unbounded == 0) return false;
+
+  BvhNode *node = &bvh->nodes.items[--build->unbounded];
+  if (node->count == 0) {
+    node->bounds = unionRect(bvh->nodes.items[node->first].bounds, bvh->nodes.items[node->first + 1].bounds);
+  }
+  return build->unbounded > 0;
+}
+
+void bvhBuildEnd(BvhBuild *build) {
+  free(build->pending.items);
+  *build = (BvhBuild){0};
+}
+
+// Traversal stack that starts in a fixed block and moves to the heap for
+// trees deeper than BVH_STACK.
+typedef struct {
+  uint32_t local[BVH_STACK];
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} BvhStack;
+
+static void bvhStackBegin(BvhStack *stack) {
+  stack->items = stack->local;
+  stack->count = 0;
+  stack->capacity = BVH_STACK;
+}
+
+static void bvhStackPush(BvhStack *stack, uint32_t node) {
+  if (stack->count == stack->capacity) {
+    uint32_t *grown = malloc(2 * stack->capacity * sizeof(*grown));
+    ASSERT(grown != NULL && "Buy more RAM lol");
+    memcpy(grown, stack->items, stack->count * sizeof(*grown));
+    if (stack->items != stack->local) free(stack->items);
+    stack->items = grown;
+    stack->capacity *= 2;
+  }
+  stack->items[stack->count++] = node;
+}
+
+static void bvhStackEnd(BvhStack *stack) {
+  if (stack->items != stack->local) free(stack->items);
+}
+
+size_t bvhOverlap(const Bvh *bvh, Rect rect, BvhItem **out, size_t capacity) {
+  size_t found = 0;
+  if (bvh->nodes.count == 0) return 0;
+
+  BvhStack stack;
+  bvhStackBegin(&stack);
+  bvhStackPush(&stack, 0);
+
+  while (stack.count > 0) {
+    const BvhNode *node = &bvh->nodes.items[stack.items[--stack.count]];
+    if (!overlaps(node->bounds, rect)) continue;
+
+    if (node->count == 0) {
+      bvhStackPush(&stack, node->first + 1);
+      bvhStackPush(&stack, node->first);
+      continue;
+    }
+
+    for (uint32_t i = node->first; i < node->first + node->count; i++) {
+      if (!overlaps(bvh->items.items[i].rect, rect)) continue;
+      if (found < capacity) out[found] = &bvh->items.items[i];
+      found++;
+    }
+  }
+  bvhStackEnd(&stack);
+  return found;
+}
+
+// Early-out collision test, skipping up to two items (e.g. the rooms a new
+// corridor connects).
+bool bvhAnyOverlap(const Bvh *bvh, Rect rect, const void *ignoreA, const void *ignoreB) {
+  if (bvh->nodes.count == 0) return false;
+
+  BvhStack stack;
+  bvhStackBegin(&stack);
+  bvhStackPush(&stack, 0);
+
+  bool hit = false;
+  while (!hit && stack.count > 0) {
+    const BvhNode *node = &bvh->nodes.items[stack.items[--stack.count]];
+    if (!overlaps(node->bounds, rect)) continue;
+
+    if (node->count == 0) {
+      bvhStackPush(&stack, node->first + 1);
+      bvhStackPush(&stack, node->first);
+      continue;
+    }
+
+    for (uint32_t i = node->first; i < node->first + node->count && !hit; i++) {
+      const BvhItem *item = &bvh->items.items[i];
+      if (item->ptr == ignoreA || item->ptr == ignoreB) continue;
+      hit = overlaps(item->rect, rect);
+    }
+  }
+  bvhStackEnd(&stack);
+  return hit;
+}
+
+typedef struct {
+  float ox, oy;
+  float dx, dy;
+  float invX, invY;
+} BvhRay;
+
+// Narrows [tmin, tmax] to where the ray is inside the slab lo..hi. A ray
+// parallel to the slab is inside it everywhere or nowhere; 1/0 would give
+// 0 * inf = NaN there whenever the origin sits on a boundary.
+static bool raySlab(float lo, float hi, float o, float d, float inv, float *tmin, float *tmax) {
+  if (d == 0.0f) return o >= lo && o <= hi;
+
+  float t1 = (lo - o) * inv, t2 = (hi - o) * inv;
+  *tmin = MAX(*tmin, MIN(t1, t2));
+  *tmax = MIN(*tmax, MAX(t1, t2));
+  return true;
+}
+
+// Slab test; returns the entry distance along the ray or FLT_MAX on a miss.
+static float rayRect(Rect r, const BvhRay *ray, float maxDistance) {
+  float tmin = 0.0f, tmax = FLT_MAX;
+  if (!raySlab(r.x1, r.x2, ray->ox, ray->dx, ray->invX, &tmin, &tmax)) return FLT_MAX;
+  if (!raySlab(r.y1, r.y2, ray->oy, ray->dy, ray->invY, &tmin, &tmax)) return FLT_MAX;
+
+  if (tmax < tmin || tmin > maxDistance) return FLT_MAX;
+  return tmin;
+}
+
+// Nearest item hit by the ray (dx, dy need not be normalized; distances are
+// in units of the direction's length).
+bool bvhRaycast(const Bvh *bvh, float ox, float oy, float dx, float dy, float maxDistance, BvhHit *hit) {
+  BvhRay ray = {
+    ox, oy, dx, dy,
+    dx != 0.0f ? 1.0f / dx : 0.0f,
+    dy != 0.0f ? 1.0f / dy : 0.0f,
+  };
+  *hit = (BvhHit){ NULL, maxDistance };
+  if (bvh->nodes.count == 0) return false;
+
+  BvhStack stack;
+  bvhStackBegin(&stack);
+  bvhStackPush(&stack, 0);
+
+  while (stack.count > 0) {
+    const BvhNode *node = &bvh->nodes.items[stack.items[--stack.count]];
+    if (rayRect(node->bounds, &ray, hit->distance) == FLT_MAX) continue;
+
+    if (node->count == 0) {
+      bvhStackPush(&stack, node->first + 1);
+      bvhStackPush(&stack, node->first);
+      continue;
+    }
+
+    for (uint32_t i = node->first; i < node->first + node->count; i++) {
+      BvhItem *item = &bvh->items.items[i];
+      float t = rayRect(item->rect, &ray, hit->distance);
+      if (t != FLT_MAX && (hit->item == NULL || t < hit->distance)) {
+        *hit = (BvhHit){ item, t };
+      }
+    }
+  }
+  bvhStackEnd(&stack);
+  return hit->item != NULL;
+}
+
+static float pointRectDistance(Rect r, float x, float y) {
+  float dx = MAX(MAX(r.x1 - x, 0.0f), x - r.x2);
+  float dy = MAX(MAX(r.y1 - y, 0.0f), y - r.y2);
+  return sqrtf(dx * dx + dy * dy);
+}
+
+// Closest item to the point (distance 0 when inside). Visits the nearer
+// child first and prunes subtrees farther than the best hit so far.
+bool bvhNearest(const Bvh *bvh, float x, float y, BvhHit *hit) {
+  *hit = (BvhHit){ NULL, FLT_MAX };
+  if (bvh->nodes.count == 0) return false;
+
+  BvhStack stack;
+  bvhStackBegin(&stack);
+  bvhStackPush(&stack, 0);
+
+  while (stack.count > 0) {
+    const BvhNode *node = &bvh->nodes.items[stack.items[--stack.count]];
+    if (pointRectDistance(node->bounds, x, y) >= hit->distance) continue;
+
+    if (node->count == 0) {
+      uint32_t left = node->first, right = node->first + 1;
+      float dl = pointRectDistance(bvh->nodes.items[left].bounds, x, y);
+      float dr = pointRectDistance(bvh->nodes.items[right].bounds, x, y);
+
+      bvhStackPush(&stack, dl < dr ? right : left);
+      bvhStackPush(&stack, dl < dr ? left : right);
+      continue;
+    }
+
+    for (uint32_t i = node->first; i < node->first + node->count; i++) {
+      float d = pointRectDistance(bvh->items.items[i].rect, x, y);
+      if (d < hit->distance) *hit = (BvhHit){ &bvh->items.items[i], d };
+    }
+  }
+  bvhStackEnd(&stack);
+  return true;
+}
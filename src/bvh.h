@@ -0,0 +1,95 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+
+// Bounding-volume hierarchy over the final room and hall rectangles, built
+// with a binned surface-area heuristic (perimeter in 2D) into one flat node
+// array. An internal node has count 0 and its two children sit side by side
+// from `first`; a leaf holds items[first, first + count). A tree over no
+// items has no nodes, and every query on it finds nothing.
+
+typedef enum {
+  BVH_ROOM,
+  BVH_HALL,
+} BvhKind;
+
+typedef struct {
+  Rect rect;
+  BvhKind kind;
+  // Cell * for rooms, Hall * for halls
+  void *ptr;
+} BvhItem;
+
+typedef struct {
+  Rect bounds;
+  uint32_t first;
+  uint32_t count;
+} BvhNode;
+
+typedef struct {
+  BvhNode *items;
+  size_t count;
+  size_t capacity;
+} BvhNodeArray;
+
+typedef struct {
+  BvhItem *items;
+  size_t count;
+  size_t capacity;
+} BvhItemArray;
+
+struct Bvh {
+  BvhNodeArray nodes;
+  BvhItemArray items;
+};
+
+typedef struct {
+  BvhItem *item;
+  float distance;
+} BvhHit;
+
+typedef struct {
+  Cell *cell;
+  uint32_t node;
+} BvhCellNode;
+
+typedef struct {
+  BvhCellNode *items;
+  size_t count;
+  size_t capacity;
+} BvhCellNodeArray;
+
+// Resumable build of a room hierarchy shaped like the BSP: every cell
+// becomes a node bounding the rooms below it. Each step lays out or bounds
+// one node in O(1), so generation can index its rooms a little at a time
+// instead of in one SAH build.
+struct BvhBuild {
+  Bvh *bvh;
+  // Cells still to lay out, with the nodes reserved for them
+  BvhCellNodeArray pending;
+  // Nodes still to bound, taken from the back: children come after their
+  // parent
+  size_t unbounded;
+};
+
+void buildBvh(Bvh *bvh, Map *map);
+void buildBvhFromItems(Bvh *bvh);
+void freeBvh(Bvh *bvh);
+// Steps bvhBuildStep() takes over a BSP with `leafCount` leaves
+size_t bvhBuildUnits(size_t leafCount);
+void bvhBuildBegin(BvhBuild *build, Bvh *bvh, Cell *root, size_t leafCount);
+// Runs one step; returns false once the hierarchy is complete
+bool bvhBuildStep(BvhBuild *build);
+void bvhBuildEnd(BvhBuild *build);
+
+size_t bvhOverlap(const Bvh *bvh, Rect rect, BvhItem **out, size_t capacity);
+bool bvhAnyOverlap(const Bvh *bvh, Rect rect, const void *ignoreA, const void *ignoreB);
+bool bvhRaycast(const Bvh *bvh, float ox, float oy, float dx, float dy, float maxDistance, BvhHit *hit);
+bool bvhNearest(const Bvh *bvh, float x, float y, BvhHit *hit);
+
+#endif // BVH_H_
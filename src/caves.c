@@ -0,0 +1,225 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./caves.h"
+#include "./mapgen.h"
+#include "./query.h"
+#include "./raster.h"
+#include "./utils.h"
+
+// Bit i of word j in a row is tile j * 64 + i of that row, set for wall.
+// Bits past the room's right edge stay set so they read as wall too.
+
+#define CAVE_MAJORITY(a, b, c) (((a) & (b)) | ((c) & ((a) ^ (b))))
+
+typedef struct {
+  uint64_t *items;
+  size_t count;
+  size_t capacity;
+} CaveWords;
+
+typedef struct {
+  Hall **items;
+  size_t count;
+  size_t capacity;
+} CaveHalls;
+
+typedef struct {
+  Map *map;
+  Grid *grid;
+  const CaveConfig *config;
+  size_t *nextRoom;
+} CaveWorker;
+
+// Lanes where the number held across `bits` slices (slices[0] the lowest
+// bit) is at least `value`.
+static uint64_t slicedAtLeast(const uint64_t *slices, int bits, uint32_t value) {
+  if (value >= 1u << bits) return 0;
+
+  uint64_t greater = 0, equal = ~0ull;
+  for (int i = bits - 1; i >= 0; i--) {
+    if (value >> i & 1) {
+      equal &= slices[i];
+    } else {
+      greater |= equal & slices[i];
+      equal &= ~slices[i];
+    }
+  }
+  return greater | equal;
+}
+
+// Each wall bit takes 8 random bits per lane, compared against the fill
+// scaled to 256ths.
+static void caveSeed(uint64_t *words, size_t count, uint8_t fill, Rng *rng) {
+  uint32_t cut = (MIN(fill, 100) * 256 + 50) / 100;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t random[8];
+    for (int b = 0; b < 8; b++) random[b] = rngNext(rng);
+    words[i] = ~slicedAtLeast(random, 8, cut);
+  }
+}
+
+static void pinRect(uint64_t *pinned, size_t stride, Rect room, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+  x1 = MAX(x1, room.x1) - room.x1;
+  y1 = MAX(y1, room.y1) - room.y1;
+  x2 = MIN(x2, room.x2) - room.x1;
+  y2 = MIN(y2, room.y2) - room.y1;
+
+  for (int32_t y = y1; y < y2; y++) {
+    for (int32_t x = x1; x < x2; x++) pinned[y * stride + x / 64] |= 1ull << (x % 64);
+  }
+}
+
+// Room tiles a hall enters through, or that a hall runs over, stay floor.
+static void cavePins(Map *map, Rect room, uint64_t *pinned, size_t stride, CaveHalls *halls) {
+  Rect around = { room.x1 - 1, room.y1 - 1, room.x2 + 1, room.y2 + 1 };
+  size_t found;
+  while ((found = queryHalls(map, around, halls->items, halls->capacity)) > halls->capacity) {
+    da_reserve(halls, found);
+  }
+
+  for (size_t i = 0; i < found; i++) {
+    Hall *hall = halls->items[i];
+    int32_t x1 = MIN(hall->x1, hall->x2), x2 = MAX(hall->x1, hall->x2);
+    int32_t y1 = MIN(hall->y1, hall->y2), y2 = MAX(hall->y1, hall->y2);
+    pinRect(pinned, stride, room, x1 - 1, y1, x2 + 1, y2);
+    pinRect(pinned, stride, room, x1, y1 - 1, x2, y2 + 1);
+  }
+}
+
+// One smoothing step. The first pass sums every tile with its left and right
+// neighbours into two bit slices; the second adds three such row sums into
+// the four-slice count of the whole 3x3 block.
+static void caveStep(const uint64_t *cur, uint64_t *next, uint64_t *sums, uint64_t *carries,
+                     size_t stride, int h, uint32_t threshold) {
+  for (int y = 0; y < h; y++) {
+    const uint64_t *row = &cur[(size_t)y * stride];
+    uint64_t *rowSums = &sums[(size_t)y * stride];
+    uint64_t *rowCarries = &carries[(size_t)y * stride];
+
+    for (size_t x = 0; x < stride; x++) {
+      uint64_t left = row[x] << 1 | (x > 0 ? row[x - 1] >> 63 : 1);
+      uint64_t right = row[x] >> 1 | (x + 1 < stride ? row[x + 1] << 63 : 1ull << 63);
+      rowSums[x] = left ^ row[x] ^ right;
+      rowCarries[x] = CAVE_MAJORITY(left, row[x], right);
+    }
+  }
+
+  // Rows above and below the room are all wall, a row sum of three
+  for (int y = 0; y < h; y++) {
+    size_t i = (size_t)y * stride;
+    for (size_t x = 0; x < stride; x++, i++) {
+      uint64_t sa = y > 0 ? sums[i - stride] : ~0ull;
+      uint64_t ca = y > 0 ? carries[i - stride] : ~0ull;
+      uint64_t sc = y + 1 < h ? sums[i + stride] : ~0ull;
+      uint64_t cc = y + 1 < h ? carries[i + stride] : ~0ull;
+
+      uint64_t twos = CAVE_MAJORITY(sa, sums[i], sc);
+      uint64_t fours = CAVE_MAJORITY(ca, carries[i], cc);
+      uint64_t otherTwos = ca ^ carries[i] ^ cc;
+      uint64_t count[4] = {
+        sa ^ sums[i] ^ sc,
+        twos ^ otherTwos,
+        fours ^ (twos & otherTwos),
+        fours & twos & otherTwos,
+      };
+      next[i] = slicedAtLeast(count, 4, threshold);
+    }
+  }
+}
+
+static void caveEdges(uint64_t *words, const uint64_t *pinned, size_t stride, int h, uint64_t tail) {
+  for (size_t i = 0; i < stride * h; i++) words[i] &= ~pinned[i];
+  for (int y = 0; y < h; y++) words[(size_t)y * stride + stride - 1] |= tail;
+}
+
+static void carveRoom(CaveWorker *worker, Rect room, Rng *rng, CaveWords *scratch, CaveHalls *halls) {
+  Grid *grid = worker->grid;
+  const CaveConfig *config = worker->config;
+  room.x1 = MAX(room.x1, 0);
+  room.y1 = MAX(room.y1, 0);
+  room.x2 = MIN(room.x2, grid->width);
+  room.y2 = MIN(room.y2, grid->height);
+
+  int w = room.x2 - room.x1, h = room.y2 - room.y1;
+  if (w <= 0 || h <= 0) return;
+
+  size_t stride = (w + 63) / 64;
+  size_t words = stride * h;
+  da_reserve(scratch, 5 * words);
+  uint64_t *cur = scratch->items;
+  uint64_t *next = cur + words;
+  uint64_t *sums = next + words;
+  uint64_t *carries = sums + words;
+  uint64_t *pinned = carries + words;
+  uint64_t tail = w % 64 ? ~0ull << (w % 64) : 0;
+
+  memset(pinned, 0, words * sizeof(uint64_t));
+  cavePins(worker->map, room, pinned, stride, halls);
+  caveSeed(cur, words, config->fill, rng);
+  caveEdges(cur, pinned, stride, h, tail);
+
+  for (int i = 0; i < config->iterations; i++) {
+    caveStep(cur, next, sums, carries, stride, h, config->threshold);
+    caveEdges(next, pinned, stride, h, tail);
+    uint64_t *t = cur;
+    cur = next;
+    next = t;
+  }
+
+  for (int y = 0; y < h; y++) {
+    const uint64_t *row = &cur[(size_t)y * stride];
+    uint8_t *tiles = &GRID_AT(grid, room.x1, room.y1 + y);
+    for (int x = 0; x < w; x++) {
+      if (row[x / 64] >> (x % 64) & 1 && tiles[x] == TILE_ROOM) tiles[x] = TILE_WALL;
+    }
+  }
+}
+
+static void *caveWorker(void *arg) {
+  CaveWorker *worker = arg;
+  Map *map = worker->map;
+  CaveWords scratch = {0};
+  CaveHalls halls = {0};
+
+  for (;;) {
+    size_t i = __atomic_fetch_add(worker->nextRoom, 1, __ATOMIC_RELAXED);
+    if (i >= map->cells.count) break;
+
+    Cell *cell = map->cells.items[i];
+    Rng rng = { map->seed ^ (0xD1B54A32D192ED03ull * (i + 1)) };
+    carveRoom(worker, (Rect){ cell->x1, cell->y1, cell->x2, cell->y2 }, &rng, &scratch, &halls);
+  }
+
+  free(scratch.items);
+  free(halls.items);
+  return NULL;
+}
+
+void carveCaves(Map *map, Grid *grid, const CaveConfig *config, size_t threads) {
+  threads = MIN(MAX(threads, (size_t)1), MAX(map->cells.count, (size_t)1));
+  CaveWorker *workers = malloc(threads * sizeof(CaveWorker));
+  pthread_t *pool = malloc(threads * sizeof(pthread_t));
+  ASSERT(workers != NULL && pool != NULL);
+
+  size_t nextRoom = 0;
+  for (size_t i = 0; i < threads; i++) {
+    workers[i] = (CaveWorker){ map, grid, config, &nextRoom };
+  }
+
+  for (size_t i = 1; i < threads; i++) pthread_create(&pool[i], NULL, caveWorker, &workers[i]);
+  caveWorker(&workers[0]);
+  for (size_t i = 1; i < threads; i++) pthread_join(pool[i], NULL);
+
+  free(workers);
+  free(pool);
+}
+
+void rasterizeLevel(Map *map, Grid *grid, size_t threads) {
+  rasterizeMap(map, grid);
+  if (map->caves) carveCaves(map, grid, &CAVE_CONFIG_DEFAULT, threads);
+}
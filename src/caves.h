@@ -0,0 +1,36 @@
+#ifndef CAVES_H_
+#define CAVES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+#include "./raster.h"
+
+typedef struct {
+  // Share of each room seeded as wall, in percent
+  uint8_t fill;
+  uint8_t iterations;
+  // A tile turns to wall when at least this many of the nine tiles of its
+  // 3x3 block are wall, floor otherwise (5 is the classic 4-5 rule)
+  uint8_t threshold;
+} CaveConfig;
+
+#define CAVE_CONFIG_DEFAULT ((CaveConfig){ .fill = 45, .iterations = 5, .threshold = 5 })
+
+// Turns the rooms of a rasterized map into caves by cellular-automata
+// smoothing inside each room's bounds. Everything outside a room counts as
+// wall, and room tiles where a hall enters are kept open, though the cave
+// may still cut them off from the rest of the room.
+//
+// Rooms are stored 64 tiles to a word and every step counts neighbours for
+// a whole word at once with bit-sliced adders. Rooms are shared out between
+// `threads` workers; each room draws from its own generator seeded from the
+// map's seed, so the result doesn't depend on the thread count.
+void carveCaves(Map *map, Grid *grid, const CaveConfig *config, size_t threads);
+
+// rasterizeMap(), then carveCaves() with CAVE_CONFIG_DEFAULT when the map
+// was configured with caves.
+void rasterizeLevel(Map *map, Grid *grid, size_t threads);
+
+#endif // CAVES_H_
@@ -0,0 +1,209 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./codec.h"
+#include "./mapgen.h"
+#include "./raster.h"
+#include "./utils.h"
+
+static void putVarint(String_Builder *out, uint64_t value) {
+  uint8_t buf[10];
+  size_t n = 0;
+  while (value >= 0x80) {
+    buf[n++] = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  buf[n++] = (uint8_t)value;
+  da_append_many(out, (const char *)buf, n);
+}
+
+static inline uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+typedef struct {
+  const uint8_t *at;
+  const uint8_t *end;
+} Cursor;
+
+static inline bool getVarint(Cursor *c, uint64_t *value) {
+  // Fast path: run lengths and deltas are almost always a single byte
+  if (c->at < c->end && *c->at < 0x80) {
+    *value = *c->at++;
+    return true;
+  }
+
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && c->at < c->end; shift += 7) {
+    uint8_t byte = *c->at++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+void encodeGrid(const Grid *grid, String_Builder *out) {
+  putVarint(out, grid->width);
+  putVarint(out, grid->height);
+
+  for (int y = 0; y < grid->height;) {
+    const uint8_t *row = &GRID_AT(grid, 0, y);
+
+    int repeat = 1;
+    while (y + repeat < grid->height &&
+           memcmp(row, &GRID_AT(grid, 0, y + repeat), grid->width) == 0) {
+      repeat++;
+    }
+    putVarint(out, repeat);
+
+    for (int x = 0; x < grid->width;) {
+      int run = 1;
+      while (x + run < grid->width && row[x + run] == row[x]) run++;
+      da_append(out, (char)row[x]);
+      putVarint(out, run);
+      x += run;
+    }
+
+    y += repeat;
+  }
+}
+
+// Sizes come from untrusted input, so they are capped before anything is
+// allocated for them. A grid with any tiles takes at least a row group of
+// three bytes: repeat count, tile and run length.
+static bool readGridSize(Cursor *c, uint64_t *width, uint64_t *height) {
+  if (!getVarint(c, width) || !getVarint(c, height)) return false;
+  if (*width > CODEC_MAX_SIDE || *height > CODEC_MAX_SIDE) return false;
+  if (*width * *height > CODEC_MAX_TILES) return false;
+  return *width * *height == 0 || c->end - c->at >= 3;
+}
+
+// Decodes into an already allocated grid of matching size, so streaming
+// callers can reuse one buffer per chunk.
+bool decodeGridInto(const void *data, size_t size, Grid *grid) {
+  Cursor c = { data, (const uint8_t *)data + size };
+  uint64_t width, height;
+  if (!readGridSize(&c, &width, &height)) return false;
+  if ((int)width != grid->width || (int)height != grid->height) return false;
+
+  for (uint64_t y = 0; y < height;) {
+    uint64_t repeat;
+    if (!getVarint(&c, &repeat) || repeat == 0 || repeat > height - y) return false;
+
+    uint8_t *row = &GRID_AT(grid, 0, y);
+    for (uint64_t x = 0; x < width;) {
+      uint64_t run;
+      if (c.at >= c.end) return false;
+      uint8_t tile = *c.at++;
+      if (!getVarint(&c, &run) || run == 0 || run > width - x) return false;
+      memset(row + x, tile, run);
+      x += run;
+    }
+
+    for (uint64_t i = 1; i < repeat; i++) {
+      memcpy(row + i * width, row, width);
+    }
+    y += repeat;
+  }
+
+  return c.at == c.end;
+}
+
+bool decodeGrid(const void *data, size_t size, Grid *grid) {
+  Cursor c = { data, (const uint8_t *)data + size };
+  uint64_t width, height;
+  if (!readGridSize(&c, &width, &height)) return false;
+
+  // Not makeGrid, which gives up on a failed allocation instead of failing
+  // the decode
+  *grid = (Grid){ calloc(width * height, 1), width, height };
+  if (grid->tiles == NULL && width * height > 0) return false;
+  if (!decodeGridInto(data, size, grid)) {
+    freeGrid(grid);
+    return false;
+  }
+  return true;
+}
+
+typedef struct {
+  int64_t x, y;
+} RectCursor;
+
+static void putRect(String_Builder *out, RectCursor *prev, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+  int64_t gx1 = MIN(x1, x2), gy1 = MIN(y1, y2);
+  int64_t gx2 = MAX(x1, x2), gy2 = MAX(y1, y2);
+
+  putVarint(out, zigzag(gx1 - prev->x));
+  putVarint(out, zigzag(gy1 - prev->y));
+  putVarint(out, gx2 - gx1);
+  putVarint(out, gy2 - gy1);
+  *prev = (RectCursor){ gx1, gy1 };
+}
+
+void encodeMapRects(Map *map, String_Builder *out) {
+  size_t halls = 0;
+  for (size_t i = 0; i < map->cells.count; i++) {
+    halls += cellHalls(map, map->cells.items[i]).count;
+  }
+
+  putVarint(out, map->cells.count);
+  putVarint(out, halls);
+
+  RectCursor prev = {0};
+  for (size_t i = 0; i < map->cells.count; i++) {
+    Cell *cell = map->cells.items[i];
+    putRect(out, &prev, cell->x1, cell->y1, cell->x2, cell->y2);
+  }
+
+  prev = (RectCursor){0};
+  for (size_t i = 0; i < map->cells.count; i++) {
+    HallArray halls = cellHalls(map, map->cells.items[i]);
+    da_foreach(Hall, hall, &halls) putRect(out, &prev, hall->x1, hall->y1, hall->x2, hall->y2);
+  }
+}
+
+// Applies a zigzag delta to a coordinate, failing when the result leaves the
+// int32_t range every rect coordinate lives in.
+static bool stepCoord(int64_t *coord, uint64_t delta) {
+  int64_t step = unzigzag(delta);
+  if (step < -(int64_t)UINT32_MAX || step > (int64_t)UINT32_MAX) return false;
+  *coord += step;
+  return *coord >= INT32_MIN && *coord <= INT32_MAX;
+}
+
+static bool getRects(Cursor *c, HallArray *rects, uint64_t count) {
+  RectCursor prev = {0};
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t dx, dy, w, h;
+    if (!getVarint(c, &dx) || !getVarint(c, &dy) || !getVarint(c, &w) || !getVarint(c, &h)) {
+      return false;
+    }
+
+    if (!stepCoord(&prev.x, dx) || !stepCoord(&prev.y, dy)) return false;
+    if (w > (uint64_t)(INT32_MAX - prev.x) || h > (uint64_t)(INT32_MAX - prev.y)) return false;
+    Hall rect = { prev.x, prev.y, prev.x + w, prev.y + h };
+    da_append(rects, rect);
+  }
+  return true;
+}
+
+bool decodeMapRects(const void *data, size_t size, HallArray *rooms, HallArray *halls) {
+  Cursor c = { data, (const uint8_t *)data + size };
+  uint64_t roomCount, hallCount;
+
+  // Every rect takes at least four bytes, which bounds bogus counts
+  if (!getVarint(&c, &roomCount) || !getVarint(&c, &hallCount)) return false;
+  if (roomCount + hallCount > (size_t)(c.end - c.at) / 4) return false;
+
+  return getRects(&c, rooms, roomCount) && getRects(&c, halls, hallCount) && c.at == c.end;
+}
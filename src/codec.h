@@ -0,0 +1,34 @@
+#ifndef CODEC_H_
+#define CODEC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+#include "./raster.h"
+#include "./utils.h"
+
+// Lossless map codec, no external dependencies.
+//
+// Tile grids: varint width, height, then row groups. Each group is a varint
+// repeat count followed by the row as (tile byte, varint length) runs, so
+// rectangular rooms collapse into one group per distinct row.
+//
+// Rectangle lists: rooms then halls, each rect stored as
+// zigzag varint deltas of x1/y1 from the previous rect plus varint width
+// and height.
+
+// Largest grid the decoder accepts, so corrupt sizes fail the decode
+// rather than the allocation
+#define CODEC_MAX_SIDE (1u << 20)
+#define CODEC_MAX_TILES ((uint64_t)1 << 32)
+
+void encodeGrid(const Grid *grid, String_Builder *out);
+bool decodeGrid(const void *data, size_t size, Grid *grid);
+bool decodeGridInto(const void *data, size_t size, Grid *grid);
+
+void encodeMapRects(Map *map, String_Builder *out);
+bool decodeMapRects(const void *data, size_t size, HallArray *rooms, HallArray *halls);
+
+#endif // CODEC_H_
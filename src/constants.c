@@ -4,6 +4,25 @@
 #define TRUE 1
 #define FALSE 0
 
+// Defaults for MAP_CONFIG_DEFAULT; sizes other than CELLSIZE are grid units
 #define CELLSIZE 10
+#define SHOWGRID true
+#define MARGIN 3
+#define ROOMNUMBER 10
+#define MINCELLSIZE 1
+#define ROUTEHALLS true
+#define CAVES false
 
+#define MAP_CONFIG_DEFAULT                                                     \
+  ((MapConfig){                                                                \
+    .width = WINDOW_WIDTH / CELLSIZE,                                          \
+    .height = WINDOW_HEIGHT / CELLSIZE,                                        \
+    .margin = MARGIN,                                                          \
+    .numRooms = ROOMNUMBER,                                                    \
+    .minCellSize = MINCELLSIZE,                                                \
+    .cellSize = CELLSIZE,                                                      \
+    .showGrid = SHOWGRID,                                                      \
+    .routeHalls = ROUTEHALLS,                                                  \
+    .caves = CAVES,                                                            \
+  })
 
@@ -0,0 +1,177 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./distance.h"
+#include "./mapgen.h"
+#include "./raster.h"
+#include "./utils.h"
+
+DistanceField makeDistanceField(int width, int height) {
+  DistanceField field = { malloc((size_t)width * height * sizeof(uint16_t)), width, height };
+  ASSERT((field.dist != NULL || width * height == 0) && "Buy more RAM lol");
+  return field;
+}
+
+void freeDistanceField(DistanceField *field) {
+  free(field->dist);
+  *field = (DistanceField){0};
+}
+
+typedef struct {
+  const Grid *grid;
+  DistanceField *field;
+  // Columns x1..x2 for the column pass, rows y1..y2 for the row pass
+  int x1, x2;
+  int y1, y2;
+} DistanceBand;
+
+// Vertical distance to the nearest wall, down then up, a row at a time so
+// the inner loops are plain element-wise selects and mins. The field doubles
+// as storage for it until the row pass overwrites each row.
+static void *distanceColumns(void *arg) {
+  DistanceBand *band = arg;
+  const Grid *grid = band->grid;
+  DistanceField *field = band->field;
+  int x1 = band->x1, x2 = band->x2;
+  int h = grid->height;
+
+  const uint8_t *tiles = &GRID_AT(grid, 0, 0);
+  uint16_t *row = &DIST_AT(field, 0, 0);
+  for (int x = x1; x < x2; x++) row[x] = tiles[x] == TILE_WALL ? 0 : 1;
+
+  for (int y = 1; y < h; y++) {
+    tiles = &GRID_AT(grid, 0, y);
+    row = &DIST_AT(field, 0, y);
+    const uint16_t *above = row - field->width;
+    for (int x = x1; x < x2; x++) row[x] = (uint16_t)(above[x] + 1) & -(uint16_t)(tiles[x] != TILE_WALL);
+  }
+
+  row = &DIST_AT(field, 0, h - 1);
+  for (int x = x1; x < x2; x++) row[x] = MIN(row[x], 1);
+
+  for (int y = h - 2; y >= 0; y--) {
+    row = &DIST_AT(field, 0, y);
+    const uint16_t *below = row + field->width;
+    for (int x = x1; x < x2; x++) row[x] = MIN(row[x], below[x] + 1);
+  }
+  return NULL;
+}
+
+// Lower envelope of the parabolas (x - q)^2 + g(q)^2 along one row, with the
+// walls past either end of the row as extra zero-height sites.
+static void distanceRow(uint16_t *row, int w, int64_t *sites, int64_t *heights, double *bounds) {
+  size_t k = 0;
+  sites[0] = -1;
+  heights[0] = 0;
+  bounds[0] = -INFINITY;
+  bounds[1] = INFINITY;
+
+  for (int64_t q = 0; q <= w; q++) {
+    int64_t f = q < w ? (int64_t)row[q] * row[q] : 0;
+
+    // bounds[0] is -inf, so the first site is never popped
+    double s;
+    for (;;) {
+      int64_t v = sites[k];
+      s = ((double)(f + q * q) - (double)(heights[k] + v * v)) / (double)(2 * (q - v));
+      if (s > bounds[k]) break;
+      k--;
+    }
+
+    k++;
+    sites[k] = q;
+    heights[k] = f;
+    bounds[k] = s;
+    bounds[k + 1] = INFINITY;
+  }
+
+  k = 0;
+  for (int64_t x = 0; x < w; x++) {
+    while (bounds[k + 1] < x) k++;
+    int64_t d = (x - sites[k]) * (x - sites[k]) + heights[k];
+    double scaled = sqrt((double)d) * DIST_ONE + 0.5;
+    row[x] = scaled >= UINT16_MAX ? UINT16_MAX : (uint16_t)scaled;
+  }
+}
+
+static void *distanceRows(void *arg) {
+  DistanceBand *band = arg;
+  DistanceField *field = band->field;
+  int w = field->width;
+
+  int64_t *sites = malloc((w + 2) * sizeof(int64_t));
+  int64_t *heights = malloc((w + 2) * sizeof(int64_t));
+  double *bounds = malloc((w + 3) * sizeof(double));
+  ASSERT(sites != NULL && heights != NULL && bounds != NULL);
+
+  for (int y = band->y1; y < band->y2; y++) {
+    distanceRow(&DIST_AT(field, 0, y), w, sites, heights, bounds);
+  }
+
+  free(sites);
+  free(heights);
+  free(bounds);
+  return NULL;
+}
+
+static void runDistanceBands(DistanceBand *bands, pthread_t *pool, size_t count, void *(*pass)(void *)) {
+  for (size_t i = 1; i < count; i++) pthread_create(&pool[i], NULL, pass, &bands[i]);
+  pass(&bands[0]);
+  for (size_t i = 1; i < count; i++) pthread_join(pool[i], NULL);
+}
+
+void distanceTransform(const Grid *grid, DistanceField *field, size_t threads) {
+  ASSERT(field->width == grid->width && field->height == grid->height);
+  // Column distances are kept in the uint16 field before scaling
+  ASSERT(grid->height < UINT16_MAX);
+  if (grid->width == 0 || grid->height == 0) return;
+
+  threads = MIN(MAX(threads, (size_t)1), (size_t)MIN(grid->width, grid->height));
+  DistanceBand *bands = malloc(threads * sizeof(DistanceBand));
+  pthread_t *pool = malloc(threads * sizeof(pthread_t));
+  ASSERT(bands != NULL && pool != NULL);
+
+  for (size_t i = 0; i < threads; i++) {
+    bands[i] = (DistanceBand){
+      .grid = grid,
+      .field = field,
+      .x1 = grid->width * i / threads,
+      .x2 = grid->width * (i + 1) / threads,
+      .y1 = grid->height * i / threads,
+      .y2 = grid->height * (i + 1) / threads,
+    };
+  }
+
+  runDistanceBands(bands, pool, threads, distanceColumns);
+  runDistanceBands(bands, pool, threads, distanceRows);
+
+  free(bands);
+  free(pool);
+}
+
+float distanceAt(const DistanceField *field, int x, int y) {
+  if (x < 0 || y < 0 || x >= field->width || y >= field->height) return 0;
+  return (float)DIST_AT(field, x, y) / DIST_ONE;
+}
+
+bool distancePeak(const DistanceField *field, Rect region, int *x, int *y) {
+  int x1 = MAX(region.x1, 0), y1 = MAX(region.y1, 0);
+  int x2 = MIN(region.x2, field->width), y2 = MIN(region.y2, field->height);
+  uint16_t best = 0;
+
+  for (int ty = y1; ty < y2; ty++) {
+    const uint16_t *row = &DIST_AT(field, 0, ty);
+    for (int tx = x1; tx < x2; tx++) {
+      if (row[tx] > best) {
+        best = row[tx];
+        *x = tx;
+        *y = ty;
+      }
+    }
+  }
+  return best > 0;
+}
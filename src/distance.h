@@ -0,0 +1,39 @@
+#ifndef DISTANCE_H_
+#define DISTANCE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+#include "./raster.h"
+
+// Exact Euclidean distance from every tile to the nearest wall tile, with
+// everything outside the grid counting as wall. Stored as fixed point with
+// DIST_FRACTION_BITS fraction bits, saturating at UINT16_MAX, so one field
+// covers distances up to 4095 tiles in two bytes per tile.
+#define DIST_FRACTION_BITS 4
+#define DIST_ONE (1 << DIST_FRACTION_BITS)
+
+typedef struct {
+  uint16_t *dist;
+  int width;
+  int height;
+} DistanceField;
+
+#define DIST_AT(field, x, y) ((field)->dist[(size_t)(y) * (field)->width + (x)])
+
+DistanceField makeDistanceField(int width, int height);
+void freeDistanceField(DistanceField *field);
+
+// Felzenszwalb-Huttenlocher in two separable passes: a column pass that
+// sweeps whole rows at a time (branch-free inner loops the compiler can
+// vectorize) with columns split across threads, then a lower envelope of parabolas per row with
+// rows split across threads. `field` must match the grid's size.
+void distanceTransform(const Grid *grid, DistanceField *field, size_t threads);
+
+float distanceAt(const DistanceField *field, int x, int y);
+// The tile in `region` furthest from any wall, e.g. the spot for a light or
+// a large prop. Returns false if the region holds no floor.
+bool distancePeak(const DistanceField *field, Rect region, int *x, int *y);
+
+#endif // DISTANCE_H_
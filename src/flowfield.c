@@ -0,0 +1,272 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./flowfield.h"
+#include "./raster.h"
+#include "./utils.h"
+
+static const uint8_t tileCost[] = {
+  [TILE_WALL] = 0,
+  [TILE_ROOM] = 1,
+  // Weighting halls spreads a crowd over the rooms instead of queueing every
+  // monster into the nearest corridor
+  [TILE_HALL] = 2,
+};
+
+static size_t flowSize(const FlowField *field) {
+  return (size_t)field->stride * (field->height + 2);
+}
+
+FlowField makeFlowField(const Grid *grid) {
+  FlowField field = {
+    .width = grid->width,
+    .height = grid->height,
+    .stride = grid->width + 2,
+    .horizon = FLOW_UNREACHED - 1,
+  };
+  size_t size = flowSize(&field);
+
+  field.cost = calloc(size, 1);
+  field.dist = malloc(size * sizeof(uint16_t));
+  field.affected = calloc(size, 1);
+  ASSERT(field.cost != NULL && field.dist != NULL && field.affected != NULL && "Buy more RAM lol");
+
+  for (int y = 0; y < grid->height; y++) {
+    const uint8_t *row = &GRID_AT(grid, 0, y);
+    uint8_t *cost = &field.cost[FLOW_INDEX(&field, 0, y)];
+    for (int x = 0; x < grid->width; x++) {
+      cost[x] = tileCost[row[x]];
+      field.floorTiles += cost[x] != 0;
+    }
+  }
+  memset(field.dist, 0xFF, size * sizeof(uint16_t));
+  return field;
+}
+
+void freeFlowField(FlowField *field) {
+  for (size_t i = 0; i < FLOW_BUCKETS; i++) free(field->buckets[i].items);
+  free(field->cost);
+  free(field->dist);
+  free(field->affected);
+  free(field->affectedList.items);
+  free(field->sources.items);
+  free(field->seeds.items);
+  *field = (FlowField){0};
+}
+
+static int compareSeeds(const void *pa, const void *pb) {
+  const FlowSeed *a = pa, *b = pb;
+  if (a->distance != b->distance) return a->distance < b->distance ? -1 : 1;
+  return (a->index > b->index) - (a->index < b->index);
+}
+
+// Dial's algorithm over the bucket ring. The seeds, sorted by distance, join
+// the frontier when the expansion reaches their distance, so repairs can
+// start from tiles at any distance.
+static void flowPropagate(FlowField *field) {
+  FlowSeedArray *seeds = &field->seeds;
+  size_t nextSeed = 0, pending = 0;
+  uint32_t distance = 0;
+  int32_t offsets[4] = { -1, 1, -(int32_t)field->stride, (int32_t)field->stride };
+
+  while (pending > 0 || nextSeed < seeds->count) {
+    if (pending == 0) distance = seeds->items[nextSeed].distance;
+
+    FlowQueue *bucket = &field->buckets[distance % FLOW_BUCKETS];
+    for (; nextSeed < seeds->count && seeds->items[nextSeed].distance == distance; nextSeed++) {
+      da_append(bucket, seeds->items[nextSeed].index);
+      pending++;
+    }
+
+    for (size_t i = 0; i < bucket->count; i++) {
+      uint32_t index = bucket->items[i];
+      if (field->dist[index] != distance) continue;
+
+      for (size_t k = 0; k < 4; k++) {
+        uint32_t next = index + offsets[k];
+        uint32_t cost = field->cost[next];
+        if (cost == 0 || distance + cost > field->horizon || distance + cost >= field->dist[next]) continue;
+
+        field->dist[next] = distance + cost;
+        da_append(&field->buckets[(distance + cost) % FLOW_BUCKETS], next);
+        pending++;
+      }
+    }
+
+    pending -= bucket->count;
+    bucket->count = 0;
+    distance++;
+  }
+  seeds->count = 0;
+}
+
+// Steps cost at least 1, so every distance the field holds lies within
+// `horizon` tiles of some source on both axes. Clears those boxes around the
+// current sources, or the whole field once they would cover most of it.
+static void flowClear(FlowField *field) {
+  size_t size = flowSize(field);
+  uint32_t r = field->horizon;
+  size_t side = 2 * (size_t)r + 1;
+  if (field->sources.count * side * side >= size) {
+    memset(field->dist, 0xFF, size * sizeof(uint16_t));
+    return;
+  }
+
+  da_foreach(uint32_t, source, &field->sources) {
+    uint32_t x = *source % field->stride, y = *source / field->stride;
+    uint32_t x1 = x > r ? x - r : 0, x2 = MIN(x + r, field->stride - 1);
+    uint32_t y1 = y > r ? y - r : 0, y2 = MIN(y + r, (uint32_t)field->height + 1);
+    for (uint32_t row = y1; row <= y2; row++) {
+      memset(&field->dist[row * field->stride + x1], 0xFF, (x2 - x1 + 1) * sizeof(uint16_t));
+    }
+  }
+}
+
+// Dijkstra from field->sources over a cleared field
+static void flowRebuild(FlowField *field) {
+  field->seeds.count = 0;
+  da_foreach(uint32_t, source, &field->sources) {
+    if (field->cost[*source] == 0 || field->dist[*source] == 0) continue;
+    field->dist[*source] = 0;
+    da_append(&field->seeds, ((FlowSeed){ *source, 0 }));
+  }
+  flowPropagate(field);
+}
+
+void flowFieldCompute(FlowField *field, const uint32_t *sources, size_t count) {
+  ASSERT(field->horizon <= FLOW_MAX_DISTANCE && "distances saturate at FLOW_MAX_DISTANCE");
+  flowClear(field);
+
+  if (sources != field->sources.items) {
+    field->sources.count = 0;
+    da_append_many(&field->sources, sources, count);
+  }
+  flowRebuild(field);
+}
+
+// A tile keeps its distance if some unaffected neighbour still offers it.
+static bool flowSupported(const FlowField *field, uint32_t index) {
+  uint32_t want = field->dist[index] - field->cost[index];
+  uint32_t neighbours[4] = { index - 1, index + 1, index - field->stride, index + field->stride };
+  for (size_t k = 0; k < 4; k++) {
+    uint32_t n = neighbours[k];
+    if (!field->affected[n] && field->dist[n] == want) return true;
+  }
+  return false;
+}
+
+// Finds every tile whose shortest paths all ran through the removed source,
+// in distance order so each tile is judged after all of its supporters.
+// Those tiles are reset and reseeded from their unaffected neighbours.
+// Returns false, leaving the field untouched, once too many are affected.
+static bool flowInvalidate(FlowField *field, uint32_t source) {
+  int32_t offsets[4] = { -1, 1, -(int32_t)field->stride, (int32_t)field->stride };
+  FlowQueue *affected = &field->affectedList;
+  size_t pending = 1;
+  uint32_t distance = 0;
+
+  // A source reaches at most the diamond of tiles within the horizon
+  size_t r = field->horizon;
+  size_t reachable = MIN(field->floorTiles, field->sources.count * (2 * r * (r + 1) + 1));
+
+  affected->count = 0;
+  da_append(&field->buckets[0], source);
+
+  while (pending > 0) {
+    FlowQueue *bucket = &field->buckets[distance % FLOW_BUCKETS];
+    for (size_t i = 0; i < bucket->count; i++) {
+      uint32_t index = bucket->items[i];
+      if (field->affected[index] || field->dist[index] != distance) continue;
+      if (index != source && flowSupported(field, index)) continue;
+
+      field->affected[index] = 1;
+      da_append(affected, index);
+
+      if (affected->count > reachable / FLOW_REBUILD_SHARE) {
+        da_foreach(uint32_t, marked, affected) field->affected[*marked] = 0;
+        for (size_t b = 0; b < FLOW_BUCKETS; b++) field->buckets[b].count = 0;
+        return false;
+      }
+
+      for (size_t k = 0; k < 4; k++) {
+        uint32_t next = index + offsets[k];
+        uint32_t cost = field->cost[next];
+        if (cost == 0 || field->affected[next] || field->dist[next] != distance + cost) continue;
+
+        da_append(&field->buckets[(distance + cost) % FLOW_BUCKETS], next);
+        pending++;
+      }
+    }
+
+    pending -= bucket->count;
+    bucket->count = 0;
+    distance++;
+  }
+
+  da_foreach(uint32_t, index, affected) field->dist[*index] = FLOW_UNREACHED;
+
+  da_foreach(uint32_t, index, affected) {
+    uint32_t best = FLOW_UNREACHED;
+    for (size_t k = 0; k < 4; k++) {
+      uint32_t n = *index + offsets[k];
+      best = MIN(best, (uint32_t)field->dist[n] + field->cost[*index]);
+    }
+    if (best <= field->horizon) {
+      field->dist[*index] = best;
+      da_append(&field->seeds, ((FlowSeed){ *index, best }));
+    }
+    field->affected[*index] = 0;
+  }
+  return true;
+}
+
+void flowFieldMoveSource(FlowField *field, uint32_t from, uint32_t to) {
+  if (from == to) return;
+  field->seeds.count = 0;
+
+  // Another source may still sit on the old tile
+  uint32_t *moved = NULL;
+  bool vacated = true;
+  da_foreach(uint32_t, source, &field->sources) {
+    if (*source != from) continue;
+    if (moved == NULL) moved = source; else vacated = false;
+  }
+
+  // Every path runs through a lone source, so none survive its move. The
+  // clear runs before the move, around the tiles the old distances are from.
+  if (vacated && field->dist[from] == 0
+      && (field->sources.count == 1 || !flowInvalidate(field, from))) {
+    flowClear(field);
+    if (moved != NULL) *moved = to;
+    flowRebuild(field);
+    field->rebuilds++;
+    return;
+  }
+  if (moved != NULL) *moved = to;
+
+  if (field->cost[to] != 0 && field->dist[to] != 0) {
+    field->dist[to] = 0;
+    da_append(&field->seeds, ((FlowSeed){ to, 0 }));
+  }
+
+  qsort(field->seeds.items, field->seeds.count, sizeof(FlowSeed), compareSeeds);
+  flowPropagate(field);
+}
+
+uint16_t flowFieldDistance(const FlowField *field, int x, int y) {
+  if (x < 0 || y < 0 || x >= field->width || y >= field->height) return FLOW_UNREACHED;
+  return field->dist[FLOW_INDEX(field, x, y)];
+}
+
+uint32_t flowFieldNext(const FlowField *field, uint32_t index) {
+  uint32_t neighbours[4] = { index - 1, index + 1, index - field->stride, index + field->stride };
+  uint32_t best = index;
+
+  for (size_t k = 0; k < 4; k++) {
+    if (field->dist[neighbours[k]] < field->dist[best]) best = neighbours[k];
+  }
+  return best;
+}
@@ -0,0 +1,89 @@
+#ifndef FLOWFIELD_H_
+#define FLOWFIELD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./raster.h"
+
+// Distance map over a tile grid for moving many agents towards a set of
+// sources (usually the player) at once. Every agent reads its next tile in
+// O(1) from the shared field instead of running its own search.
+//
+// Distances and step costs live in flat arrays padded by one impassable tile
+// on every side, so the four neighbours of an index are always at +-1 and
+// +-stride with no bounds checks, and resets are plain memsets.
+
+#define FLOW_UNREACHED UINT16_MAX
+// Distances are uint16_t and saturate here: tiles further than this from
+// every source read FLOW_UNREACHED, as if walled off. It is also the largest
+// horizon a field accepts.
+#define FLOW_MAX_DISTANCE (FLOW_UNREACHED - 1)
+// Step costs are 1..FLOW_MAX_COST, so a ring of FLOW_BUCKETS buckets holds
+// every distance the frontier can reach ahead of the one being expanded.
+#define FLOW_MAX_COST 3
+#define FLOW_BUCKETS 4
+// A repair that invalidates more than 1/FLOW_REBUILD_SHARE of the tiles the
+// sources can reach falls back to recomputing the field, which is cheaper
+// per tile.
+#define FLOW_REBUILD_SHARE 8
+
+#define FLOW_INDEX(field, x, y) ((uint32_t)((y) + 1) * (field)->stride + (uint32_t)((x) + 1))
+
+typedef struct {
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} FlowQueue;
+
+typedef struct {
+  uint32_t index;
+  uint16_t distance;
+} FlowSeed;
+
+typedef struct {
+  FlowSeed *items;
+  size_t count;
+  size_t capacity;
+} FlowSeedArray;
+
+typedef struct {
+  int width;
+  int height;
+  uint32_t stride;
+  // Cost of stepping onto each padded tile; 0 is impassable
+  uint8_t *cost;
+  uint16_t *dist;
+  size_t floorTiles;
+  // Tiles further than this from every source stay FLOW_UNREACHED, which
+  // keeps repairs and rebuilds local to the sources. At most
+  // FLOW_MAX_DISTANCE, the default; set before the first compute.
+  uint16_t horizon;
+  FlowQueue sources;
+  // Moves that fell back to a rebuild
+  size_t rebuilds;
+
+  // Scratch kept between updates
+  FlowQueue buckets[FLOW_BUCKETS];
+  uint8_t *affected;
+  FlowQueue affectedList;
+  FlowSeedArray seeds;
+} FlowField;
+
+FlowField makeFlowField(const Grid *grid);
+void freeFlowField(FlowField *field);
+
+// Multi-source Dijkstra from scratch; `sources` are tile indices.
+void flowFieldCompute(FlowField *field, const uint32_t *sources, size_t count);
+// Moves one source and repairs only the tiles whose distance changes, unless
+// so many change that a rebuild is cheaper. Moving the only source changes
+// every distance, so that always rebuilds; with a horizon the rebuild only
+// touches the tiles within it of the old and new positions.
+void flowFieldMoveSource(FlowField *field, uint32_t from, uint32_t to);
+
+uint16_t flowFieldDistance(const FlowField *field, int x, int y);
+// The neighbour one step closer to the nearest source, or `index` itself at a
+// source or where no source is reachable.
+uint32_t flowFieldNext(const FlowField *field, uint32_t index);
+
+#endif // FLOWFIELD_H_
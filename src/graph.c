@@ -0,0 +1,450 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./graph.h"
+#include "./mapgen.h"
+#include "./utils.h"
+
+// Overlapping or sharing an edge; rectangles that only meet at a corner
+// leave no floor between them.
+static bool floorTouches(Rect a, Rect b) {
+  if (a.x1 > b.x2 || b.x1 > a.x2 || a.y1 > b.y2 || b.y1 > a.y2) return false;
+  return (a.x1 < b.x2 && b.x1 < a.x2) || (a.y1 < b.y2 && b.y1 < a.y2);
+}
+
+static uint32_t findCorridor(uint32_t *parents, uint32_t i) {
+  while (parents[i] != i) i = parents[i] = parents[parents[i]];
+  return i;
+}
+
+typedef struct {
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} GraphIndices;
+
+// Uniform grid of square buckets, each listing the rects that overlap it,
+// laid out like the graph: bucket b's rects are items[starts[b]] up to
+// items[starts[b + 1]]. Buckets are about a room across, so a hall's
+// neighbourhood is a few buckets and building it is two linear passes.
+typedef struct {
+  int32_t x1, y1;
+  int32_t shift;
+  int32_t columns, rows;
+  uint32_t *starts;
+  uint32_t *items;
+} TouchGrid;
+
+static void touchBuckets(const TouchGrid *grid, Rect r, int32_t *bx1, int32_t *by1, int32_t *bx2, int32_t *by2) {
+  *bx1 = MAX((r.x1 - grid->x1) >> grid->shift, 0);
+  *by1 = MAX((r.y1 - grid->y1) >> grid->shift, 0);
+  *bx2 = MIN((r.x2 - grid->x1) >> grid->shift, grid->columns - 1);
+  *by2 = MIN((r.y2 - grid->y1) >> grid->shift, grid->rows - 1);
+}
+
+static void buildTouchGrid(TouchGrid *grid, Rect bounds, const Rect *rects, size_t count, size_t rooms) {
+  int64_t area = (int64_t)(bounds.x2 - bounds.x1) * (bounds.y2 - bounds.y1);
+  int32_t shift = 0;
+  while (shift < 24 && ((int64_t)1 << (2 * shift)) * (int64_t)MAX(rooms, (size_t)1) < area) shift++;
+
+  *grid = (TouchGrid){
+    .x1 = bounds.x1,
+    .y1 = bounds.y1,
+    .shift = shift,
+    .columns = ((bounds.x2 - bounds.x1) >> shift) + 1,
+    .rows = ((bounds.y2 - bounds.y1) >> shift) + 1,
+  };
+  size_t buckets = (size_t)grid->columns * grid->rows;
+  grid->starts = calloc(buckets + 2, sizeof(uint32_t));
+  ASSERT(grid->starts != NULL && "Buy more RAM lol");
+
+  // Count into starts[b + 2], sum so starts[b + 1] is where bucket b
+  // begins, then fill through it so it ends up where b ends
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < count; i++) {
+      int32_t bx1, by1, bx2, by2;
+      touchBuckets(grid, rects[i], &bx1, &by1, &bx2, &by2);
+      for (int32_t by = by1; by <= by2; by++) {
+        for (int32_t bx = bx1; bx <= bx2; bx++) {
+          size_t b = (size_t)by * grid->columns + bx;
+          if (pass == 0) grid->starts[b + 2]++;
+          else grid->items[grid->starts[b + 1]++] = i;
+        }
+      }
+    }
+    if (pass == 0) {
+      for (size_t b = 0; b < buckets; b++) grid->starts[b + 2] += grid->starts[b + 1];
+      grid->items = malloc(MAX(grid->starts[buckets + 1], 1u) * sizeof(uint32_t));
+      ASSERT(grid->items != NULL && "Buy more RAM lol");
+    }
+  }
+}
+
+static void freeTouchGrid(TouchGrid *grid) {
+  free(grid->starts);
+  free(grid->items);
+}
+
+// Corridors are sets of touching halls. Returns, per room, the sorted
+// corridors touching it: room i's are corridors[starts[i]] up to
+// corridors[starts[i + 1]].
+static void roomCorridors(Map *map, uint32_t **starts, GraphIndices *corridors) {
+  size_t rooms = map->cells.count, halls = map->graph.halls.count;
+
+  // Rooms first, then halls
+  Rect *rects = malloc(MAX(rooms + halls, (size_t)1) * sizeof(Rect));
+  ASSERT(rects != NULL && "Buy more RAM lol");
+  Rect bounds = map->bounds;
+  size_t n = 0;
+  da_foreach(Cell *, cell, &map->cells) {
+    rects[n++] = (Rect){ (*cell)->x1, (*cell)->y1, (*cell)->x2, (*cell)->y2 };
+  }
+  da_foreach(Hall, hall, &map->graph.halls) {
+    rects[n++] = (Rect){ hall->x1, hall->y1, hall->x2, hall->y2 };
+  }
+  for (size_t i = 0; i < n; i++) {
+    bounds = (Rect){ MIN(bounds.x1, rects[i].x1), MIN(bounds.y1, rects[i].y1),
+                     MAX(bounds.x2, rects[i].x2), MAX(bounds.y2, rects[i].y2) };
+  }
+
+  TouchGrid grid;
+  buildTouchGrid(&grid, bounds, rects, n, rooms);
+
+  uint32_t *parents = malloc(MAX(halls, (size_t)1) * sizeof(uint32_t));
+  ASSERT(parents != NULL && "Buy more RAM lol");
+  for (size_t i = 0; i < halls; i++) parents[i] = i;
+
+  // Room and hall pairs, flattened. A rect listed in several buckets shows
+  // up more than once, which only repeats a union or a link.
+  GraphIndices links = {0};
+  for (size_t h = 0; h < halls; h++) {
+    Rect hall = rects[rooms + h];
+    int32_t bx1, by1, bx2, by2;
+    touchBuckets(&grid, hall, &bx1, &by1, &bx2, &by2);
+
+    for (int32_t by = by1; by <= by2; by++) {
+      for (int32_t bx = bx1; bx <= bx2; bx++) {
+        size_t b = (size_t)by * grid.columns + bx;
+        for (uint32_t k = grid.starts[b]; k < grid.starts[b + 1]; k++) {
+          uint32_t other = grid.items[k];
+          if (other == rooms + h || !floorTouches(hall, rects[other])) continue;
+
+          if (other < rooms) {
+            da_append(&links, other);
+            da_append(&links, (uint32_t)h);
+          } else {
+            uint32_t a = findCorridor(parents, h), c = findCorridor(parents, other - rooms);
+            if (a != c) parents[MAX(a, c)] = MIN(a, c);
+          }
+        }
+      }
+    }
+  }
+  freeTouchGrid(&grid);
+
+  // Counting sort of the links by room, then each room's corridors sorted
+  // and deduplicated in place
+  uint32_t *start = calloc(rooms + 1, sizeof(uint32_t));
+  ASSERT(start != NULL && "Buy more RAM lol");
+  for (size_t i = 0; i < links.count; i += 2) start[links.items[i] + 1]++;
+  for (size_t i = 0; i < rooms; i++) start[i + 1] += start[i];
+
+  corridors->count = 0;
+  da_resize(corridors, links.count / 2);
+  uint32_t *fill = malloc(MAX(rooms, (size_t)1) * sizeof(uint32_t));
+  ASSERT(fill != NULL && "Buy more RAM lol");
+  memcpy(fill, start, rooms * sizeof(uint32_t));
+  for (size_t i = 0; i < links.count; i += 2) {
+    corridors->items[fill[links.items[i]]++] = findCorridor(parents, links.items[i + 1]);
+  }
+
+  size_t kept = 0;
+  for (size_t room = 0; room < rooms; room++) {
+    uint32_t *list = &corridors->items[start[room]];
+    size_t count = start[room + 1] - start[room];
+    start[room] = kept;
+    // Rooms touch a handful of halls, so insertion sort it is
+    for (size_t i = 1; i < count; i++) {
+      uint32_t value = list[i];
+      size_t j = i;
+      for (; j > 0 && list[j - 1] > value; j--) list[j] = list[j - 1];
+      list[j] = value;
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (i == 0 || list[i] != list[i - 1]) corridors->items[kept++] = list[i];
+    }
+  }
+  start[rooms] = kept;
+  corridors->count = kept;
+  *starts = start;
+
+  free(fill);
+  free(links.items);
+  free(parents);
+  free(rects);
+}
+
+static bool shareCorridor(const uint32_t *starts, const uint32_t *corridors, uint32_t a, uint32_t b) {
+  uint32_t i = starts[a], j = starts[b];
+  while (i < starts[a + 1] && j < starts[b + 1]) {
+    if (corridors[i] == corridors[j]) return true;
+    if (corridors[i] < corridors[j]) i++; else j++;
+  }
+  return false;
+}
+
+const RoomGraph *mapRoomGraph(Map *map) {
+  mapRequire(map, STAGE_HALLS);
+  RoomGraph *graph = &map->graph;
+  if (graph->analysed) return graph;
+
+  // Packed, the halls are exactly the ones the corridors are made of and
+  // edge positions can index the in lists and per-edge outputs
+  compactRoomGraph(graph);
+  size_t rooms = graph->roomCount, edges = graph->edges.count;
+
+  free(graph->inStart);
+  free(graph->inEdges);
+  graph->inStart = calloc(rooms + 2, sizeof(uint32_t));
+  graph->inEdges = malloc(MAX(edges, (size_t)1) * sizeof(uint32_t));
+  ASSERT(graph->inStart != NULL && graph->inEdges != NULL && "Buy more RAM lol");
+
+  uint32_t *corridorStarts;
+  GraphIndices corridors = {0};
+  roomCorridors(map, &corridorStarts, &corridors);
+
+  da_foreach(RoomEdge, edge, &graph->edges) {
+    edge->linked = shareCorridor(corridorStarts, corridors.items, edge->from, edge->to);
+    graph->inStart[edge->to + 2]++;
+  }
+
+  // Counting sort of the edges by `to`; inStart runs one slot ahead while
+  // it doubles as the fill cursor
+  for (size_t i = 0; i < rooms; i++) graph->inStart[i + 2] += graph->inStart[i + 1];
+  for (uint32_t k = 0; k < edges; k++) {
+    graph->inEdges[graph->inStart[graph->edges.items[k].to + 1]++] = k;
+  }
+  graph->analysed = true;
+
+  free(corridors.items);
+  free(corridorStarts);
+  return graph;
+}
+
+// Steps `cursor` through the room's linked edges, its out edges and then
+// its in edges. Returns false once they run out.
+static bool nextLink(const RoomGraph *graph, uint32_t room, uint32_t *cursor, uint32_t *edge, uint32_t *other) {
+  uint32_t outs = graph->out[room].count;
+  uint32_t ins = graph->inStart[room + 1] - graph->inStart[room];
+
+  while (*cursor < outs + ins) {
+    uint32_t i = (*cursor)++;
+    uint32_t k = i < outs ? graph->out[room].start + i : graph->inEdges[graph->inStart[room] + i - outs];
+    if (!graph->edges.items[k].linked) continue;
+    *edge = k;
+    *other = i < outs ? graph->edges.items[k].to : graph->edges.items[k].from;
+    return true;
+  }
+  return false;
+}
+
+// BFS from `source` over rooms still ROOM_UNREACHABLE in `distances`,
+// leaving the others alone so one array can sweep every component. Returns
+// the furthest room reached and how many were.
+static uint32_t graphBfs(const RoomGraph *graph, uint32_t source, uint32_t *distances, uint32_t *queue,
+                         uint32_t *reached) {
+  size_t head = 0, tail = 0;
+  uint32_t far = source;
+  distances[source] = 0;
+  queue[tail++] = source;
+
+  while (head < tail) {
+    uint32_t room = queue[head++];
+    if (distances[room] > distances[far] || (distances[room] == distances[far] && room < far)) far = room;
+
+    uint32_t cursor = 0, edge, other;
+    while (nextLink(graph, room, &cursor, &edge, &other)) {
+      if (distances[other] != ROOM_UNREACHABLE) continue;
+      distances[other] = distances[room] + 1;
+      queue[tail++] = other;
+    }
+  }
+
+  if (reached != NULL) *reached = tail;
+  return far;
+}
+
+static void fillUnreachable(uint32_t *distances, size_t count) {
+  for (size_t i = 0; i < count; i++) distances[i] = ROOM_UNREACHABLE;
+}
+
+uint32_t roomDistances(const RoomGraph *graph, uint32_t source, uint32_t *distances) {
+  uint32_t *queue = malloc(MAX(graph->roomCount, 1u) * sizeof(uint32_t));
+  ASSERT(queue != NULL && "Buy more RAM lol");
+
+  fillUnreachable(distances, graph->roomCount);
+  uint32_t far = graphBfs(graph, source, distances, queue, NULL);
+  free(queue);
+  return far;
+}
+
+RoomPlacement placeEntranceAndExit(const RoomGraph *graph) {
+  RoomPlacement placement = {0};
+  if (graph->roomCount == 0) return placement;
+
+  uint32_t *distances = malloc(graph->roomCount * sizeof(uint32_t));
+  uint32_t *queue = malloc(graph->roomCount * sizeof(uint32_t));
+  ASSERT(distances != NULL && queue != NULL && "Buy more RAM lol");
+
+  // One sweep over every component doubles as the first BFS: within the
+  // largest one, the room furthest from where the sweep entered it
+  fillUnreachable(distances, graph->roomCount);
+  for (uint32_t room = 0; room < graph->roomCount; room++) {
+    if (distances[room] != ROOM_UNREACHABLE) continue;
+    uint32_t reached;
+    uint32_t far = graphBfs(graph, room, distances, queue, &reached);
+    if (reached > placement.reachable) {
+      placement.reachable = reached;
+      placement.entrance = far;
+    }
+  }
+
+  fillUnreachable(distances, graph->roomCount);
+  placement.exit = graphBfs(graph, placement.entrance, distances, queue, NULL);
+  placement.distance = distances[placement.exit];
+
+  free(distances);
+  free(queue);
+  return placement;
+}
+
+size_t findChokepoints(const RoomGraph *graph, bool *cutRooms, bool *bridges) {
+  size_t rooms = graph->roomCount, found = 0;
+  memset(cutRooms, 0, rooms * sizeof(bool));
+  memset(bridges, 0, graph->edges.count * sizeof(bool));
+  if (rooms == 0) return 0;
+
+  // Discovery order, lowest order reachable through one back edge, the edge
+  // a room was discovered through, and its place in its links
+  uint32_t *order = malloc(rooms * sizeof(uint32_t));
+  uint32_t *low = malloc(rooms * sizeof(uint32_t));
+  uint32_t *parentEdge = malloc(rooms * sizeof(uint32_t));
+  uint32_t *cursors = malloc(rooms * sizeof(uint32_t));
+  uint32_t *stack = malloc(rooms * sizeof(uint32_t));
+  ASSERT(order != NULL && low != NULL && parentEdge != NULL && "Buy more RAM lol");
+  ASSERT(cursors != NULL && stack != NULL && "Buy more RAM lol");
+  fillUnreachable(order, rooms);
+
+  uint32_t visited = 0;
+  for (uint32_t root = 0; root < rooms; root++) {
+    if (order[root] != ROOM_UNREACHABLE) continue;
+
+    size_t depth = 0, rootChildren = 0;
+    order[root] = low[root] = visited++;
+    parentEdge[root] = UINT32_MAX;
+    cursors[root] = 0;
+    stack[depth++] = root;
+
+    while (depth > 0) {
+      uint32_t room = stack[depth - 1], edge, other;
+      if (nextLink(graph, room, &cursors[room], &edge, &other)) {
+        if (edge == parentEdge[room]) continue;
+        if (order[other] == ROOM_UNREACHABLE) {
+          order[other] = low[other] = visited++;
+          parentEdge[other] = edge;
+          cursors[other] = 0;
+          stack[depth++] = other;
+          if (room == root) rootChildren++;
+        } else {
+          low[room] = MIN(low[room], order[other]);
+        }
+        continue;
+      }
+
+      // Done with `room`: hand its low up to the room it was found from
+      depth--;
+      if (depth == 0) break;
+      uint32_t parent = stack[depth - 1];
+      low[parent] = MIN(low[parent], low[room]);
+      if (low[room] > order[parent]) {
+        bridges[parentEdge[room]] = true;
+        found++;
+      }
+      if (parent != root && low[room] >= order[parent]) cutRooms[parent] = true;
+    }
+
+    if (rootChildren > 1) cutRooms[root] = true;
+  }
+
+  free(order);
+  free(low);
+  free(parentEdge);
+  free(cursors);
+  free(stack);
+  return found;
+}
+
+void approximateBetweenness(const RoomGraph *graph, uint32_t samples, uint64_t seed, float *betweenness) {
+  size_t rooms = graph->roomCount;
+  if (rooms == 0) return;
+
+  uint32_t *distances = malloc(rooms * sizeof(uint32_t));
+  uint32_t *queue = malloc(rooms * sizeof(uint32_t));
+  // Shortest path counts grow exponentially with distance on grid-like
+  // maps and overflow a double across a million rooms
+  long double *paths = malloc(rooms * sizeof(long double));
+  double *dependency = malloc(rooms * sizeof(double));
+  double *total = calloc(rooms, sizeof(double));
+  ASSERT(distances != NULL && queue != NULL && paths != NULL && "Buy more RAM lol");
+  ASSERT(dependency != NULL && total != NULL && "Buy more RAM lol");
+
+  Rng rng = { seed };
+  for (uint32_t sample = 0; sample < samples; sample++) {
+    uint32_t source = rngNext(&rng) % rooms;
+    fillUnreachable(distances, rooms);
+
+    // Brandes' forward pass: BFS order, counting shortest paths
+    size_t head = 0, tail = 0;
+    distances[source] = 0;
+    paths[source] = 1;
+    dependency[source] = 0;
+    queue[tail++] = source;
+    while (head < tail) {
+      uint32_t room = queue[head++], cursor = 0, edge, other;
+      while (nextLink(graph, room, &cursor, &edge, &other)) {
+        if (distances[other] == ROOM_UNREACHABLE) {
+          distances[other] = distances[room] + 1;
+          paths[other] = 0;
+          dependency[other] = 0;
+          queue[tail++] = other;
+        }
+        if (distances[other] == distances[room] + 1) paths[other] += paths[room];
+      }
+    }
+
+    // Backward pass: each room passes its dependency on to the rooms one
+    // step closer to the source, split by their share of the paths
+    for (size_t i = tail; i-- > 1;) {
+      uint32_t room = queue[i], cursor = 0, edge, other;
+      while (nextLink(graph, room, &cursor, &edge, &other)) {
+        if (distances[other] + 1 != distances[room]) continue;
+        dependency[other] += (double)(paths[other] / paths[room]) * (1 + dependency[room]);
+      }
+      total[room] += dependency[room];
+    }
+  }
+
+  // Every unordered pair is counted from both ends when all rooms are
+  // sources, hence the halving
+  double scale = samples > 0 ? (double)rooms / samples / 2 : 0;
+  for (size_t i = 0; i < rooms; i++) betweenness[i] = total[i] * scale;
+
+  free(distances);
+  free(queue);
+  free(paths);
+  free(dependency);
+  free(total);
+}
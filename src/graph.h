@@ -0,0 +1,60 @@
+#ifndef GRAPH_H_
+#define GRAPH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+
+// Graph passes (BFS, spanning trees, pathfinding) over a map's RoomGraph,
+// the flat adjacency generation builds in compressed sparse row form.
+
+// The map's room graph, generating it through its halls if needed. The
+// first call after the map changes packs the graph, works out which edges
+// are `linked` and builds the in lists; later calls return it as is. It
+// belongs to the map and lives as long as it does.
+const RoomGraph *mapRoomGraph(Map *map);
+
+// Analytics over the walkable graph: rooms are joined where an edge is
+// `linked`, in either direction. Each pass is linear in rooms and edges,
+// with scratch arrays of a few words per room, so they hold up on maps of
+// millions of rooms. The per-room and per-edge outputs are caller-allocated,
+// graph->roomCount and graph->edges.count long.
+
+#define ROOM_UNREACHABLE UINT32_MAX
+
+// BFS hop counts from `source`, ROOM_UNREACHABLE for rooms it cannot reach.
+// Returns the reachable room furthest away, the lowest index on ties.
+uint32_t roomDistances(const RoomGraph *graph, uint32_t source, uint32_t *distances);
+
+typedef struct {
+  uint32_t entrance;
+  uint32_t exit;
+  // Hops between them. Double BFS gives a lower bound on the diameter of
+  // the entrance's component, exact when the component is a tree and
+  // rarely far off on the near-trees generation makes.
+  uint32_t distance;
+  // Rooms in the entrance's component, the largest one
+  uint32_t reachable;
+} RoomPlacement;
+
+// Entrance and exit as far apart as a double BFS finds: the room furthest
+// from any room of the largest component, then the room furthest from that.
+RoomPlacement placeEntranceAndExit(const RoomGraph *graph);
+
+// Tarjan's chokepoints: rooms whose removal splits their component, and
+// edges whose hall is the only way between the two sides, i.e. spots for a
+// locked door. Runs on an explicit stack, as BSP walks do, so a corridor a
+// million rooms long needs no deeper C stack than a short one. Unlinked
+// edges are never bridges. Returns the number of bridges.
+size_t findChokepoints(const RoomGraph *graph, bool *cutRooms, bool *bridges);
+
+// Brandes' betweenness from `samples` random sources instead of all of
+// them, scaled up by roomCount / samples: each room's estimated number of
+// shortest paths between pairs of rooms that pass through it. Linear per
+// sample, so the cost is picked through `samples` rather than forced by the
+// map's size.
+void approximateBetweenness(const RoomGraph *graph, uint32_t samples, uint64_t seed, float *betweenness);
+
+#endif // GRAPH_H_
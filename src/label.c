@@ -0,0 +1,236 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./label.h"
+#include "./raster.h"
+#include "./utils.h"
+
+// While labeling, a floor entry holds its parent's index + 1 (0 stays free
+// for walls) and a root points at itself. Roots are always the smallest
+// index in their tree, since unions link the larger root under the smaller.
+// Once compacted, roots briefly carry LABEL_ROOT | id before every entry is
+// rewritten to its id.
+#define LABEL_ROOT 0x80000000u
+
+#define LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+typedef struct {
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} LabelRoots;
+
+typedef struct {
+  const Grid *grid;
+  uint32_t *labels;
+  int y1;
+  int y2;
+  LabelRoots roots;
+  uint32_t firstId;
+} LabelBand;
+
+// Within a band only its own thread touches the entries, so the first pass
+// gets by with plain loads and path halving.
+static uint32_t findLocal(uint32_t *labels, uint32_t p) {
+  while (labels[p] - 1 != p) {
+    labels[p] = labels[labels[p] - 1];
+    p = labels[p] - 1;
+  }
+  return p;
+}
+
+static void uniteLocal(uint32_t *labels, uint32_t a, uint32_t b) {
+  a = findLocal(labels, a);
+  b = findLocal(labels, b);
+  if (a < b) labels[b] = a + 1;
+  else if (b < a) labels[a] = b + 1;
+}
+
+// Trees span bands once the borders are stitched, so from then on entries
+// are read and linked atomically. Linking only ever moves a root under a
+// smaller one, which keeps concurrent unions from forming cycles.
+static uint32_t findShared(uint32_t *labels, uint32_t p) {
+  for (;;) {
+    uint32_t parent = LOAD(&labels[p]) - 1;
+    if (parent == p) return p;
+    p = parent;
+  }
+}
+
+static void uniteShared(uint32_t *labels, uint32_t a, uint32_t b) {
+  for (;;) {
+    a = findShared(labels, a);
+    b = findShared(labels, b);
+    if (a == b) return;
+    if (a > b) {
+      uint32_t t = a;
+      a = b;
+      b = t;
+    }
+
+    uint32_t expected = b + 1;
+    if (__atomic_compare_exchange_n(&labels[b], &expected, a + 1, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+}
+
+// Works run by run: every tile of a floor run shares the link of its first
+// tile, and the run is joined with each run above it that it touches.
+static void *labelLocal(void *arg) {
+  LabelBand *band = arg;
+  const Grid *grid = band->grid;
+  uint32_t *labels = band->labels;
+  uint32_t w = grid->width;
+
+  for (int y = band->y1; y < band->y2; y++) {
+    const uint8_t *row = &GRID_AT(grid, 0, y);
+    const uint8_t *above = y > band->y1 ? row - w : NULL;
+    uint32_t *out = &labels[(size_t)y * w];
+
+    uint32_t x = 0;
+    while (x < w) {
+      if (row[x] == TILE_WALL) {
+        out[x++] = 0;
+        continue;
+      }
+
+      uint32_t start = x;
+      while (x < w && row[x] != TILE_WALL) x++;
+
+      uint32_t p = (uint32_t)y * w + start;
+      uint32_t link = above != NULL && above[start] != TILE_WALL ? labels[p - w] : p + 1;
+      for (uint32_t i = start; i < x; i++) out[i] = link;
+
+      if (above == NULL) continue;
+      for (uint32_t i = start + 1; i < x; i++) {
+        if (above[i] != TILE_WALL && above[i - 1] == TILE_WALL) uniteLocal(labels, p - start + i - w, p);
+      }
+    }
+  }
+  return NULL;
+}
+
+static void *labelBorder(void *arg) {
+  LabelBand *band = arg;
+  if (band->y1 == 0 || band->y1 == band->y2) return NULL;
+
+  const Grid *grid = band->grid;
+  uint32_t w = grid->width;
+  const uint8_t *row = &GRID_AT(grid, 0, band->y1);
+  const uint8_t *above = row - w;
+
+  for (uint32_t x = 0; x < w; x++) {
+    if (row[x] == TILE_WALL || above[x] == TILE_WALL) continue;
+    if (x > 0 && row[x - 1] != TILE_WALL && above[x - 1] != TILE_WALL) continue;
+
+    uint32_t p = (uint32_t)band->y1 * w + x;
+    uniteShared(band->labels, p - w, p);
+  }
+  return NULL;
+}
+
+// Parents always sit at lower indices, so a tile sharing the previous tile's
+// link can't be a root and reuses the previous lookup.
+static void *labelFlatten(void *arg) {
+  LabelBand *band = arg;
+  uint32_t w = band->grid->width;
+  uint32_t *labels = band->labels;
+  uint32_t last = 0, lastRoot = 0;
+  band->roots.count = 0;
+
+  for (uint32_t p = band->y1 * w; p < band->y2 * w; p++) {
+    uint32_t v = LOAD(&labels[p]);
+    if (v == 0) continue;
+
+    if (v != last) {
+      last = v;
+      lastRoot = findShared(labels, v - 1);
+    }
+    if (lastRoot == p) da_append(&band->roots, p);
+    else STORE(&labels[p], lastRoot + 1);
+  }
+  return NULL;
+}
+
+static void *labelAssign(void *arg) {
+  LabelBand *band = arg;
+  uint32_t *labels = band->labels;
+  uint32_t id = band->firstId;
+
+  da_foreach(uint32_t, root, &band->roots) STORE(&labels[*root], LABEL_ROOT | id++);
+  return NULL;
+}
+
+static void *labelResolve(void *arg) {
+  LabelBand *band = arg;
+  uint32_t w = band->grid->width;
+  uint32_t *labels = band->labels;
+  uint32_t last = 0, lastId = 0;
+
+  for (uint32_t p = band->y1 * w; p < band->y2 * w; p++) {
+    uint32_t v = LOAD(&labels[p]);
+    if (v == 0) continue;
+
+    if (v & LABEL_ROOT) {
+      STORE(&labels[p], v & ~LABEL_ROOT);
+    } else {
+      if (v != last) {
+        last = v;
+        lastId = LOAD(&labels[v - 1]) & ~LABEL_ROOT;
+      }
+      STORE(&labels[p], lastId);
+    }
+  }
+  return NULL;
+}
+
+// Runs one pass over every band, the calling thread taking the first. The
+// joins are the barrier between passes.
+static void runBands(LabelBand *bands, pthread_t *pool, size_t count, void *(*pass)(void *)) {
+  for (size_t i = 1; i < count; i++) pthread_create(&pool[i], NULL, pass, &bands[i]);
+  pass(&bands[0]);
+  for (size_t i = 1; i < count; i++) pthread_join(pool[i], NULL);
+}
+
+uint32_t labelGrid(const Grid *grid, uint32_t *labels, size_t threads) {
+  if (grid->width == 0 || grid->height == 0) return 0;
+  ASSERT((size_t)grid->width * grid->height < LABEL_ROOT);
+
+  threads = MIN(MAX(threads, (size_t)1), (size_t)grid->height);
+  LabelBand *bands = malloc(threads * sizeof(LabelBand));
+  pthread_t *pool = malloc(threads * sizeof(pthread_t));
+  ASSERT(bands != NULL && pool != NULL);
+
+  for (size_t i = 0; i < threads; i++) {
+    bands[i] = (LabelBand){
+      .grid = grid,
+      .labels = labels,
+      .y1 = grid->height * i / threads,
+      .y2 = grid->height * (i + 1) / threads,
+    };
+  }
+
+  runBands(bands, pool, threads, labelLocal);
+  runBands(bands, pool, threads, labelBorder);
+  runBands(bands, pool, threads, labelFlatten);
+
+  uint32_t count = 0;
+  for (size_t i = 0; i < threads; i++) {
+    bands[i].firstId = count + 1;
+    count += bands[i].roots.count;
+  }
+
+  runBands(bands, pool, threads, labelAssign);
+  runBands(bands, pool, threads, labelResolve);
+
+  for (size_t i = 0; i < threads; i++) free(bands[i].roots.items);
+  free(bands);
+  free(pool);
+  return count;
+}
@@ -0,0 +1,19 @@
+#ifndef LABEL_H_
+#define LABEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./raster.h"
+
+// Connected-component labeling of the floor (every non-wall tile, 4-connected)
+// on worker threads. The grid is cut into bands of rows, each band is
+// labeled with its own union-find, then the bands are stitched along their
+// borders with lock-free unions and the labels are compacted in parallel.
+//
+// `labels` holds width * height entries: 0 for walls, otherwise 1..count in
+// order of each component's first tile in row-major order, so the result
+// does not depend on the thread count. Grids are limited to 2^31 tiles.
+uint32_t labelGrid(const Grid *grid, uint32_t *labels, size_t threads);
+
+#endif // LABEL_H_
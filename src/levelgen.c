@@ -0,0 +1,90 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./levelgen.h"
+#include "./mapgen.h"
+
+static void *levelWorker(void *arg) {
+  LevelQueue *queue = arg;
+
+  pthread_mutex_lock(&queue->lock);
+  for (;;) {
+    while (!queue->quit && queue->nextReady) {
+      pthread_cond_wait(&queue->wake, &queue->lock);
+    }
+    if (queue->quit) break;
+
+    // `next` is owned by the worker until nextReady is set again
+    Map *next = queue->next;
+    bool retired = queue->retired;
+    uint64_t seed = queue->nextSeed++;
+    pthread_mutex_unlock(&queue->lock);
+
+    // Generate in place: a single-room map's cells point at its own root, so
+    // a Map copied out of a local would leave them aimed at this stack frame.
+    // config is only written before the worker starts.
+    if (retired) freeMap(next);
+    *next = initMap(&queue->config, seed);
+    generateMap(next);
+    mapWalls(next);
+
+    pthread_mutex_lock(&queue->lock);
+    queue->retired = false;
+    queue->nextReady = true;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  return NULL;
+}
+
+// Generates the first level synchronously and starts building the second.
+void levelQueueStart(LevelQueue *queue, const MapConfig *config, uint64_t seed) {
+  *queue = (LevelQueue){
+    .config = *config,
+    .nextSeed = seed + 1,
+  };
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->wake, NULL);
+
+  queue->current = &queue->maps[0];
+  queue->next = &queue->maps[1];
+  *queue->current = initMap(config, seed);
+  generateMap(queue->current);
+  mapWalls(queue->current);
+
+  pthread_create(&queue->thread, NULL, levelWorker, queue);
+}
+
+// Swaps in the pre-generated level. Never blocks on the worker: if the next
+// level is still being built the call returns false and the player stays put.
+bool levelQueueDescend(LevelQueue *queue) {
+  if (pthread_mutex_trylock(&queue->lock) != 0) return false;
+
+  bool ready = queue->nextReady;
+  if (ready) {
+    Map *old = queue->current;
+    queue->current = queue->next;
+    queue->next = old;
+    queue->retired = true;
+    queue->nextReady = false;
+    pthread_cond_signal(&queue->wake);
+  }
+
+  pthread_mutex_unlock(&queue->lock);
+  return ready;
+}
+
+void levelQueueStop(LevelQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->quit = true;
+  pthread_cond_signal(&queue->wake);
+  pthread_mutex_unlock(&queue->lock);
+  pthread_join(queue->thread, NULL);
+
+  freeMap(queue->current);
+  if (queue->nextReady || queue->retired) freeMap(queue->next);
+
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->wake);
+}
@@ -0,0 +1,33 @@
+#ifndef LEVELGEN_H_
+#define LEVELGEN_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+
+// Double-buffered level generation. The worker thread builds the next level
+// while the current one is played, and frees the level left behind after a
+// descend, so the render loop never waits on generation or teardown.
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+
+  Map maps[2];
+  Map *current;
+  Map *next;
+  bool nextReady;
+  bool retired;
+  bool quit;
+
+  MapConfig config;
+  uint64_t nextSeed;
+} LevelQueue;
+
+void levelQueueStart(LevelQueue *queue, const MapConfig *config, uint64_t seed);
+bool levelQueueDescend(LevelQueue *queue);
+void levelQueueStop(LevelQueue *queue);
+
+#endif // LEVELGEN_H_
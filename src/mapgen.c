@@ -1,247 +1,484 @@
 #include <stdbool.h>
-#include <math.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "./constants.c"
 #include "./mapgen.h"
+#include "./profile.h"
 #include "./utils.h"
 
-#define SNAPTOGRID true
+#include "./bvh.c"
+#include "./sort.c"
+#include "./router.c"
+#include "./walls.c"
 
-void addGrid(){
-  if (SNAPTOGRID){ 
-    for(size_t x=0; x < WINDOW_WIDTH; x+=CELLSIZE){
-      DrawLine(x,0,x,WINDOW_HEIGHT, BLUE);
+Cell* makeCell(int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+  Cell* c = malloc(sizeof(Cell));
+  c->x1 = x1; c->y1 = y1; c->x2 = x2; c->y2 = y2;
+  c->split = 0; c->splitOnX = false;
+  c->left = NULL; c->right = NULL;
+  c->index = 0;
+  return c;
+}
+
+void cellWalkBegin(CellWalk* walk, Cell* root, bool postOrder) {
+  walk->stack.count = 0;
+  walk->last = NULL;
+  walk->postOrder = postOrder;
+  da_append(&walk->stack, root);
+}
+
+Cell* cellWalkNext(CellWalk* walk) {
+  while (walk->stack.count > 0) {
+    Cell *cell = da_last(&walk->stack);
+
+    if (!walk->postOrder) {
+      walk->stack.count--;
+      if (cell->left != NULL) {
+        da_append(&walk->stack, cell->right);
+        da_append(&walk->stack, cell->left);
+      }
+      return cell;
     }
 
-    for(size_t y=0; y < WINDOW_HEIGHT; y+=CELLSIZE){
-      DrawLine(0,y,WINDOW_WIDTH,y, BLUE);
+    // Coming back up from the left child sends the walk down the right one
+    if (cell->left != NULL && walk->last != cell->right) {
+      da_append(&walk->stack, walk->last == cell->left ? cell->right : cell->left);
+      continue;
     }
+
+    walk->stack.count--;
+    walk->last = cell;
+    return cell;
   }
+  return NULL;
 }
 
-int snapCoords(float x){
-  return(round(x/CELLSIZE)*CELLSIZE);
+void cellWalkEnd(CellWalk* walk) {
+  free(walk->stack.items);
+  *walk = (CellWalk){0};
 }
 
-Cell* makeCell(float x1, float y1, float x2, float y2) {
-  Cell* c = malloc(sizeof(Cell));
-  c->x1 = x1; c->y1 = y1; c->x2 = x2; c->y2 = y2;
-  c->left = NULL; c->right = NULL;
+// Frees everything below `cell`, but not `cell`, which may live inside a
+// Map.
+void freeCell(Cell* cell){
+  CellWalk walk = {0};
+  cellWalkBegin(&walk, cell, false);
 
-  c->hHalls = (HallArray){0};
-  c->vHalls = (HallArray){0};
-  return c;
+  for (Cell *c; (c = cellWalkNext(&walk)) != NULL;) {
+    if (c != cell) free(c);
+  }
+  cellWalkEnd(&walk);
 }
 
-void snapToGrid(CellArray *cells)
-{
-  for (size_t i=0; i<cells->count; i++) {
-    Cell *cell = cells->items[i];
+static size_t cellMemoryUsage(Cell* cell){
+  CellWalk walk = {0};
+  size_t bytes = 0;
+  cellWalkBegin(&walk, cell, false);
 
-    cell->x1 = snapCoords(cell->x1);
-    cell->x2 = snapCoords(cell->x2);
-    cell->y1 = snapCoords(cell->y1);
-    cell->y2 = snapCoords(cell->y2);
+  for (Cell *c; (c = cellWalkNext(&walk)) != NULL;) {
+    if (c != cell) bytes += sizeof(Cell);
+  }
+  cellWalkEnd(&walk);
+  return bytes;
+}
 
+// Heap bytes owned by the map (the root cell lives inside Map itself).
+size_t mapMemoryUsage(Map* map){
+  return cellMemoryUsage(&map->root) + map->cells.capacity * sizeof(Cell*)
+    + roomGraphMemoryUsage(&map->graph)
+    + map->walls.segments.capacity * sizeof(WallSegment)
+    + map->walls.loops.capacity * sizeof(WallLoop);
+}
 
+void resetRoomGraph(RoomGraph* graph, size_t rooms) {
+  freeRoomGraph(graph);
+  graph->roomCount = rooms;
+  graph->out = calloc(MAX(rooms, (size_t)1), sizeof(RoomSpan));
+  graph->hallSpans = calloc(MAX(rooms, (size_t)1), sizeof(RoomHalls));
+  ASSERT(graph->out != NULL && graph->hallSpans != NULL && "Buy more RAM lol");
+}
 
-    for (size_t j = 0; j < cell->vHalls.count; j++) {
-      Hall *vHall = &cell->vHalls.items[j];  
+void freeRoomGraph(RoomGraph* graph) {
+  free(graph->edges.items);
+  free(graph->halls.items);
+  free(graph->out);
+  free(graph->hallSpans);
+  free(graph->inStart);
+  free(graph->inEdges);
+  free(graph->pending.items);
+  *graph = (RoomGraph){0};
+}
 
-      vHall->x1 = snapCoords(vHall->x1);
-      vHall->x2 = snapCoords(vHall->x2);
-      vHall->y1 = snapCoords(vHall->y1);
-      vHall->y2 = snapCoords(vHall->y2);
+void compactRoomGraph(RoomGraph* graph) {
+  if (graph->deadEdges > 0) {
+    RoomEdgeArray edges = {0};
+    da_reserve(&edges, graph->edges.count - graph->deadEdges);
+    for (size_t i = 0; i < graph->roomCount; i++) {
+      RoomSpan *span = &graph->out[i];
+      uint32_t start = edges.count;
+      for (uint32_t k = 0; k < span->count; k++) da_append(&edges, graph->edges.items[span->start + k]);
+      span->start = start;
     }
+    free(graph->edges.items);
+    graph->edges = edges;
+    graph->deadEdges = 0;
+  }
 
-    for (size_t j = 0; j < cell->hHalls.count; j++) {
-      Hall *hHall = &cell->hHalls.items[j]; 
-
-      hHall->x1 = snapCoords(hHall->x1);
-      hHall->x2 = snapCoords(hHall->x2);
-      hHall->y1 = snapCoords(hHall->y1);
-      hHall->y2 = snapCoords(hHall->y2);
+  if (graph->deadHalls > 0) {
+    HallArray halls = {0};
+    da_reserve(&halls, graph->halls.count - graph->deadHalls);
+    for (size_t i = 0; i < graph->roomCount; i++) {
+      RoomHalls *span = &graph->hallSpans[i];
+      uint32_t start = halls.count;
+      for (uint32_t k = 0; k < span->horizontal + span->vertical; k++) {
+        da_append(&halls, graph->halls.items[span->start + k]);
+      }
+      span->start = start;
     }
+    free(graph->halls.items);
+    graph->halls = halls;
+    graph->deadHalls = 0;
   }
+
+  // In edges point at edges by position
+  graph->analysed = false;
 }
 
-void drawHall(Hall* hall){
-  int x = MIN(hall->x1, hall->x2);
-  int y = MIN(hall->y1, hall->y2);
-  int w = hall->x2 - hall->x1;
-  int h = hall->y2 - hall->y1;
+void trimRoomGraph(RoomGraph* graph) {
+  if (graph->deadEdges > graph->edges.count - graph->deadEdges
+      || graph->deadHalls > graph->halls.count - graph->deadHalls) {
+    compactRoomGraph(graph);
+  }
+}
 
-  DrawRectangleLines(x, y, w, h, YELLOW);
+size_t roomGraphMemoryUsage(const RoomGraph* graph) {
+  size_t bytes = graph->edges.capacity * sizeof(RoomEdge)
+    + (graph->halls.capacity + graph->pending.capacity) * sizeof(Hall);
+  if (graph->out != NULL) bytes += graph->roomCount * (sizeof(RoomSpan) + sizeof(RoomHalls));
+  if (graph->inStart != NULL) bytes += (graph->roomCount + 2 + graph->edges.count) * sizeof(uint32_t);
+  return bytes;
 }
 
-void drawCell(Cell* cell){
-  if(cell->left != NULL){
-    drawCell(cell->left);
-    drawCell(cell->right);
-  } else {
-    DrawRectangleLinesEx(
-      (Rectangle){ cell->x1, cell->y1, cell->x2 - cell->x1, cell->y2 - cell->y1 },
-      1,
-      GREEN
-    );
-
-    // Draw horizontal halls
-    if(cell->hHalls.items) {
-      for(size_t i = 0; i < cell->hHalls.count; i++)
-        drawHall(&cell->hHalls.items[i]);
-    }
+// Leaves numbered past the graph (maps still dividing) have nothing yet
+RoomEdgeArray cellEdges(const Map* map, const Cell* cell) {
+  if (cell->index >= map->graph.roomCount) return (RoomEdgeArray){0};
+  RoomSpan span = map->graph.out[cell->index];
+  return (RoomEdgeArray){ map->graph.edges.items + span.start, span.count, span.count };
+}
 
-    // Draw vertical halls
-    if(cell->vHalls.items) {
-      for(size_t i = 0; i < cell->vHalls.count; i++)
-        drawHall(&cell->vHalls.items[i]);
-    }
-  }
+HallArray cellHalls(const Map* map, const Cell* cell) {
+  if (cell->index >= map->graph.roomCount) return (HallArray){0};
+  RoomHalls span = map->graph.hallSpans[cell->index];
+  size_t count = span.horizontal + span.vertical;
+  return (HallArray){ map->graph.halls.items + span.start, count, count };
 }
 
+HallArray cellAxisHalls(const Map* map, const Cell* cell, bool vertical) {
+  if (cell->index >= map->graph.roomCount) return (HallArray){0};
+  RoomHalls span = map->graph.hallSpans[cell->index];
+  size_t start = span.start + (vertical ? span.horizontal : 0);
+  size_t count = vertical ? span.vertical : span.horizontal;
+  return (HallArray){ map->graph.halls.items + start, count, count };
+}
 
-bool devideCell(Cell* cell, uint8_t minCellSize){
+// The cells devideCell() accepts, so a leaf it can still split. Cells
+// containing such a leaf pass the same test.
+static bool cellSplittable(const Cell* cell, uint16_t minCellSize) {
+  int32_t width = cell->x2 - cell->x1, height = cell->y2 - cell->y1;
+  return (width >= minCellSize || height >= minCellSize) && MAX(width, height) >= 2;
+}
 
-  float width = cell->x2-cell->x1;
-  float height = cell->y2-cell->y1;
-  if (width<minCellSize && height<minCellSize) { return false;}
-  if (cell->left != NULL){
-    if (rand() % 2){
-      return devideCell(cell->left, minCellSize);
-    } else {
-      return devideCell(cell->right, minCellSize);
-    }
+// A split replaces one splittable leaf with its two children
+static void countSplit(size_t* splittable, const Cell* cell, uint16_t minCellSize) {
+  *splittable += cellSplittable(cell->left, minCellSize) + cellSplittable(cell->right, minCellSize) - 1;
+}
+
+Cell* devideCell(Cell* cell, uint16_t minCellSize, Rng* rng){
+  int32_t width, height;
+
+  // Random descent to a leaf, as a loop since skewed trees get deep
+  for (;;) {
+    width = cell->x2-cell->x1;
+    height = cell->y2-cell->y1;
+    if (width<minCellSize && height<minCellSize) { return NULL;}
+    if (cell->left == NULL) break;
+    cell = rngNext(rng) % 2 ? cell->left : cell->right;
   }
 
+  // Both halves need at least one grid unit
+  if (MAX(width, height) < 2) { return NULL; }
+
   if (width > height) {
-    float mid = cell->x1 + (RANDBETWEEN(3, 6) / 10.0f) * width;
+    int32_t mid = cell->x1 + MAX(RNGBETWEEN(rng, 3, 6) * width / 10, 1);
+    cell->split = mid;
+    cell->splitOnX = true;
     cell->left  = makeCell(cell->x1, cell->y1, mid, cell->y2);
     cell->right = makeCell(mid, cell->y1, cell->x2, cell->y2);
-    return true;
+    return cell;
   } else {
-    float mid = cell->y1 + (RANDBETWEEN(3, 6) / 10.0f) * height;
+    int32_t mid = cell->y1 + MAX(RNGBETWEEN(rng, 3, 6) * height / 10, 1);
+    cell->split = mid;
+    cell->splitOnX = false;
     cell->left  = makeCell(cell->x1, cell->y1, cell->x2, mid);
     cell->right = makeCell(cell->x1, mid, cell->x2, cell->y2);
-    return true;
+    return cell;
   }
-
-  return false;
 }
 
 
 void getLeaves(Cell* cell, CellArray* cells) {
   if (!cell) return;
 
-  if (cell->left != NULL) {
-    getLeaves(cell->left, cells);
-    getLeaves(cell->right, cells);
-  } else {
-    da_append(cells, cell);
+  CellWalk walk = {0};
+  cellWalkBegin(&walk, cell, false);
+  for (Cell *c; (c = cellWalkNext(&walk)) != NULL;) {
+    if (c->left != NULL) continue;
+    c->index = cells->count;
+    da_append(cells, c);
   }
+  cellWalkEnd(&walk);
 }
 
-#define EPSILON 0.01f
-
-void findNeighbours(Map* map) {
-  getLeaves(&map->root, &map->cells);
-
-  for (size_t i = 0; i < map->cells.count; i++) {
+static Rect cellBounds(const Cell* cell) {
+  return (Rect){ cell->x1, cell->y1, cell->x2, cell->y2 };
+}
 
-    map->cells.items[i]->hNeighbours = (CellArray){0};
-    map->cells.items[i]->vNeighbours = (CellArray){0};
+// A subtree and the BSP region it spans, for walks that need the regions
+typedef struct {
+  const Cell *cell;
+  Rect region;
+} CellRegion;
+
+typedef struct {
+  CellRegion *items;
+  size_t count;
+  size_t capacity;
+} CellRegionArray;
+
+static void splitRegion(const Cell* cell, Rect region, Rect* left, Rect* right) {
+  *left = *right = region;
+  if (cell->splitOnX) left->x2 = right->x1 = cell->split;
+  else left->y2 = right->y1 = cell->split;
+}
 
-    for (size_t j = 0; j < map->cells.count; j++) {
-      if (i == j) continue;
+// Appends edges from `from` to the leaves whose regions start on the line
+// x = at (y = at when `vertical`) and share part of [lo, hi) along it. Only
+// splits along the line can put matches on both sides, so this costs the
+// tree's depth plus the matches, and leaves come out in getLeaves order.
+// `stack` is scratch space the caller may reuse between calls.
+static void linkAcross(Cell* root, Rect bounds, bool vertical, int32_t at, int32_t lo, int32_t hi, CellRegionArray* stack, uint32_t from, RoomEdgeArray* out) {
+  stack->count = 0;
+  da_append(stack, ((CellRegion){ root, bounds }));
+
+  while (stack->count > 0) {
+    CellRegion top = stack->items[--stack->count];
+    const Cell *cell = top.cell;
+    if (cell->left == NULL) {
+      Rect r = top.region;
+      if ((vertical ? r.y1 : r.x1) != at) continue;
+      RoomEdge edge = {
+        .from = from,
+        .to = cell->index,
+        .vertical = vertical,
+        .lo = MAX(lo, vertical ? r.x1 : r.y1),
+        .hi = MIN(hi, vertical ? r.x2 : r.y2),
+      };
+      da_append(out, edge);
+      continue;
+    }
 
-      if (fabs(map->cells.items[i]->x2 - map->cells.items[j]->x1) < EPSILON) {
-        if (MAX(map->cells.items[i]->y1, map->cells.items[j]->y1) <
-          MIN(map->cells.items[i]->y2, map->cells.items[j]->y2)) {
-          da_append(&map->cells.items[i]->hNeighbours, map->cells.items[j]);
-        }
-      }
+    Rect left, right;
+    splitRegion(cell, top.region, &left, &right);
 
-      if (fabs(map->cells.items[i]->y2 - map->cells.items[j]->y1) < EPSILON) {
-        if (MAX(map->cells.items[i]->x1, map->cells.items[j]->x1) <
-          MIN(map->cells.items[i]->x2, map->cells.items[j]->x2)) {
-          da_append(&map->cells.items[i]->vNeighbours, map->cells.items[j]);
-        }
-      }
+    // Right before left so the left side pops first
+    if (cell->splitOnX == vertical) {
+      if (hi > cell->split) da_append(stack, ((CellRegion){ cell->right, right }));
+      if (lo < cell->split) da_append(stack, ((CellRegion){ cell->left, left }));
+    } else if (at < cell->split) {
+      da_append(stack, ((CellRegion){ cell->left, left }));
+    } else {
+      da_append(stack, ((CellRegion){ cell->right, right }));
     }
   }
 }
 
-void shrinkCells(Cell* cell, uint8_t minCellSize){
-  if(cell->left!=NULL){
-    shrinkCells(cell->left, minCellSize);
-    shrinkCells(cell->right, minCellSize);
-  }
+// Links `cell` to the leaves right of and below its BSP `region`, found by
+// descending the splits from map->bounds. The new edges go on the end of
+// the shared array and any old ones are left dead.
+void linkCellNeighbours(Map* map, Cell* cell, Rect region) {
+  RoomGraph *graph = &map->graph;
+  RoomSpan *span = &graph->out[cell->index];
+  graph->deadEdges += span->count;
+  graph->analysed = false;
+  uint32_t start = graph->edges.count;
+
+  CellRegionArray stack = {0};
+  linkAcross(&map->root, map->bounds, false, region.x2, region.y1, region.y2, &stack, cell->index, &graph->edges);
+  linkAcross(&map->root, map->bounds, true, region.y2, region.x1, region.x2, &stack, cell->index, &graph->edges);
+  free(stack.items);
+  *span = (RoomSpan){ start, graph->edges.count - start };
+}
 
-  float w = cell->x2-cell->x1;
-  float h = cell->y2-cell->y1;
-  float newW = MAX(w*RANDBETWEEN(3,9)/10, minCellSize);
-  float newH = MAX(h*RANDBETWEEN(3,9)/10, minCellSize);
+// `regions` holds the leaves' BSP regions in map->cells order once rooms
+// have shrunk, NULL means each leaf still spans its region.
+static void linkNeighbours(Map* map, const Rect* regions, size_t i) {
+  Cell *cell = map->cells.items[i];
+  linkCellNeighbours(map, cell, regions != NULL ? regions[i] : cellBounds(cell));
+}
 
-  cell->x1 = cell->x1 + 0.5*(w-newW);
-  cell->x2 = cell->x2 - 0.5*(w-newW);
-  cell->y1 = cell->y1 + 0.5*(h-newH);
-  cell->y2 = cell->y2 - 0.5*(h-newH);
+void findCellNeighbours(Map* map, size_t i) {
+  linkNeighbours(map, NULL, i);
 }
 
-void makeHalls(Map* map) {
+void findNeighbours(Map* map) {
+  getLeaves(&map->root, &map->cells);
+  resetRoomGraph(&map->graph, map->cells.count);
+
   for (size_t i = 0; i < map->cells.count; i++) {
-    Cell *cell = map->cells.items[i];
+    findCellNeighbours(map, i);
+  }
+}
 
-    cell->hHalls = (HallArray){0};
-    cell->vHalls = (HallArray){0};
+// Rebuilds leaf regions from the splits, in getLeaves order.
+void collectRegions(const Cell* cell, Rect region, Rect* regions, size_t* count) {
+  CellRegionArray stack = {0};
+  da_append(&stack, ((CellRegion){ cell, region }));
 
-    // Horizontal halls
-    for (size_t j = 0; j < cell->hNeighbours.count; j++) {
-      Cell *neighbour = cell->hNeighbours.items[j];
+  while (stack.count > 0) {
+    CellRegion top = stack.items[--stack.count];
+    if (top.cell->left == NULL) {
+      regions[(*count)++] = top.region;
+      continue;
+    }
 
-      float y_min = MAX(cell->y1, neighbour->y1);
-      float y_max = MIN(cell->y2, neighbour->y2) - map->minCellSize;
+    Rect left, right;
+    splitRegion(top.cell, top.region, &left, &right);
+    da_append(&stack, ((CellRegion){ top.cell->right, right }));
+    da_append(&stack, ((CellRegion){ top.cell->left, left }));
+  }
+  free(stack.items);
+}
 
-      if (y_max > y_min) {
-        float y = RANDBETWEENF(y_min, y_max);
-        Hall hall = { cell->x2, y, neighbour->x1, y + map->minCellSize };
-        da_append(&cell->hHalls, hall);
-      }
-    }
+void shrinkCell(Cell* cell, uint16_t minCellSize, Rng* rng){
+  int32_t w = cell->x2-cell->x1;
+  int32_t h = cell->y2-cell->y1;
+  int32_t newW = MAX(w*RNGBETWEEN(rng, 3,9)/10, (int32_t)minCellSize);
+  int32_t newH = MAX(h*RNGBETWEEN(rng, 3,9)/10, (int32_t)minCellSize);
 
-    // Vertical halls
-    for (size_t j = 0; j < cell->vNeighbours.count; j++) {
-      Cell *neighbour = cell->vNeighbours.items[j];
+  cell->x1 = cell->x1 + (w-newW)/2;
+  cell->x2 = cell->x1 + newW;
+  cell->y1 = cell->y1 + (h-newH)/2;
+  cell->y2 = cell->y1 + newH;
+}
 
-      float x_min = MAX(cell->x1, neighbour->x1);
-      float x_max = MIN(cell->x2, neighbour->x2) - map->minCellSize;
+void shrinkCells(Cell* cell, uint16_t minCellSize, Rng* rng){
+  CellWalk walk = {0};
+  cellWalkBegin(&walk, cell, true);
+  for (Cell *c; (c = cellWalkNext(&walk)) != NULL;) shrinkCell(c, minCellSize, rng);
+  cellWalkEnd(&walk);
+}
 
-      if (x_max > x_min) {
-        float x = RANDBETWEENF(x_min, x_max);
+// How far the hall sticks out of its owner's room. Rooms sit inside their
+// leaf regions, so every hall lies within hallReach of its owner's region.
+int32_t hallReach(const Cell* owner, const Hall* hall) {
+  int32_t reach = MAX(owner->x1 - hall->x1, hall->x2 - owner->x2);
+  reach = MAX(reach, MAX(owner->y1 - hall->y1, hall->y2 - owner->y2));
+  return MAX(reach, 0);
+}
+
+// Straight halls where the rooms still share enough of an edge; otherwise a
+// routed corridor when `rooms` is given. The room's halls go on the end of
+// the shared array, horizontal ones straight there and vertical ones once
+// those are done, and any old ones are left dead.
+void makeCellHalls(Map* map, Cell* cell, const Bvh* rooms) {
+  RoomGraph *graph = &map->graph;
+  RoomHalls *span = &graph->hallSpans[cell->index];
+  graph->deadHalls += span->horizontal + span->vertical;
+  graph->analysed = false;
+
+  HallArray *hHalls = &graph->halls;
+  HallArray *vHalls = &graph->pending;
+  uint32_t start = hHalls->count;
+  vHalls->count = 0;
+
+  RoomEdgeArray edges = cellEdges(map, cell);
+  da_foreach(RoomEdge, edge, &edges) {
+    Cell *neighbour = map->cells.items[edge->to];
+
+    if (!edge->vertical) {
+      int32_t y_min = MAX(cell->y1, neighbour->y1);
+      int32_t y_max = MIN(cell->y2, neighbour->y2) - map->minCellSize;
+
+      if (y_max >= y_min) {
+        int32_t y = RNGBETWEEN(&map->rng, y_min, y_max);
+        Hall hall = { cell->x2, y, neighbour->x1, y + map->minCellSize };
+        da_append(hHalls, hall);
+        map->hallReach = MAX(map->hallReach, hallReach(cell, &hall));
+      } else if (rooms != NULL) {
+        routeCorridor(map, cell, neighbour, false, rooms, hHalls, vHalls);
+      }
+    } else {
+      int32_t x_min = MAX(cell->x1, neighbour->x1);
+      int32_t x_max = MIN(cell->x2, neighbour->x2) - map->minCellSize;
+
+      if (x_max >= x_min) {
+        int32_t x = RNGBETWEEN(&map->rng, x_min, x_max);
         Hall hall = { x, cell->y2, x + map->minCellSize, neighbour->y1 };
-        da_append(&cell->vHalls, hall);
+        da_append(vHalls, hall);
+        map->hallReach = MAX(map->hallReach, hallReach(cell, &hall));
+      } else if (rooms != NULL) {
+        routeCorridor(map, cell, neighbour, true, rooms, hHalls, vHalls);
       }
     }
   }
+
+  uint32_t horizontal = hHalls->count - start;
+  da_foreach(Hall, hall, vHalls) da_append(hHalls, *hall);
+  *span = (RoomHalls){ start, horizontal, vHalls->count };
+}
+
+void makeHalls(Map* map) {
+  Bvh rooms = {0};
+  if (map->routeHalls) buildBvh(&rooms, map);
+
+  for (size_t i = 0; i < map->cells.count; i++) {
+    makeCellHalls(map, map->cells.items[i], map->routeHalls ? &rooms : NULL);
+  }
+
+  if (map->routeHalls) {
+    mergeHalls(map);
+    freeBvh(&rooms);
+  }
 }
 
-Map initMap(uint16_t margin, uint8_t numRooms, uint8_t minCellSize) {
+Map initMap(const MapConfig* config, uint64_t seed) {
   Map map = {
     .root = {
-      .x1 = margin,
-      .y1 = margin,
-      .x2 = WINDOW_WIDTH - 2 * margin,
-      .y2 = WINDOW_HEIGHT - 2 * margin,
+      .x1 = config->margin,
+      .y1 = config->margin,
+      .x2 = config->width - 2 * config->margin,
+      .y2 = config->height - 2 * config->margin,
       .left = NULL,
       .right = NULL
     }, 
-
-    .numRooms = numRooms,
-    .minCellSize = minCellSize,
+    .bounds = {
+      config->margin,
+      config->margin,
+      config->width - 2 * config->margin,
+      config->height - 2 * config->margin,
+    },
+
+    .numRooms = config->numRooms,
+    .minCellSize = config->minCellSize,
+    .routeHalls = config->routeHalls,
+    .caves = config->caves,
+    .seed = seed,
+    .rng = { seed },
   };
 
   //TODO: Add randomizer for rooms and minCellSize
@@ -249,29 +486,296 @@ Map initMap(uint16_t margin, uint8_t numRooms, uint8_t minCellSize) {
   return map;
 }
 
+void freeMap(Map* map) {
+  freeCell(&map->root);
+  free(map->cells.items);
+  freeRoomGraph(&map->graph);
+  freeWalls(&map->walls);
+  map->root.left = NULL;
+  map->root.right = NULL;
+  map->cells = (CellArray){0};
+  map->stages = 0;
+}
+
 
-void devideMap(Map* map){
+// Stops early once no leaf can be split, so a room count the area can't
+// hold doesn't spin forever; returns the rooms actually made.
+size_t devideMap(Map* map){
   size_t rooms = 1;
-  while(rooms<map->numRooms){
-    if(devideCell(&map->root, map->minCellSize)){rooms++;}
+  size_t splittable = cellSplittable(&map->root, map->minCellSize);
+  while(rooms<map->numRooms && splittable > 0){
+    Cell *split = devideCell(&map->root, map->minCellSize, &map->rng);
+    if(split){rooms++; countSplit(&splittable, split, map->minCellSize);}
+  }
+  return rooms;
+}
+
+void mapGenBegin(MapGenTask* task, Map* map) {
+  map->rng = (Rng){ map->seed };
+  *task = (MapGenTask){
+    .map = map,
+    .phase = GEN_DIVIDE,
+    .total = map->numRooms > 1 ? map->numRooms - 1 : 0,
+    .splittable = cellSplittable(&map->root, map->minCellSize),
+    .phaseStart = PROFILE_NOW(),
+  };
+}
+
+static void mapGenNextPhase(MapGenTask* task) {
+  uint64_t now = PROFILE_NOW();
+  PROFILE_RECORD(mapGenPhaseName(task->phase), task->phaseStart, now);
+  task->phaseStart = now;
+
+  task->phase++;
+  task->done = 0;
+
+  switch (task->phase) {
+  case GEN_NEIGHBOURS:
+    getLeaves(&task->map->root, &task->map->cells);
+    resetRoomGraph(&task->map->graph, task->map->cells.count);
+    task->map->stages |= STAGE_DIVIDED;
+    task->total = task->map->cells.count;
+    break;
+  case GEN_SHRINK:
+    task->map->stages |= STAGE_NEIGHBOURS;
+    cellWalkBegin(&task->walk, &task->map->root, true);
+    task->total = 2 * task->map->cells.count - 1;
+    break;
+  case GEN_INDEX:
+    task->map->stages |= STAGE_SHRUNK;
+    task->total = 0;
+    if (task->map->routeHalls) {
+      task->rooms = malloc(sizeof(Bvh));
+      task->roomsBuild = malloc(sizeof(BvhBuild));
+      ASSERT(task->rooms != NULL && task->roomsBuild != NULL && "Buy more RAM lol");
+      bvhBuildBegin(task->roomsBuild, task->rooms, &task->map->root, task->map->cells.count);
+      task->total = bvhBuildUnits(task->map->cells.count);
+    }
+    break;
+  case GEN_HALLS:
+    if (task->roomsBuild != NULL) {
+      bvhBuildEnd(task->roomsBuild);
+      free(task->roomsBuild);
+      task->roomsBuild = NULL;
+    }
+    task->total = task->map->cells.count;
+    break;
+  case GEN_MERGE:
+    task->total = 0;
+    if (task->map->routeHalls) {
+      task->merge = malloc(sizeof(HallMerge));
+      ASSERT(task->merge != NULL && "Buy more RAM lol");
+      hallMergeBegin(task->merge, task->map, task->map->cells.items, task->map->cells.count);
+      task->total = task->merge->total;
+    }
+    break;
+  case GEN_WALLS:
+    if (task->merge != NULL) {
+      hallMergeEnd(task->merge);
+      free(task->merge);
+      task->merge = NULL;
+    }
+    task->map->stages |= STAGE_HALLS;
+    task->wallTask = malloc(sizeof(WallTask));
+    ASSERT(task->wallTask != NULL && "Buy more RAM lol");
+    wallTaskBeginMap(task->wallTask, task->map);
+    task->total = task->wallTask->total;
+    break;
+  case GEN_DONE:
+    task->map->stages |= STAGE_WALLS;
+    mapGenAbort(task);
+    break;
+  default:
+    UNREACHABLE("mapGenNextPhase");
+  }
+}
+
+
+// Runs at most `units` work units; returns true once the map is complete.
+bool mapGenAdvance(MapGenTask* task, size_t units) {
+  Map *map = task->map;
+
+  for (size_t unit = 0; unit < units && task->phase != GEN_DONE; unit++) {
+    if (task->done >= task->total) {
+      mapGenNextPhase(task);
+      continue;
+    }
+
+    switch (task->phase) {
+    case GEN_DIVIDE: {
+      // Ends the phase at the rooms reached once no leaf can be split
+      if (task->splittable == 0) {
+        task->total = task->done;
+        break;
+      }
+      Cell *split = devideCell(&map->root, map->minCellSize, &map->rng);
+      if (split) {
+        task->done++;
+        countSplit(&task->splittable, split, map->minCellSize);
+      }
+      break;
+    }
+    case GEN_NEIGHBOURS:
+      findCellNeighbours(map, task->done++);
+      break;
+    case GEN_SHRINK:
+      shrinkCell(cellWalkNext(&task->walk), map->minCellSize, &map->rng);
+      task->done++;
+      break;
+    case GEN_INDEX:
+      bvhBuildStep(task->roomsBuild);
+      task->done++;
+      break;
+    case GEN_HALLS:
+      makeCellHalls(map, map->cells.items[task->done++], task->rooms);
+      break;
+    case GEN_MERGE:
+      // The merge only learns its length as it goes
+      if (hallMergeStep(task->merge)) {
+        task->total = MAX(task->merge->total, task->merge->done + 1);
+        task->done = task->merge->done;
+      } else {
+        map->hallReach = task->merge->reach;
+        task->done = task->total;
+      }
+      break;
+    case GEN_WALLS:
+      if (wallTaskStep(task->wallTask)) {
+        task->total = MAX(task->wallTask->total, task->wallTask->done + 1);
+        task->done = task->wallTask->done;
+      } else {
+        task->done = task->total;
+      }
+      break;
+    default:
+      UNREACHABLE("mapGenAdvance");
+    }
+  }
+
+  return task->phase == GEN_DONE;
+}
+
+static double monotonicSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Advances generation until `budget` seconds have passed. The clock is only
+// read every GEN_STEP_UNITS units so timing stays cheap next to the work.
+#define GEN_STEP_UNITS 64
+
+bool mapGenStep(MapGenTask* task, double budget) {
+  double deadline = monotonicSeconds() + budget;
+
+  while (!mapGenAdvance(task, GEN_STEP_UNITS)) {
+    if (monotonicSeconds() >= deadline) return false;
+  }
+  return true;
+}
+
+float mapGenProgress(const MapGenTask* task) {
+  if (task->phase == GEN_DONE) return 1.0f;
+
+  float phase = task->total > 0 ? (float)task->done / task->total : 1.0f;
+  return (task->phase + phase) / GEN_DONE;
+}
+
+const char *mapGenPhaseName(GenPhase phase) {
+  switch (phase) {
+  case GEN_DIVIDE:     return "Dividing";
+  case GEN_NEIGHBOURS: return "Finding neighbours";
+  case GEN_SHRINK:     return "Shrinking rooms";
+  case GEN_INDEX:      return "Indexing rooms";
+  case GEN_HALLS:      return "Making halls";
+  case GEN_MERGE:      return "Merging halls";
+  case GEN_WALLS:      return "Tracing walls";
+  case GEN_DONE:       return "Done";
+  }
+  UNREACHABLE("mapGenPhaseName");
+}
+
+// Frees the task's scratch state; the map keeps whatever was generated.
+void mapGenAbort(MapGenTask* task) {
+  cellWalkEnd(&task->walk);
+  if (task->roomsBuild != NULL) {
+    bvhBuildEnd(task->roomsBuild);
+    free(task->roomsBuild);
+    task->roomsBuild = NULL;
+  }
+  if (task->merge != NULL) {
+    hallMergeEnd(task->merge);
+    free(task->merge);
+    task->merge = NULL;
+  }
+  if (task->wallTask != NULL) {
+    wallTaskEnd(task->wallTask);
+    free(task->wallTask);
+    task->wallTask = NULL;
+  }
+  if (task->rooms != NULL) {
+    freeBvh(task->rooms);
+    free(task->rooms);
+    task->rooms = NULL;
   }
 }
 
 void generateMap(Map* map) {
-  devideMap(map);
-  findNeighbours(map);
-  shrinkCells(&map->root, map->minCellSize);
-  makeHalls(map);
+  PROFILE_ZONE("generateMap");
+  MapGenTask task;
+  mapGenBegin(&task, map);
+  // Walls are left to mapWalls(), for whoever needs them
+  while (task.phase < GEN_WALLS) mapGenAdvance(&task, 1);
+  mapGenAbort(&task);
+}
+
+// Neighbours consume no random draws, so wherever they fall the divide,
+// shrink and hall draws come off the stream in generateMap's order.
+void mapRequire(Map* map, uint8_t stages) {
+  if (stages & STAGE_WALLS) stages |= STAGE_HALLS;
+  if (stages & STAGE_HALLS) stages |= STAGE_SHRUNK | STAGE_NEIGHBOURS;
+  if (stages & (STAGE_SHRUNK | STAGE_NEIGHBOURS)) stages |= STAGE_DIVIDED;
+
+  uint8_t missing = stages & ~map->stages;
+  if (missing == 0) return;
+  PROFILE_ZONE("mapRequire");
+
+  if (missing & STAGE_DIVIDED) {
+    devideMap(map);
+    getLeaves(&map->root, &map->cells);
+    resetRoomGraph(&map->graph, map->cells.count);
+  }
+
+  if (missing & STAGE_NEIGHBOURS) {
+    Rect *regions = NULL;
+    if (map->stages & STAGE_SHRUNK) {
+      size_t count = 0;
+      regions = malloc(map->cells.count * sizeof(Rect));
+      ASSERT(regions != NULL && "Buy more RAM lol");
+      collectRegions(&map->root, map->bounds, regions, &count);
+    }
 
-  if (SNAPTOGRID){ 
-    snapToGrid(&map->cells);
+    for (size_t i = 0; i < map->cells.count; i++) linkNeighbours(map, regions, i);
+    free(regions);
   }
+
+  if (missing & STAGE_SHRUNK) shrinkCells(&map->root, map->minCellSize, &map->rng);
+  if (missing & STAGE_HALLS) makeHalls(map);
+  if (missing & STAGE_WALLS) extractMapWalls(map);
+  map->stages |= stages;
 }
 
+size_t mapRoomCount(Map* map) {
+  mapRequire(map, STAGE_DIVIDED);
+  return map->cells.count;
+}
 
-void drawMap(Map* map) {
-  if (!map) return;
+const CellArray *mapRooms(Map* map) {
+  mapRequire(map, STAGE_SHRUNK);
+  return &map->cells;
+}
 
-  addGrid();
-  drawCell(&map->root);
+const Walls *mapWalls(Map* map) {
+  mapRequire(map, STAGE_WALLS);
+  return &map->walls;
 }
@@ -5,15 +5,30 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "./utils.h"
+
 typedef struct Cell Cell;
+typedef struct Bvh Bvh;
+typedef struct BvhBuild BvhBuild;
+typedef struct HallMerge HallMerge;
+typedef struct WallTask WallTask;
 
+// All map coordinates are in grid units; CELLSIZE is only applied when
+// rendering, so generation is exact integer math on every platform.
 typedef struct {
-  float x1;
-  float y1;
-  float x2;
-  float y2;
+  int32_t x1;
+  int32_t y1;
+  int32_t x2;
+  int32_t y2;
 } Hall;
 
+typedef struct {
+  int32_t x1;
+  int32_t y1;
+  int32_t x2;
+  int32_t y2;
+} Rect;
+
 typedef struct {
   Hall *items;
   size_t count;
@@ -26,31 +41,267 @@ typedef struct {
   size_t capacity;
 } CellArray;
 
+// Directed edge of the floor outline with the floor on its left as seen on
+// screen (y down): outer outlines run counter-clockwise, holes clockwise.
+typedef struct {
+  int32_t x1;
+  int32_t y1;
+  int32_t x2;
+  int32_t y2;
+} WallSegment;
+
+typedef struct {
+  WallSegment *items;
+  size_t count;
+  size_t capacity;
+} WallArray;
+
+// Closed outline: `count` segments from `first`, each ending where the next
+// one starts.
+typedef struct {
+  uint32_t first;
+  uint32_t count;
+} WallLoop;
+
+typedef struct {
+  WallLoop *items;
+  size_t count;
+  size_t capacity;
+} WallLoopArray;
+
+// Outline of the union of every room and hall, merged into maximal segments
+// and ordered loop by loop. Doubles as the collision mesh.
+typedef struct {
+  WallArray segments;
+  WallLoopArray loops;
+} Walls;
+
 struct Cell {
-  float x1, y1, x2, y2;
+  int32_t x1, y1, x2, y2;
+  // Where devideCell cut this cell. Internal bounds are shrunk later, so
+  // queries descend on the split rather than the children's bounds.
+  int32_t split;
+  bool splitOnX;
   Cell *left;
   Cell *right;
-  CellArray hNeighbours;
-  CellArray vNeighbours;
-  HallArray hHalls;
-  HallArray vHalls;
+  // A leaf's place in map->cells, which names it in the room graph
+  uint32_t index;
 };
 
+// Neighbour link between two leaves whose BSP regions share part of an
+// edge, stored once, on the room left of the boundary or above it. Rooms
+// are leaf indices of map->cells.
+typedef struct {
+  uint32_t from;
+  uint32_t to;
+  // `to` lies below `from` rather than right of it
+  bool vertical;
+  // Some corridor of touching halls reaches both rooms. Only filled in by
+  // mapRoomGraph()
+  bool linked;
+  // Stretch of the boundary the two BSP regions share, in y for side by
+  // side rooms and in x for vertical pairs
+  int32_t lo;
+  int32_t hi;
+} RoomEdge;
+
+typedef struct {
+  RoomEdge *items;
+  size_t count;
+  size_t capacity;
+} RoomEdgeArray;
+
+// A room's run of entries in one of RoomGraph's shared arrays
+typedef struct {
+  uint32_t start;
+  uint32_t count;
+} RoomSpan;
+
+// A room's halls: `horizontal` ones from `start`, then `vertical` ones
+typedef struct {
+  uint32_t start;
+  uint32_t horizontal;
+  uint32_t vertical;
+} RoomHalls;
+
+// Room adjacency and halls of a map, in shared arrays rather than lists on
+// every leaf. Each room's out edges (its right and lower neighbours, right
+// ones first) and halls are one span of `edges` and `halls`. Generation
+// appends room after room, so the spans come out in room order with
+// nothing between them, as in compressed sparse row form. Redoing a room
+// (see rerollSubtree) appends its new span and leaves the old entries dead
+// until compactRoomGraph() packs the arrays again.
+typedef struct {
+  uint32_t roomCount;
+  RoomEdgeArray edges;
+  HallArray halls;
+  // Per room, in map->cells order
+  RoomSpan *out;
+  RoomHalls *hallSpans;
+  // Entries of `edges` and `halls` no span covers any more
+  size_t deadEdges;
+  size_t deadHalls;
+  // Edges into room i, as indices into `edges`, are inEdges[inStart[i]] up
+  // to inEdges[inStart[i + 1]]. Built along with the linked flags by
+  // mapRoomGraph(), and only valid while `analysed`
+  uint32_t *inStart;
+  uint32_t *inEdges;
+  bool analysed;
+  // Vertical halls of the room makeCellHalls() is working on
+  HallArray pending;
+} RoomGraph;
+
+// Generator settings. Everything except cellSize is in grid units; cellSize
+// and showGrid only affect drawing.
+typedef struct {
+  int32_t width;
+  int32_t height;
+  uint16_t margin;
+  // Fewer rooms come out when the area can't be divided that far
+  uint32_t numRooms;
+  uint16_t minCellSize;
+  uint16_t cellSize;
+  bool showGrid;
+  // Route L and Z shaped corridors between neighbours that can't take a
+  // straight hall, avoiding every other room
+  bool routeHalls;
+  // Carve each room into a cave when the map is rasterized (see
+  // rasterizeLevel())
+  bool caves;
+} MapConfig;
+
+// Generation stages a map has been built to, as bit flags. Later stages
+// need the earlier ones, except that neighbours and shrunk rooms don't need
+// each other. See mapRequire().
+typedef enum {
+  STAGE_DIVIDED = 1 << 0,
+  STAGE_SHRUNK = 1 << 1,
+  STAGE_NEIGHBOURS = 1 << 2,
+  STAGE_HALLS = 1 << 3,
+  STAGE_WALLS = 1 << 4,
+} MapStage;
+
+#define STAGE_ALL (STAGE_DIVIDED | STAGE_SHRUNK | STAGE_NEIGHBOURS | STAGE_HALLS | STAGE_WALLS)
+
 typedef struct {
   Cell root;
-  uint8_t numRooms;
-  uint8_t minCellSize;
+  // The area the BSP divides. Kept apart from root, which shrinks with
+  // every other cell
+  Rect bounds;
+  uint8_t stages;
+  uint32_t numRooms;
+  uint16_t minCellSize;
+  bool routeHalls;
+  bool caves;
+  uint64_t seed;
+  Rng rng;
   CellArray cells;
+  RoomGraph graph;
+  // Furthest any hall sticks out of its owner's room (see hallReach())
+  int32_t hallReach;
+  Walls walls;
 } Map;
 
-Cell *makeCell(float x1, float y1, float x2, float y2);
-void drawCell(Cell *cell);
+typedef enum {
+  GEN_DIVIDE,
+  GEN_NEIGHBOURS,
+  GEN_SHRINK,
+  GEN_INDEX,
+  GEN_HALLS,
+  GEN_MERGE,
+  GEN_WALLS,
+  GEN_DONE,
+} GenPhase;
+
+// Iterative walk over a BSP subtree with an explicit stack, so passes over
+// deep or lopsided trees neither recurse nor risk the call stack. Pre-order
+// yields a cell before its children, left first, and has already pushed
+// them when it does, so the caller may free the cell it was given.
+// Post-order yields both children before their parent, which is how rooms
+// shrink.
+typedef struct {
+  CellArray stack;
+  Cell *last;
+  bool postOrder;
+} CellWalk;
+
+// Resumable generateMap that goes on to trace the walls: advances the phases
+// in bounded work units so callers can spread generation across frames or
+// watch it step by step.
+typedef struct {
+  Map *map;
+  GenPhase phase;
+  size_t done;
+  size_t total;
+  CellWalk walk;
+  // Final rooms, for routed halls to collide against, and their build
+  Bvh *rooms;
+  BvhBuild *roomsBuild;
+  HallMerge *merge;
+  WallTask *wallTask;
+  // Leaves the divide phase can still split
+  size_t splittable;
+  uint64_t phaseStart;
+} MapGenTask;
+
+Cell *makeCell(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+void freeCell(Cell *cell);
+// Appends the leaves below `cell` left to right, numbering them as it goes
+void getLeaves(Cell *cell, CellArray *cells);
+// The leaves' BSP regions, which shrunk rooms no longer show, from `bounds`
+void collectRegions(const Cell *cell, Rect bounds, Rect *regions, size_t *count);
+// Redoes a leaf's links to the leaves right of and below its BSP `region`
+void linkCellNeighbours(Map *map, Cell *cell, Rect region);
+void cellWalkBegin(CellWalk *walk, Cell *root, bool postOrder);
+// The next cell of the walk, or NULL once it is over
+Cell *cellWalkNext(CellWalk *walk);
+void cellWalkEnd(CellWalk *walk);
+int32_t hallReach(const Cell *owner, const Hall *hall);
+
+// Empties the graph and sizes it for `rooms` rooms
+void resetRoomGraph(RoomGraph *graph, size_t rooms);
+void freeRoomGraph(RoomGraph *graph);
+// Moves every span to the front in room order, dropping the dead entries
+void compactRoomGraph(RoomGraph *graph);
+// Compacts once dead entries outnumber live ones, so redoing rooms costs
+// amortized time in the entries redone
+void trimRoomGraph(RoomGraph *graph);
+size_t roomGraphMemoryUsage(const RoomGraph *graph);
+// Views into the graph's shared arrays, valid until the map's edges or
+// halls next change. Halls come horizontal ones first.
+RoomEdgeArray cellEdges(const Map *map, const Cell *cell);
+HallArray cellHalls(const Map *map, const Cell *cell);
+HallArray cellAxisHalls(const Map *map, const Cell *cell, bool vertical);
 
-Map initMap(uint16_t margin, uint8_t numRooms, uint8_t minCellSize);
-void devideMap(Map *map);
-bool devideRoot(Cell root, uint8_t minCellSize);
+Map initMap(const MapConfig *config, uint64_t seed);
+void freeMap(Map *map);
+size_t mapMemoryUsage(Map *map);
+size_t devideMap(Map *map);
+bool devideRoot(Cell root, uint16_t minCellSize);
+// Splits a random leaf below `cell` and returns it, or NULL when the descent
+// ends at a cell too small to split.
+Cell *devideCell(Cell *cell, uint16_t minCellSize, Rng *rng);
+void shrinkCells(Cell *cell, uint16_t minCellSize, Rng *rng);
+void makeCellHalls(Map *map, Cell *cell, const Bvh *rooms);
 
+// Builds every stage but the walls, which mapWalls() traces on demand
 void generateMap(Map *map);
-void drawMap(Map *map);
+
+// Demand-driven generation: builds whichever of `stages` and the stages
+// they need are still missing, in the same order and with the same random
+// draws as generateMap, so a map built piecemeal ends up identical.
+void mapRequire(Map *map, uint8_t stages);
+// Accessors that build only what they return. Room counts are known once
+// the BSP is divided; rooms need shrinking but not neighbours or halls.
+size_t mapRoomCount(Map *map);
+const CellArray *mapRooms(Map *map);
+const Walls *mapWalls(Map *map);
+
+void mapGenBegin(MapGenTask *task, Map *map);
+bool mapGenAdvance(MapGenTask *task, size_t units);
+bool mapGenStep(MapGenTask *task, double budget);
+float mapGenProgress(const MapGenTask *task);
+const char *mapGenPhaseName(GenPhase phase);
+void mapGenAbort(MapGenTask *task);
 
 #endif // MAPGEN_H_
@@ -0,0 +1,251 @@
+#ifndef MAPGEN_FIXED_H_
+#define MAPGEN_FIXED_H_
+
+// Allocation-free generator for configurations fixed at compile time.
+//
+//   DEFINE_FIXED_MAPGEN(SmallMap, 80, 60, 3, 10, 1, 3)
+//
+//   static SmallMap map;
+//   SmallMap_generate(&map, seed);
+//   int px = SmallMap_toPixels(map.nodes[map.leaves[0]].x1);
+//
+// expands to a SmallMap struct whose nodes, leaves, neighbours and halls are
+// fixed-capacity arrays sized from the room count, plus a generate function
+// with every size inlined as a constant. Cell size is given as a shift, so
+// grid to pixel conversion is a single shift. For the same configuration and
+// seed the result is identical to initMap + generateMap with routeHalls off;
+// pairs that can't take a straight hall are left unconnected.
+// tools/fixedbench checks this over a range of seeds.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+#include "./utils.h"
+
+// Rooms partition the world, so their adjacency graph is planar and has
+// fewer than 3 edges per room.
+#define FIXED_MAX_NEIGHBOURS(rooms) (3 * (rooms))
+
+typedef struct {
+  int32_t x1, y1, x2, y2;
+  // Child node indices; 0 marks a leaf since the root is never a child
+  uint32_t left, right;
+} FixedCell;
+
+typedef struct {
+  uint32_t from;
+  uint32_t to;
+  bool vertical;
+} FixedNeighbour;
+
+// Pointers into a fixed map's arrays so one generator body serves every
+// instantiation; it is always inlined so the constants still fold.
+typedef struct {
+  FixedCell *nodes;
+  uint32_t *nodeCount;
+  uint32_t *leaves;
+  uint32_t *leafCount;
+  FixedNeighbour *neighbours;
+  uint32_t *neighbourCount;
+  Hall *halls;
+  uint32_t *hallOffsets;
+  uint32_t *stack;
+  Rng *rng;
+} FixedMapView;
+
+static inline __attribute__((always_inline)) bool
+fixedDevide(FixedMapView *m, int32_t minCellSize) {
+  uint32_t index = 0;
+
+  for (;;) {
+    FixedCell *cell = &m->nodes[index];
+    int32_t width = cell->x2 - cell->x1;
+    int32_t height = cell->y2 - cell->y1;
+    if (width < minCellSize && height < minCellSize) return false;
+
+    if (cell->left != 0) {
+      index = rngNext(m->rng) % 2 ? cell->left : cell->right;
+      continue;
+    }
+
+    if (MAX(width, height) < 2) return false;
+
+    FixedCell left = *cell, right = *cell;
+    left.left = left.right = right.left = right.right = 0;
+    if (width > height) {
+      int32_t mid = cell->x1 + MAX(RNGBETWEEN(m->rng, 3, 6) * width / 10, 1);
+      left.x2 = right.x1 = mid;
+    } else {
+      int32_t mid = cell->y1 + MAX(RNGBETWEEN(m->rng, 3, 6) * height / 10, 1);
+      left.y2 = right.y1 = mid;
+    }
+
+    cell->left = (*m->nodeCount)++;
+    cell->right = (*m->nodeCount)++;
+    m->nodes[cell->left] = left;
+    m->nodes[cell->right] = right;
+    return true;
+  }
+}
+
+// Preorder leaves, the same order getLeaves produces.
+static inline __attribute__((always_inline)) void
+fixedCollectLeaves(FixedMapView *m) {
+  size_t top = 0;
+  m->stack[top++] = 0;
+
+  while (top > 0) {
+    FixedCell *cell = &m->nodes[m->stack[--top]];
+    if (cell->left == 0) {
+      m->leaves[(*m->leafCount)++] = cell - m->nodes;
+    } else {
+      m->stack[top++] = cell->right;
+      m->stack[top++] = cell->left;
+    }
+  }
+}
+
+static inline __attribute__((always_inline)) void
+fixedFindNeighbours(FixedMapView *m, uint32_t maxNeighbours) {
+  for (uint32_t i = 0; i < *m->leafCount; i++) {
+    FixedCell *a = &m->nodes[m->leaves[i]];
+
+    for (int vertical = 0; vertical < 2; vertical++) {
+      for (uint32_t j = 0; j < *m->leafCount; j++) {
+        FixedCell *b = &m->nodes[m->leaves[j]];
+        if (i == j) continue;
+
+        bool touching = vertical
+          ? a->y2 == b->y1 && MAX(a->x1, b->x1) < MIN(a->x2, b->x2)
+          : a->x2 == b->x1 && MAX(a->y1, b->y1) < MIN(a->y2, b->y2);
+        if (!touching) continue;
+
+        ASSERT(*m->neighbourCount < maxNeighbours);
+        m->neighbours[(*m->neighbourCount)++] = (FixedNeighbour){ i, j, vertical };
+      }
+    }
+  }
+}
+
+// Post-order over every node, matching shrinkCells' random draws.
+static inline __attribute__((always_inline)) void
+fixedShrink(FixedMapView *m, int32_t minCellSize) {
+  size_t top = 0;
+  uint32_t last = UINT32_MAX;
+  m->stack[top++] = 0;
+
+  while (top > 0) {
+    uint32_t index = m->stack[top - 1];
+    FixedCell *cell = &m->nodes[index];
+
+    if (cell->left != 0 && last != cell->right) {
+      m->stack[top++] = last == cell->left ? cell->right : cell->left;
+      continue;
+    }
+
+    int32_t w = cell->x2 - cell->x1;
+    int32_t h = cell->y2 - cell->y1;
+    int32_t newW = MAX(w * RNGBETWEEN(m->rng, 3, 9) / 10, minCellSize);
+    int32_t newH = MAX(h * RNGBETWEEN(m->rng, 3, 9) / 10, minCellSize);
+
+    cell->x1 = cell->x1 + (w - newW) / 2;
+    cell->x2 = cell->x1 + newW;
+    cell->y1 = cell->y1 + (h - newH) / 2;
+    cell->y2 = cell->y1 + newH;
+
+    top--;
+    last = index;
+  }
+}
+
+static inline __attribute__((always_inline)) void
+fixedMakeHalls(FixedMapView *m, int32_t minCellSize) {
+  uint32_t hall = 0;
+  uint32_t edge = 0;
+
+  for (uint32_t i = 0; i < *m->leafCount; i++) {
+    m->hallOffsets[i] = hall;
+
+    for (; edge < *m->neighbourCount && m->neighbours[edge].from == i; edge++) {
+      FixedNeighbour *n = &m->neighbours[edge];
+      FixedCell *cell = &m->nodes[m->leaves[n->from]];
+      FixedCell *neighbour = &m->nodes[m->leaves[n->to]];
+
+      if (!n->vertical) {
+        int32_t yMin = MAX(cell->y1, neighbour->y1);
+        int32_t yMax = MIN(cell->y2, neighbour->y2) - minCellSize;
+        if (yMax >= yMin) {
+          int32_t y = RNGBETWEEN(m->rng, yMin, yMax);
+          m->halls[hall++] = (Hall){ cell->x2, y, neighbour->x1, y + minCellSize };
+        }
+      } else {
+        int32_t xMin = MAX(cell->x1, neighbour->x1);
+        int32_t xMax = MIN(cell->x2, neighbour->x2) - minCellSize;
+        if (xMax >= xMin) {
+          int32_t x = RNGBETWEEN(m->rng, xMin, xMax);
+          m->halls[hall++] = (Hall){ x, cell->y2, x + minCellSize, neighbour->y1 };
+        }
+      }
+    }
+  }
+
+  m->hallOffsets[*m->leafCount] = hall;
+}
+
+static inline __attribute__((always_inline)) void
+fixedGenerate(FixedMapView *m, uint64_t seed, int32_t width, int32_t height,
+              int32_t margin, uint32_t rooms, int32_t minCellSize) {
+  *m->rng = (Rng){ seed };
+  *m->nodeCount = 1;
+  *m->leafCount = 0;
+  *m->neighbourCount = 0;
+  m->nodes[0] = (FixedCell){
+    margin, margin, width - 2 * margin, height - 2 * margin, 0, 0,
+  };
+
+  for (uint32_t count = 1; count < rooms;) {
+    if (fixedDevide(m, minCellSize)) count++;
+  }
+
+  fixedCollectLeaves(m);
+  fixedFindNeighbours(m, FIXED_MAX_NEIGHBOURS(rooms));
+  fixedShrink(m, minCellSize);
+  fixedMakeHalls(m, minCellSize);
+}
+
+#define DEFINE_FIXED_MAPGEN(Name, WIDTH, HEIGHT, MARGIN, ROOMS, MINCELLSIZE,   \
+                            CELLSHIFT)                                         \
+  _Static_assert((ROOMS) >= 1, #Name " needs at least one room");              \
+  _Static_assert((CELLSHIFT) >= 0 && (CELLSHIFT) < 16,                         \
+                 #Name " cell size must be a small power of two");             \
+                                                                               \
+  typedef struct {                                                             \
+    FixedCell nodes[2 * (ROOMS) - 1];                                          \
+    uint32_t nodeCount;                                                        \
+    uint32_t leaves[ROOMS];                                                    \
+    uint32_t leafCount;                                                        \
+    FixedNeighbour neighbours[FIXED_MAX_NEIGHBOURS(ROOMS)];                    \
+    uint32_t neighbourCount;                                                   \
+    Hall halls[FIXED_MAX_NEIGHBOURS(ROOMS)];                                   \
+    uint32_t hallOffsets[(ROOMS) + 1];                                         \
+    uint32_t stack[2 * (ROOMS)];                                               \
+    Rng rng;                                                                   \
+  } Name;                                                                      \
+                                                                               \
+  static inline int32_t Name##_toPixels(int32_t units) {                       \
+    return units << (CELLSHIFT);                                               \
+  }                                                                            \
+                                                                               \
+  static void Name##_generate(Name *map, uint64_t seed) {                      \
+    FixedMapView view = {                                                      \
+      map->nodes, &map->nodeCount, map->leaves, &map->leafCount,               \
+      map->neighbours, &map->neighbourCount, map->halls, map->hallOffsets,     \
+      map->stack, &map->rng,                                                   \
+    };                                                                         \
+    fixedGenerate(&view, seed, (WIDTH), (HEIGHT), (MARGIN), (ROOMS),           \
+                  (MINCELLSIZE));                                              \
+  }
+
+#endif // MAPGEN_FIXED_H_
@@ -0,0 +1,204 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./mapgen.h"
+#include "./mapio.h"
+#include "./utils.h"
+
+static uint32_t countNodes(Cell *root) {
+  CellWalk walk = {0};
+  uint32_t count = 0;
+  cellWalkBegin(&walk, root, false);
+  while (cellWalkNext(&walk) != NULL) count++;
+  cellWalkEnd(&walk);
+  return count;
+}
+
+static void writeNodes(String_Builder *sb, Cell *root) {
+  CellWalk walk = {0};
+  cellWalkBegin(&walk, root, false);
+
+  for (Cell *cell; (cell = cellWalkNext(&walk)) != NULL;) {
+    MapFileNode node = {
+      cell->x1, cell->y1, cell->x2, cell->y2, cell->split,
+      (cell->left != NULL ? MAPFILE_NODE_SPLIT : 0) | (cell->splitOnX ? MAPFILE_NODE_SPLIT_X : 0),
+    };
+    sb_append_buf(sb, (const char *)&node, sizeof(node));
+  }
+  cellWalkEnd(&walk);
+}
+
+static void writeU32(String_Builder *sb, uint32_t value) {
+  sb_append_buf(sb, (const char *)&value, sizeof(value));
+}
+
+void serializeMap(Map *map, String_Builder *sb) {
+  MapFileHeader header = {
+    .magic = MAPIO_MAGIC,
+    .version = MAPIO_VERSION,
+    .seed = map->seed,
+    .numRooms = map->numRooms,
+    .minCellSize = map->minCellSize,
+    .nodeCount = countNodes(&map->root),
+    .leafCount = map->cells.count,
+    .flags = (map->routeHalls ? MAPFILE_ROUTE_HALLS : 0) | (map->caves ? MAPFILE_CAVES : 0),
+    .bounds = map->bounds,
+  };
+  sb_append_buf(sb, (const char *)&header, sizeof(header));
+  writeNodes(sb, &map->root);
+
+  for (size_t i = 0; i < map->cells.count; i++) {
+    Cell *cell = map->cells.items[i];
+    RoomEdgeArray edges = cellEdges(map, cell);
+    HallArray halls = cellHalls(map, cell);
+
+    // A room's edges to its right come before the ones below it
+    uint32_t hEdges = 0;
+    while (hEdges < edges.count && !edges.items[hEdges].vertical) hEdges++;
+    writeU32(sb, hEdges);
+    writeU32(sb, edges.count - hEdges);
+    writeU32(sb, cellAxisHalls(map, cell, false).count);
+    writeU32(sb, cellAxisHalls(map, cell, true).count);
+
+    da_foreach(RoomEdge, edge, &edges) writeU32(sb, edge->to);
+    if (halls.count > 0) sb_append_buf(sb, (const char *)halls.items, halls.count * sizeof(Hall));
+  }
+}
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  size_t pos;
+} Reader;
+
+static bool readBytes(Reader *r, void *out, size_t size) {
+  if (size > r->size - r->pos) return false;
+  memcpy(out, r->data + r->pos, size);
+  r->pos += size;
+  return true;
+}
+
+// Rebuilds the tree from its pre-order nodes. The stack holds the cells
+// still waiting for their node, so deep trees need no recursion.
+static bool readNodes(Reader *r, Cell *root, uint32_t budget) {
+  CellArray pending = {0};
+  bool ok = true;
+  da_append(&pending, root);
+
+  while (pending.count > 0) {
+    Cell *cell = pending.items[--pending.count];
+    MapFileNode node;
+    if (budget == 0 || !readBytes(r, &node, sizeof(node))) {
+      ok = false;
+      break;
+    }
+    budget--;
+
+    cell->x1 = node.x1; cell->y1 = node.y1;
+    cell->x2 = node.x2; cell->y2 = node.y2;
+    cell->split = node.split;
+    cell->splitOnX = (node.flags & MAPFILE_NODE_SPLIT_X) != 0;
+    if (!(node.flags & MAPFILE_NODE_SPLIT)) continue;
+
+    cell->left = makeCell(0, 0, 0, 0);
+    cell->right = makeCell(0, 0, 0, 0);
+    da_append(&pending, cell->right);
+    da_append(&pending, cell->left);
+  }
+
+  free(pending.items);
+  return ok && budget == 0;
+}
+
+// Appends a room's edges to the graph; the shared stretch of boundary comes
+// from the two rooms' BSP regions.
+static bool readEdges(Reader *r, Map *map, const Rect *regions, uint32_t from,
+                      bool vertical, uint32_t count) {
+  RoomEdgeArray *edges = &map->graph.edges;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t to;
+    if (!readBytes(r, &to, sizeof(to)) || to >= map->cells.count) return false;
+    Rect a = regions[from], b = regions[to];
+    RoomEdge edge = {
+      .from = from,
+      .to = to,
+      .vertical = vertical,
+      .lo = vertical ? MAX(a.x1, b.x1) : MAX(a.y1, b.y1),
+      .hi = vertical ? MIN(a.x2, b.x2) : MIN(a.y2, b.y2),
+    };
+    da_append(edges, edge);
+  }
+  return true;
+}
+
+static bool readHalls(Reader *r, Map *map, Cell *owner, uint32_t count) {
+  HallArray *halls = &map->graph.halls;
+  if ((size_t)count * sizeof(Hall) > r->size - r->pos) return false;
+  if (count == 0) return true;
+  size_t start = halls->count;
+  da_resize(halls, start + count);
+  if (!readBytes(r, halls->items + start, count * sizeof(Hall))) return false;
+
+  for (size_t i = start; i < halls->count; i++) {
+    map->hallReach = MAX(map->hallReach, hallReach(owner, &halls->items[i]));
+  }
+  return true;
+}
+
+bool deserializeMap(const void *data, size_t size, Map *map) {
+  Reader r = { data, size, 0 };
+  MapFileHeader header;
+
+  if (!readBytes(&r, &header, sizeof(header))) return false;
+  if (memcmp(header.magic, MAPIO_MAGIC, 4) != 0) return false;
+  if (header.version != MAPIO_VERSION) return false;
+
+  *map = (Map){
+    .bounds = header.bounds,
+    .numRooms = header.numRooms,
+    .minCellSize = header.minCellSize,
+    .routeHalls = (header.flags & MAPFILE_ROUTE_HALLS) != 0,
+    .caves = (header.flags & MAPFILE_CAVES) != 0,
+    .seed = header.seed,
+    .rng = { header.seed },
+  };
+
+  bool ok = readNodes(&r, &map->root, header.nodeCount);
+  Rect *regions = NULL;
+  if (ok) {
+    getLeaves(&map->root, &map->cells);
+    ok = map->cells.count == header.leafCount;
+  }
+  if (ok) {
+    size_t count = 0;
+    resetRoomGraph(&map->graph, map->cells.count);
+    regions = malloc(MAX(map->cells.count, (size_t)1) * sizeof(Rect));
+    ASSERT(regions != NULL && "Buy more RAM lol");
+    collectRegions(&map->root, map->bounds, regions, &count);
+  }
+
+  for (uint32_t i = 0; ok && i < map->cells.count; i++) {
+    Cell *cell = map->cells.items[i];
+    RoomGraph *graph = &map->graph;
+    uint32_t counts[4];
+    uint32_t edgeStart = graph->edges.count, hallStart = graph->halls.count;
+
+    ok = readBytes(&r, counts, sizeof(counts))
+      && readEdges(&r, map, regions, i, false, counts[0])
+      && readEdges(&r, map, regions, i, true, counts[1])
+      && readHalls(&r, map, cell, counts[2])
+      && readHalls(&r, map, cell, counts[3]);
+    if (!ok) break;
+    graph->out[i] = (RoomSpan){ edgeStart, graph->edges.count - edgeStart };
+    graph->hallSpans[i] = (RoomHalls){ hallStart, counts[2], counts[3] };
+  }
+  free(regions);
+
+  // Files hold everything but the walls, which mapWalls() derives on demand
+  if (ok) map->stages = STAGE_DIVIDED | STAGE_SHRUNK | STAGE_NEIGHBOURS | STAGE_HALLS;
+  if (!ok) freeMap(map);
+  return ok;
+}
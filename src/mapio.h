@@ -0,0 +1,51 @@
+#ifndef MAPIO_H_
+#define MAPIO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+#include "./utils.h"
+
+#define MAPIO_MAGIC "RGVM"
+#define MAPIO_VERSION 5
+
+// Binary layout (native endianness, little-endian on every target we ship):
+//
+//   MapFileHeader
+//   MapFileNode[nodeCount]      BSP in preorder, MAPFILE_NODE_SPLIT on inner nodes
+//   per leaf, in getLeaves() order, its span of the room graph:
+//     uint32_t hEdges, vEdges, hHalls, vHalls
+//     uint32_t neighbour leaf indices (right then below)
+//     Hall halls (h then v)
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t seed;
+  uint32_t numRooms;
+  uint32_t minCellSize;
+  uint32_t nodeCount;
+  uint32_t leafCount;
+  uint32_t flags;
+  // Map.bounds, which the shrunk root no longer shows
+  Rect bounds;
+} MapFileHeader;
+
+// MapFileHeader.flags
+#define MAPFILE_ROUTE_HALLS 1u
+#define MAPFILE_CAVES 2u
+
+#define MAPFILE_NODE_SPLIT 1u
+#define MAPFILE_NODE_SPLIT_X 2u
+
+typedef struct {
+  int32_t x1, y1, x2, y2;
+  int32_t split;
+  uint32_t flags;
+} MapFileNode;
+
+void serializeMap(Map *map, String_Builder *sb);
+bool deserializeMap(const void *data, size_t size, Map *map);
+
+#endif // MAPIO_H_
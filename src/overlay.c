@@ -0,0 +1,85 @@
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./overlay.h"
+#include "./utils.h"
+
+void overlayPush(PerfOverlay *overlay, FrameSample sample) {
+  overlay->samples[overlay->written++ % OVERLAY_SAMPLES] = sample;
+}
+
+static size_t overlayCount(PerfOverlay *overlay) {
+  return MIN(overlay->written, (size_t)OVERLAY_SAMPLES);
+}
+
+static int compareFloat(const void *a, const void *b) {
+  float x = *(const float *)a;
+  float y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+void overlayDraw(PerfOverlay *overlay) {
+  size_t count = overlayCount(overlay);
+  if (!overlay->visible || count == 0) return;
+
+  static float sorted[OVERLAY_SAMPLES];
+  int bins[OVERLAY_BINS] = {0};
+  FrameSample mean = {0};
+
+  for (size_t i = 0; i < count; i++) {
+    FrameSample *s = &overlay->samples[i];
+    sorted[i] = s->frameMs;
+    bins[MIN((int)s->frameMs, OVERLAY_BINS - 1)]++;
+
+    mean.updateMs += s->updateMs / count;
+    mean.mapMs += s->mapMs / count;
+    mean.gridMs += s->gridMs / count;
+    mean.presentMs += s->presentMs / count;
+  }
+  qsort(sorted, count, sizeof(*sorted), compareFloat);
+
+  FrameSample *last = &overlay->samples[(overlay->written - 1) % OVERLAY_SAMPLES];
+  int x = 10, y = 40, line = 16;
+
+  DrawRectangle(x - 5, y - 5, 260, 9 * line + 70, Fade(BLACK, 0.7f));
+  DrawText(TextFormat("frame p50 %.2f  p99 %.2f  max %.2f ms",
+                      sorted[count / 2], sorted[(count - 1) * 99 / 100], sorted[count - 1]),
+           x, y, 10, WHITE);
+  DrawText(TextFormat("update  %.3f ms", mean.updateMs), x, y += line, 10, WHITE);
+  DrawText(TextFormat("map     %.3f ms", mean.mapMs), x, y += line, 10, WHITE);
+  DrawText(TextFormat("grid    %.3f ms", mean.gridMs), x, y += line, 10, WHITE);
+  DrawText(TextFormat("present %.3f ms", mean.presentMs), x, y += line, 10, WHITE);
+  DrawText(TextFormat("draw calls %u", last->drawCalls), x, y += line, 10, WHITE);
+  DrawText(TextFormat("map memory %.1f KiB", last->memory / 1024.0), x, y += line, 10, WHITE);
+  DrawText(TextFormat("%zu frames (F2 exports CSV)", count), x, y += line, 10, WHITE);
+
+  int peak = 1;
+  for (int i = 0; i < OVERLAY_BINS; i++) peak = MAX(peak, bins[i]);
+
+  int base = y + line + 60;
+  for (int i = 0; i < OVERLAY_BINS; i++) {
+    int h = bins[i] * 60 / peak;
+    DrawRectangle(x + i * 6, base - h, 5, h, i < 17 ? GREEN : (i < 34 ? YELLOW : RED));
+  }
+}
+
+bool overlayExportCsv(PerfOverlay *overlay, const char *path, uint64_t seed) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) return false;
+
+  fprintf(file, "seed,frame,frame_ms,update_ms,map_ms,grid_ms,present_ms,draw_calls,memory\n");
+
+  size_t count = overlayCount(overlay);
+  for (size_t i = overlay->written - count; i < overlay->written; i++) {
+    FrameSample *s = &overlay->samples[i % OVERLAY_SAMPLES];
+    fprintf(file, "%llu,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%u,%zu\n",
+            (unsigned long long)seed, i, s->frameMs, s->updateMs, s->mapMs,
+            s->gridMs, s->presentMs, s->drawCalls, s->memory);
+  }
+
+  return fclose(file) == 0;
+}
@@ -0,0 +1,37 @@
+#ifndef OVERLAY_H_
+#define OVERLAY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef OVERLAY_SAMPLES
+#define OVERLAY_SAMPLES 1024
+#endif
+
+// Frame-time histogram bins, one per millisecond
+#define OVERLAY_BINS 40
+
+typedef struct {
+  float frameMs;
+  float updateMs;
+  float mapMs;
+  float gridMs;
+  float presentMs;
+  uint32_t drawCalls;
+  size_t memory;
+} FrameSample;
+
+// Fixed-size ring of the most recent frames, drawn as a toggleable overlay
+// and exportable to CSV.
+typedef struct {
+  FrameSample samples[OVERLAY_SAMPLES];
+  size_t written;
+  bool visible;
+} PerfOverlay;
+
+void overlayPush(PerfOverlay *overlay, FrameSample sample);
+void overlayDraw(PerfOverlay *overlay);
+bool overlayExportCsv(PerfOverlay *overlay, const char *path, uint64_t seed);
+
+#endif // OVERLAY_H_
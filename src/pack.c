@@ -0,0 +1,222 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "./mapgen.h"
+#include "./mapio.h"
+#include "./pack.h"
+#include "./utils.h"
+
+static uint64_t hashSeed(uint64_t seed) {
+  Rng rng = { seed };
+  return rngNext(&rng);
+}
+
+static void growBounds(PackEntry *entry, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+  entry->x1 = MIN(entry->x1, MIN(x1, x2));
+  entry->y1 = MIN(entry->y1, MIN(y1, y2));
+  entry->x2 = MAX(entry->x2, MAX(x1, x2));
+  entry->y2 = MAX(entry->y2, MAX(y1, y2));
+}
+
+PackEntry summarizeMap(Map *map) {
+  PackEntry entry = {
+    .seed = map->seed,
+    .numRooms = map->cells.count,
+    .x1 = map->root.x2, .y1 = map->root.y2,
+    .x2 = map->root.x1, .y2 = map->root.y1,
+  };
+
+  for (size_t i = 0; i < map->cells.count; i++) {
+    Cell *cell = map->cells.items[i];
+    growBounds(&entry, cell->x1, cell->y1, cell->x2, cell->y2);
+
+    HallArray halls = cellHalls(map, cell);
+    entry.numHalls += halls.count;
+    da_foreach(Hall, hall, &halls) growBounds(&entry, hall->x1, hall->y1, hall->x2, hall->y2);
+  }
+
+  return entry;
+}
+
+bool packWriterOpen(PackWriter *writer, const char *path) {
+  *writer = (PackWriter){0};
+  writer->file = fopen(path, "wb");
+  if (writer->file == NULL) return false;
+
+  PackHeader header = { .magic = PACK_MAGIC, .version = PACK_VERSION };
+  writer->offset = sizeof(header);
+  return fwrite(&header, sizeof(header), 1, writer->file) == 1;
+}
+
+bool packWriterAdd(PackWriter *writer, PackEntry entry, const void *data, size_t size) {
+  entry.offset = writer->offset;
+  entry.size = size;
+  if (fwrite(data, 1, size, writer->file) != size) return false;
+
+  writer->offset += size;
+  da_append(&writer->entries, entry);
+  return true;
+}
+
+bool packWriterFinish(PackWriter *writer) {
+  // Serialized maps are only a multiple of 4 bytes long, and the index is
+  // read in place from the mapped file, so it starts on a PackEntry boundary
+  static const uint8_t padding[_Alignof(PackEntry)] = {0};
+  size_t pad = -writer->offset & (_Alignof(PackEntry) - 1);
+  bool padded = fwrite(padding, 1, pad, writer->file) == pad;
+  writer->offset += pad;
+
+  PackHeader header = {
+    .magic = PACK_MAGIC,
+    .version = PACK_VERSION,
+    .count = writer->entries.count,
+    .seedSlots = 1,
+    .indexOffset = writer->offset,
+  };
+
+  // Keep the seed table at most half full so probes stay short.
+  while (header.seedSlots < 2 * header.count) header.seedSlots *= 2;
+  header.seedTableOffset = header.indexOffset + header.count * sizeof(PackEntry);
+
+  uint32_t *seedTable = calloc(header.seedSlots, sizeof(*seedTable));
+  ASSERT(seedTable != NULL && "Buy more RAM lol");
+  for (uint32_t i = 0; i < header.count; i++) {
+    size_t slot = hashSeed(writer->entries.items[i].seed) & (header.seedSlots - 1);
+    while (seedTable[slot] != 0) slot = (slot + 1) & (header.seedSlots - 1);
+    seedTable[slot] = i + 1;
+  }
+
+  bool ok = padded
+    && fwrite(writer->entries.items, sizeof(PackEntry), header.count, writer->file) == header.count
+    && fwrite(seedTable, sizeof(*seedTable), header.seedSlots, writer->file) == header.seedSlots
+    && fseek(writer->file, 0, SEEK_SET) == 0
+    && fwrite(&header, sizeof(header), 1, writer->file) == 1;
+
+  ok = fclose(writer->file) == 0 && ok;
+  free(seedTable);
+  free(writer->entries.items);
+  *writer = (PackWriter){0};
+  return ok;
+}
+
+static bool mapFile(Pack *pack, const char *path) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size;
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  }
+  CloseHandle(file);
+  if (mapping == NULL) return false;
+
+  pack->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  pack->size = size.QuadPart;
+  CloseHandle(mapping);
+  return pack->data != NULL;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+
+  pack->data = data;
+  pack->size = st.st_size;
+  return true;
+#endif
+}
+
+static void unmapFile(Pack *pack) {
+#ifdef _WIN32
+  UnmapViewOfFile(pack->data);
+#else
+  munmap((void *)pack->data, pack->size);
+#endif
+}
+
+bool packOpen(Pack *pack, const char *path) {
+  *pack = (Pack){0};
+  if (!mapFile(pack, path)) return false;
+
+  const PackHeader *header = (const PackHeader *)pack->data;
+  bool ok = pack->size >= sizeof(*header)
+    && memcmp(header->magic, PACK_MAGIC, 4) == 0
+    && header->version == PACK_VERSION
+    && header->indexOffset >= sizeof(*header)
+    && header->indexOffset % _Alignof(PackEntry) == 0
+    && header->seedTableOffset % _Alignof(uint32_t) == 0
+    && header->indexOffset <= pack->size
+    && header->count <= (pack->size - header->indexOffset) / sizeof(PackEntry)
+    && header->seedTableOffset <= pack->size
+    && header->seedSlots <= (pack->size - header->seedTableOffset) / sizeof(uint32_t)
+    && header->seedSlots > 0
+    && (header->seedSlots & (header->seedSlots - 1)) == 0;
+
+  if (!ok) {
+    packClose(pack);
+    return false;
+  }
+
+  pack->header = header;
+  pack->entries = (const PackEntry *)(pack->data + header->indexOffset);
+  pack->seedTable = (const uint32_t *)(pack->data + header->seedTableOffset);
+  return true;
+}
+
+void packClose(Pack *pack) {
+  if (pack->data != NULL) unmapFile(pack);
+  *pack = (Pack){0};
+}
+
+int64_t packFindSeed(const Pack *pack, uint64_t seed) {
+  uint32_t mask = pack->header->seedSlots - 1;
+  size_t slot = hashSeed(seed) & mask;
+
+  for (uint32_t probe = 0; probe < pack->header->seedSlots; probe++) {
+    uint32_t index = pack->seedTable[slot];
+    if (index == 0 || index > pack->header->count) return -1;
+    if (pack->entries[index - 1].seed == seed) return index - 1;
+    slot = (slot + 1) & mask;
+  }
+
+  return -1;
+}
+
+const void *packEntryData(const Pack *pack, size_t index, size_t *size) {
+  if (index >= pack->header->count) return NULL;
+
+  const PackEntry *entry = &pack->entries[index];
+  if (entry->offset > pack->size || entry->size > pack->size - entry->offset) return NULL;
+
+  *size = entry->size;
+  return pack->data + entry->offset;
+}
+
+bool packLoadMap(const Pack *pack, size_t index, Map *map) {
+  size_t size;
+  const void *data = packEntryData(pack, index, &size);
+  return data != NULL && deserializeMap(data, size, map);
+}
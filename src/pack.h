@@ -0,0 +1,75 @@
+#ifndef PACK_H_
+#define PACK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./mapgen.h"
+
+#define PACK_MAGIC "RGVP"
+#define PACK_VERSION 3
+
+// File layout:
+//
+//   PackHeader
+//   serialized maps (see mapio.h), back to back
+//   zero padding to _Alignof(PackEntry)
+//   PackEntry[count]            at indexOffset
+//   uint32_t seedTable[seedSlots] at seedTableOffset
+//
+// The seed table is open-addressed on the entry seed and stores entry
+// index + 1 (0 marks an empty slot), so opening by seed is a constant
+// number of probes into the mapped file.
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint32_t seedSlots;
+  uint64_t indexOffset;
+  uint64_t seedTableOffset;
+} PackHeader;
+
+typedef struct {
+  uint64_t offset;
+  uint64_t size;
+  uint64_t seed;
+  uint32_t numRooms;
+  uint32_t numHalls;
+  int32_t x1, y1, x2, y2;
+} PackEntry;
+
+typedef struct {
+  PackEntry *items;
+  size_t count;
+  size_t capacity;
+} PackEntryArray;
+
+typedef struct {
+  FILE *file;
+  uint64_t offset;
+  PackEntryArray entries;
+} PackWriter;
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  const PackHeader *header;
+  const PackEntry *entries;
+  const uint32_t *seedTable;
+} Pack;
+
+PackEntry summarizeMap(Map *map);
+
+bool packWriterOpen(PackWriter *writer, const char *path);
+bool packWriterAdd(PackWriter *writer, PackEntry entry, const void *data, size_t size);
+bool packWriterFinish(PackWriter *writer);
+
+bool packOpen(Pack *pack, const char *path);
+void packClose(Pack *pack);
+int64_t packFindSeed(const Pack *pack, uint64_t seed);
+const void *packEntryData(const Pack *pack, size_t index, size_t *size);
+bool packLoadMap(const Pack *pack, size_t index, Map *map);
+
+#endif // PACK_H_
@@ -0,0 +1,125 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./mapgen.h"
+#include "./placement.h"
+#include "./utils.h"
+
+void freePlacementScratch(PlacementScratch *scratch) {
+  free(scratch->grid.items);
+  free(scratch->active.items);
+  *scratch = (PlacementScratch){0};
+}
+
+typedef struct {
+  int32_t x1, y1, x2, y2;
+  int32_t cell;
+  int32_t columns, rows;
+  int64_t radius2;
+} PlacementBounds;
+
+// Grid cells hold their point's coordinates, x then y. Empty cells hold a
+// spot far outside any room instead, so the neighbour scan needs no branch
+// per cell: whether a cell is empty or its point is far is too random to
+// predict, and the mispredicts cost more than the whole distance check.
+#define PLACE_EMPTY (-(1 << 30))
+
+static bool tooClose(const PlacementBounds *b, const int32_t *grid, int32_t x, int32_t y) {
+  int32_t gx = (x - b->x1) / b->cell, gy = (y - b->y1) / b->cell;
+  int32_t cx1 = MAX(gx - 2, 0), cx2 = MIN(gx + 2, b->columns - 1);
+  bool close = false;
+
+  for (int32_t cy = MAX(gy - 2, 0); cy <= MIN(gy + 2, b->rows - 1); cy++) {
+    const int32_t *row = &grid[2 * ((size_t)cy * b->columns)];
+    for (int32_t cx = cx1; cx <= cx2; cx++) {
+      int64_t dx = row[2 * cx] - (int64_t)x, dy = row[2 * cx + 1] - (int64_t)y;
+      close |= dx * dx + dy * dy < b->radius2;
+    }
+  }
+  return close;
+}
+
+static void placePoint(const PlacementBounds *b, PlacementArray *out, PlacementScratch *scratch,
+                       int32_t x, int32_t y, uint32_t room) {
+  int32_t gx = (x - b->x1) / b->cell, gy = (y - b->y1) / b->cell;
+  int32_t *cell = &scratch->grid.items[2 * ((size_t)gy * b->columns + gx)];
+  cell[0] = x;
+  cell[1] = y;
+  da_append(&scratch->active, out->count);
+  da_append(out, ((PlacedPoint){ x, y, room }));
+}
+
+void poissonInRect(Rect rect, uint32_t room, const PlacementConfig *config, Rng *rng,
+                   PlacementArray *out, PlacementScratch *scratch) {
+  int32_t r = config->radius;
+  ASSERT(r >= 2);
+  if (rect.x2 <= rect.x1 || rect.y2 <= rect.y1) return;
+  // Keeps offsets from PLACE_EMPTY under 2^31, so their squares fit
+  ASSERT(rect.x1 >= 0 && rect.y1 >= 0);
+  ASSERT(rect.x2 < (1 << (30 - PLACE_SHIFT)) && rect.y2 < (1 << (30 - PLACE_SHIFT)));
+
+  // 181 / 256 is just under 1 / sqrt(2), so no cell can hold two points
+  PlacementBounds b = {
+    .x1 = rect.x1 * PLACE_ONE,
+    .y1 = rect.y1 * PLACE_ONE,
+    .x2 = rect.x2 * PLACE_ONE,
+    .y2 = rect.y2 * PLACE_ONE,
+    .cell = (int32_t)((int64_t)r * 181 / 256),
+    .radius2 = (int64_t)r * r,
+  };
+  b.columns = (b.x2 - b.x1 + b.cell - 1) / b.cell;
+  b.rows = (b.y2 - b.y1 + b.cell - 1) / b.cell;
+
+  size_t cells = (size_t)b.columns * b.rows;
+  da_reserve(&scratch->grid, 2 * cells);
+  for (size_t i = 0; i < 2 * cells; i++) scratch->grid.items[i] = PLACE_EMPTY;
+  scratch->active.count = 0;
+
+  placePoint(&b, out, scratch,
+             b.x1 + (int32_t)(rngNext(rng) % (uint64_t)(b.x2 - b.x1)),
+             b.y1 + (int32_t)(rngNext(rng) % (uint64_t)(b.y2 - b.y1)), room);
+
+  while (scratch->active.count > 0) {
+    size_t pick = rngNext(rng) % scratch->active.count;
+    PlacedPoint from = out->items[scratch->active.items[pick]];
+    bool placed = false;
+
+    for (int i = 0; i < config->attempts && !placed; i++) {
+      // Uniform in the annulus [r, 2r) by rejection from its bounding square.
+      // Each draw splits into two offsets by multiply and shift, which is far
+      // cheaper than two 64-bit modulos in this loop.
+      int64_t dx, dy, d2;
+      do {
+        uint64_t bits = rngNext(rng);
+        dx = (int64_t)((bits & 0xFFFFFFFF) * (uint64_t)(4 * r) >> 32) - 2 * r;
+        dy = (int64_t)((bits >> 32) * (uint64_t)(4 * r) >> 32) - 2 * r;
+        d2 = dx * dx + dy * dy;
+      } while (d2 < b.radius2 || d2 >= 4 * b.radius2);
+
+      int32_t x = from.x + (int32_t)dx, y = from.y + (int32_t)dy;
+      if (x < b.x1 || x >= b.x2 || y < b.y1 || y >= b.y2) continue;
+      if (tooClose(&b, scratch->grid.items, x, y)) continue;
+
+      placePoint(&b, out, scratch, x, y, room);
+      placed = true;
+    }
+
+    if (!placed) {
+      scratch->active.items[pick] = scratch->active.items[--scratch->active.count];
+    }
+  }
+}
+
+void placeInRooms(const Map *map, const PlacementConfig *config, PlacementArray *out) {
+  PlacementScratch scratch = {0};
+
+  for (size_t i = 0; i < map->cells.count; i++) {
+    const Cell *cell = map->cells.items[i];
+    Rng rng = { map->seed ^ (0x8CB92BA72F3D8DD7ull * (i + 1)) };
+    poissonInRect((Rect){ cell->x1, cell->y1, cell->x2, cell->y2 }, i, config, &rng, out, &scratch);
+  }
+
+  freePlacementScratch(&scratch);
+}
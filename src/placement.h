@@ -0,0 +1,70 @@
+#ifndef PLACEMENT_H_
+#define PLACEMENT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+
+// Positions are fixed point with PLACE_SHIFT fraction bits, so placement
+// stays exact integer math like the rest of generation; the tile under a
+// point is (x >> PLACE_SHIFT, y >> PLACE_SHIFT).
+#define PLACE_SHIFT 8
+#define PLACE_ONE (1 << PLACE_SHIFT)
+
+typedef struct {
+  int32_t x;
+  int32_t y;
+  // Index into map->cells
+  uint32_t room;
+} PlacedPoint;
+
+typedef struct {
+  PlacedPoint *items;
+  size_t count;
+  size_t capacity;
+} PlacementArray;
+
+typedef struct {
+  // Minimum distance between any two points, in 1/PLACE_ONE tiles
+  int32_t radius;
+  // Candidates tried around a point before it stops spawning more
+  uint8_t attempts;
+} PlacementConfig;
+
+#define PLACEMENT_CONFIG_DEFAULT ((PlacementConfig){ .radius = 3 * PLACE_ONE, .attempts = 30 })
+
+typedef struct {
+  int32_t *items;
+  size_t count;
+  size_t capacity;
+} PlacementCells;
+
+typedef struct {
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} PlacementIndices;
+
+// Buffers reused from one room to the next
+typedef struct {
+  PlacementCells grid;
+  PlacementIndices active;
+} PlacementScratch;
+
+void freePlacementScratch(PlacementScratch *scratch);
+
+// Bridson's Poisson-disk sampling of the half-open `rect` (in tiles),
+// appending the points to `out`. A background grid with cells under
+// radius / sqrt(2) across holds at most one point each, so every candidate
+// is checked against a fixed 5x5 block of cells and a room costs time
+// linear in the points placed.
+void poissonInRect(Rect rect, uint32_t room, const PlacementConfig *config, Rng *rng,
+                   PlacementArray *out, PlacementScratch *scratch);
+
+// Fills every room of a generated map, room by room in map->cells order.
+// Each room draws from its own generator seeded from the map's seed, so the
+// points only depend on the seed and the config.
+void placeInRooms(const Map *map, const PlacementConfig *config, PlacementArray *out);
+
+#endif // PLACEMENT_H_
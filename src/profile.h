@@ -0,0 +1,195 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+// Scoped timing zones exported as Chrome trace JSON (chrome://tracing or
+// https://ui.perfetto.dev). Build with -DPROFILE to enable; otherwise every
+// macro below expands to nothing.
+//
+//   void drawMap(Map *map) {
+//     PROFILE_ZONE("drawMap");
+//     ...
+//   }
+//
+// Each thread records into its own fixed-size ring buffer without locking,
+// so the oldest events are overwritten once PROFILE_RING_SIZE is exceeded.
+// Export once the instrumented threads are idle, then PROFILE_SHUTDOWN()
+// after they have exited to release the buffers.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef PROFILE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "./utils.h"
+
+#ifndef PROFILE_RING_SIZE
+#define PROFILE_RING_SIZE 65536
+#endif
+
+typedef struct {
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+} ProfileEvent;
+
+typedef struct ProfileThread ProfileThread;
+struct ProfileThread {
+  ProfileEvent events[PROFILE_RING_SIZE];
+  uint64_t written;
+  uint32_t id;
+  ProfileThread *next;
+};
+
+typedef struct {
+  const char *name;
+  uint64_t start;
+} ProfileZone;
+
+static pthread_mutex_t profileLock = PTHREAD_MUTEX_INITIALIZER;
+static ProfileThread *profileThreads = NULL;
+static uint32_t profileThreadCount = 0;
+static _Thread_local ProfileThread *profileThread = NULL;
+
+static inline uint64_t profileNow(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static uint64_t profileWallNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Tick/nanosecond pairs used to turn rdtsc ticks into trace microseconds
+static uint64_t profileStartTicks = 0;
+static uint64_t profileStartNs = 0;
+
+static ProfileThread *profileRegisterThread(void) {
+  ProfileThread *thread = calloc(1, sizeof(*thread));
+  ASSERT(thread != NULL && "Buy more RAM lol");
+
+  pthread_mutex_lock(&profileLock);
+  if (profileThreads == NULL) {
+    profileStartTicks = profileNow();
+    profileStartNs = profileWallNs();
+  }
+  thread->id = profileThreadCount++;
+  thread->next = profileThreads;
+  profileThreads = thread;
+  pthread_mutex_unlock(&profileLock);
+
+  profileThread = thread;
+  return thread;
+}
+
+// Records a finished span; used directly for spans that outlive a scope.
+static inline void profileRecord(const char *name, uint64_t start, uint64_t end) {
+  ProfileThread *thread = profileThread ? profileThread : profileRegisterThread();
+  thread->events[thread->written++ % PROFILE_RING_SIZE] = (ProfileEvent){ name, start, end };
+}
+
+static inline ProfileZone profileZoneBegin(const char *name) {
+  return (ProfileZone){ name, profileNow() };
+}
+
+static inline void profileZoneEnd(ProfileZone *zone) {
+  profileRecord(zone->name, zone->start, profileNow());
+}
+
+static inline bool profileExport(const char *path) {
+  pthread_mutex_lock(&profileLock);
+
+  double ticksPerUs = 1.0;
+  uint64_t ticks = profileNow() - profileStartTicks;
+  uint64_t ns = profileWallNs() - profileStartNs;
+  if (ticks > 0 && ns > 0) ticksPerUs = ticks * 1000.0 / ns;
+
+  // Zones may start before their thread registers, so the trace origin is
+  // the earliest recorded event rather than the first registration
+  uint64_t origin = UINT64_MAX;
+  for (ProfileThread *thread = profileThreads; thread != NULL; thread = thread->next) {
+    uint64_t count = MIN(thread->written, (uint64_t)PROFILE_RING_SIZE);
+    for (uint64_t i = thread->written - count; i < thread->written; i++) {
+      origin = MIN(origin, thread->events[i % PROFILE_RING_SIZE].start);
+    }
+  }
+
+  String_Builder sb = {0};
+  sb_appendf(&sb, "{\"traceEvents\":[\n");
+
+  bool first = true;
+  for (ProfileThread *thread = profileThreads; thread != NULL; thread = thread->next) {
+    uint64_t count = MIN(thread->written, (uint64_t)PROFILE_RING_SIZE);
+
+    for (uint64_t i = thread->written - count; i < thread->written; i++) {
+      ProfileEvent *event = &thread->events[i % PROFILE_RING_SIZE];
+      sb_appendf(&sb, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                 first ? "" : ",\n", event->name, thread->id,
+                 (event->start - origin) / ticksPerUs,
+                 (event->end - event->start) / ticksPerUs);
+      first = false;
+    }
+  }
+  sb_appendf(&sb, "\n]}\n");
+  pthread_mutex_unlock(&profileLock);
+
+  FILE *file = fopen(path, "wb");
+  bool ok = file != NULL && fwrite(sb.items, 1, sb.count, file) == sb.count;
+  if (file != NULL) ok = fclose(file) == 0 && ok;
+  free(sb.items);
+  return ok;
+}
+
+// Frees every thread's ring buffer. Other threads still holding one would
+// write into freed memory, so only call this once they have been joined.
+static inline void profileShutdown(void) {
+  pthread_mutex_lock(&profileLock);
+  ProfileThread *thread = profileThreads;
+  while (thread != NULL) {
+    ProfileThread *next = thread->next;
+    free(thread);
+    thread = next;
+  }
+  profileThreads = NULL;
+  profileThreadCount = 0;
+  profileThread = NULL;
+  pthread_mutex_unlock(&profileLock);
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#define PROFILE_ZONE(name)                                                     \
+  ProfileZone PROFILE_CONCAT(profileZone_, __LINE__)                           \
+      __attribute__((cleanup(profileZoneEnd))) = profileZoneBegin(name)
+#define PROFILE_NOW() profileNow()
+#define PROFILE_RECORD(name, start, end) profileRecord((name), (start), (end))
+#define PROFILE_EXPORT(path) profileExport(path)
+#define PROFILE_SHUTDOWN() profileShutdown()
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_NOW() ((uint64_t)0)
+#define PROFILE_RECORD(name, start, end) ((void)(start), (void)(end))
+#define PROFILE_EXPORT(path) true
+#define PROFILE_SHUTDOWN()
+
+#endif // PROFILE
+
+#endif // PROFILE_H_
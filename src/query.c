@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+#include "./query.h"
+#include "./utils.h"
+
+static bool rectsOverlap(Rect a, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+  return a.x1 < x2 && x1 < a.x2 && a.y1 < y2 && y1 < a.y2;
+}
+
+// The leaf whose BSP region contains the point. Regions tile the root, so
+// this is a single root-to-leaf descent.
+Cell *locateLeaf(Map *map, int32_t x, int32_t y) {
+  Cell *cell = &map->root;
+
+  while (cell->left != NULL) {
+    int32_t coord = cell->splitOnX ? x : y;
+    cell = coord < cell->split ? cell->left : cell->right;
+  }
+  return cell;
+}
+
+// The room containing the point, or NULL if it falls outside every room.
+Cell *roomAt(Map *map, int32_t x, int32_t y) {
+  Cell *cell = locateLeaf(map, x, y);
+  if (x < cell->x1 || x >= cell->x2 || y < cell->y1 || y >= cell->y2) return NULL;
+  return cell;
+}
+
+typedef struct {
+  Rect rect;
+  void **out;
+  size_t capacity;
+  size_t count;
+} QueryResult;
+
+static void pushResult(QueryResult *result, void *item) {
+  if (result->count < result->capacity) result->out[result->count] = item;
+  result->count++;
+}
+
+// Pruned descent to the leaves whose regions can overlap `region`, yielded
+// in getLeaves order. Uses an explicit stack like CellWalk, so lopsided trees
+// don't recurse.
+typedef struct {
+  CellArray stack;
+  Rect region;
+} LeafSearch;
+
+static void leafSearchBegin(LeafSearch *search, Cell *root, Rect region) {
+  *search = (LeafSearch){ .region = region };
+  da_append(&search->stack, root);
+}
+
+static Cell *leafSearchNext(LeafSearch *search) {
+  while (search->stack.count > 0) {
+    Cell *cell = search->stack.items[--search->stack.count];
+    if (cell->left == NULL) return cell;
+
+    int32_t lo = cell->splitOnX ? search->region.x1 : search->region.y1;
+    int32_t hi = cell->splitOnX ? search->region.x2 : search->region.y2;
+    if (hi > cell->split) da_append(&search->stack, cell->right);
+    if (lo < cell->split) da_append(&search->stack, cell->left);
+  }
+  return NULL;
+}
+
+static void leafSearchEnd(LeafSearch *search) {
+  free(search->stack.items);
+  search->stack = (CellArray){0};
+}
+
+size_t queryRooms(Map *map, Rect rect, Cell **out, size_t capacity) {
+  QueryResult result = { rect, (void **)out, capacity, 0 };
+  LeafSearch search;
+  leafSearchBegin(&search, &map->root, rect);
+  for (Cell *cell; (cell = leafSearchNext(&search)) != NULL;) {
+    if (rectsOverlap(rect, cell->x1, cell->y1, cell->x2, cell->y2)) pushResult(&result, cell);
+  }
+  leafSearchEnd(&search);
+  return result.count;
+}
+
+static void collectHalls(HallArray *halls, QueryResult *result) {
+  da_foreach(Hall, hall, halls) {
+    if (rectsOverlap(result->rect, hall->x1, hall->y1, hall->x2, hall->y2)) pushResult(result, hall);
+  }
+}
+
+// Halls are stored on the leaf they leave from and may run out of its region
+// (routed corridors in any direction), so the descent widens the region by
+// hallReach to reach owners whose own region misses the rectangle.
+size_t queryHalls(Map *map, Rect rect, Hall **out, size_t capacity) {
+  QueryResult result = { rect, (void **)out, capacity, 0 };
+  int32_t reach = map->hallReach;
+  Rect region = { rect.x1 - reach, rect.y1 - reach, rect.x2 + reach, rect.y2 + reach };
+  LeafSearch search;
+  leafSearchBegin(&search, &map->root, region);
+  for (Cell *cell; (cell = leafSearchNext(&search)) != NULL;) {
+    HallArray halls = cellHalls(map, cell);
+    collectHalls(&halls, &result);
+  }
+  leafSearchEnd(&search);
+  return result.count;
+}
@@ -0,0 +1,21 @@
+#ifndef QUERY_H_
+#define QUERY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+
+// Spatial queries over a generated map that descend the BSP from map->root
+// instead of scanning map->cells. Points and rectangles are in grid units
+// and half-open, so a room covers [x1, x2) x [y1, y2).
+//
+// Range queries write at most `capacity` results and return the total number
+// of matches, so a return value above `capacity` means the buffer was short.
+
+Cell *locateLeaf(Map *map, int32_t x, int32_t y);
+Cell *roomAt(Map *map, int32_t x, int32_t y);
+size_t queryRooms(Map *map, Rect rect, Cell **out, size_t capacity);
+size_t queryHalls(Map *map, Rect rect, Hall **out, size_t capacity);
+
+#endif // QUERY_H_
@@ -0,0 +1,62 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./mapgen.h"
+#include "./raster.h"
+#include "./utils.h"
+
+Grid makeGrid(int width, int height) {
+  Grid grid = { calloc((size_t)width * height, 1), width, height };
+  ASSERT((grid.tiles != NULL || width * height == 0) && "Buy more RAM lol");
+  return grid;
+}
+
+void freeGrid(Grid *grid) {
+  free(grid->tiles);
+  *grid = (Grid){0};
+}
+
+static void fillRect(Grid *grid, int32_t x1, int32_t y1, int32_t x2, int32_t y2, Tile tile) {
+  int tx1 = MAX(MIN(x1, x2), 0);
+  int ty1 = MAX(MIN(y1, y2), 0);
+  int tx2 = MIN(MAX(x1, x2), grid->width);
+  int ty2 = MIN(MAX(y1, y2), grid->height);
+
+  for (int y = ty1; y < ty2; y++) {
+    uint8_t *row = &GRID_AT(grid, 0, y);
+    for (int x = tx1; x < tx2; x++) {
+      // Rooms win over halls where the two touch
+      if (row[x] != TILE_ROOM) row[x] = tile;
+    }
+  }
+}
+
+static void growExtent(int32_t *w, int32_t *h, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+  *w = MAX(*w, MAX(x1, x2));
+  *h = MAX(*h, MAX(y1, y2));
+}
+
+// Allocates `grid` to cover every room and hall of a generated map.
+void rasterizeMap(Map *map, Grid *grid) {
+  int32_t w = 0, h = 0;
+  for (size_t i = 0; i < map->cells.count; i++) {
+    Cell *cell = map->cells.items[i];
+    HallArray halls = cellHalls(map, cell);
+    growExtent(&w, &h, cell->x1, cell->y1, cell->x2, cell->y2);
+    da_foreach(Hall, hall, &halls) growExtent(&w, &h, hall->x1, hall->y1, hall->x2, hall->y2);
+  }
+
+  *grid = makeGrid(w, h);
+
+  for (size_t i = 0; i < map->cells.count; i++) {
+    Cell *cell = map->cells.items[i];
+    fillRect(grid, cell->x1, cell->y1, cell->x2, cell->y2, TILE_ROOM);
+  }
+
+  for (size_t i = 0; i < map->cells.count; i++) {
+    HallArray halls = cellHalls(map, map->cells.items[i]);
+    da_foreach(Hall, hall, &halls) fillRect(grid, hall->x1, hall->y1, hall->x2, hall->y2, TILE_HALL);
+  }
+}
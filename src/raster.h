@@ -0,0 +1,28 @@
+#ifndef RASTER_H_
+#define RASTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+
+typedef enum {
+  TILE_WALL = 0,
+  TILE_ROOM,
+  TILE_HALL,
+} Tile;
+
+// Tile grid with one tile per grid unit, origin at (0, 0).
+typedef struct {
+  uint8_t *tiles;
+  int width;
+  int height;
+} Grid;
+
+#define GRID_AT(grid, x, y) ((grid)->tiles[(size_t)(y) * (grid)->width + (x)])
+
+Grid makeGrid(int width, int height);
+void freeGrid(Grid *grid);
+void rasterizeMap(Map *map, Grid *grid);
+
+#endif // RASTER_H_
@@ -0,0 +1,94 @@
+#include <raylib.h>
+#include <rlgl.h>
+
+#include "./mapgen.h"
+#include "./profile.h"
+#include "./render.h"
+#include "./utils.h"
+
+// Per-frame draw statistics, reset by the caller once per frame
+RenderStats renderStats = {0};
+
+void addGrid(const MapConfig* config){
+  PROFILE_ZONE("addGrid");
+  int width = config->width * config->cellSize;
+  int height = config->height * config->cellSize;
+
+  if (config->showGrid){ 
+    for(int x=0; x < width; x+=config->cellSize){
+      DrawLine(x,0,x,height, BLUE);
+      renderStats.drawCalls++;
+    }
+
+    for(int y=0; y < height; y+=config->cellSize){
+      DrawLine(0,y,width,y, BLUE);
+      renderStats.drawCalls++;
+    }
+  }
+}
+
+void drawHall(Hall* hall, int cellSize){
+  int x = MIN(hall->x1, hall->x2) * cellSize;
+  int y = MIN(hall->y1, hall->y2) * cellSize;
+  int w = (hall->x2 - hall->x1) * cellSize;
+  int h = (hall->y2 - hall->y1) * cellSize;
+
+  DrawRectangleLines(x, y, w, h, YELLOW);
+  renderStats.drawCalls++;
+}
+
+void drawCell(const Map* map, Cell* cell, int cellSize){
+  CellWalk walk = {0};
+  cellWalkBegin(&walk, cell, false);
+
+  for (Cell *c; (c = cellWalkNext(&walk)) != NULL;) {
+    if (c->left != NULL) continue;
+
+    DrawRectangleLinesEx(
+      (Rectangle){
+        c->x1 * cellSize, c->y1 * cellSize,
+        (c->x2 - c->x1) * cellSize, (c->y2 - c->y1) * cellSize
+      },
+      1,
+      GREEN
+    );
+    renderStats.drawCalls++;
+
+    // Draw the leaf's halls
+    HallArray halls = cellHalls(map, c);
+    for(size_t i = 0; i < halls.count; i++)
+      drawHall(&halls.items[i], cellSize);
+  }
+  cellWalkEnd(&walk);
+}
+
+// The merged outline as a single line batch
+void drawWalls(Walls* walls, int cellSize){
+  rlBegin(RL_LINES);
+  rlColor4ub(GREEN.r, GREEN.g, GREEN.b, GREEN.a);
+  da_foreach(WallSegment, wall, &walls->segments) {
+    rlVertex2i(wall->x1 * cellSize, wall->y1 * cellSize);
+    rlVertex2i(wall->x2 * cellSize, wall->y2 * cellSize);
+  }
+  rlEnd();
+  renderStats.drawCalls++;
+}
+
+void drawMap(Map* map, const MapConfig* config) {
+  PROFILE_ZONE("drawMap");
+  if (!map) return;
+
+  double start = GetTime();
+  addGrid(config);
+  double gridEnd = GetTime();
+
+  // Maps still being generated have no walls yet; show their rectangles
+  if (map->walls.segments.count > 0) {
+    drawWalls(&map->walls, config->cellSize);
+  } else {
+    drawCell(map, &map->root, config->cellSize);
+  }
+
+  renderStats.gridSeconds += gridEnd - start;
+  renderStats.mapSeconds += GetTime() - gridEnd;
+}
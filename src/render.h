@@ -0,0 +1,20 @@
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include "./mapgen.h"
+
+typedef struct {
+  size_t drawCalls;
+  double gridSeconds;
+  double mapSeconds;
+} RenderStats;
+
+extern RenderStats renderStats;
+
+void addGrid(const MapConfig *config);
+void drawHall(Hall *hall, int cellSize);
+void drawCell(const Map *map, Cell *cell, int cellSize);
+void drawWalls(Walls *walls, int cellSize);
+void drawMap(Map *map, const MapConfig *config);
+
+#endif // RENDER_H_
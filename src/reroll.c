@@ -0,0 +1,233 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./bvh.h"
+#include "./mapgen.h"
+#include "./query.h"
+#include "./reroll.h"
+#include "./router.h"
+#include "./utils.h"
+
+typedef struct {
+  Cell *cell;
+  Rect region;
+} RegionLeaf;
+
+typedef struct {
+  RegionLeaf *items;
+  size_t count;
+  size_t capacity;
+} RegionLeaves;
+
+// Closed rectangles: sharing only an edge or a corner counts
+static bool rectsTouch(Rect a, Rect b) {
+  return a.x1 <= b.x2 && b.x1 <= a.x2 && a.y1 <= b.y2 && b.y1 <= a.y2;
+}
+
+static bool hallCrosses(const Hall *hall, Rect r) {
+  return hall->x1 < r.x2 && r.x1 < hall->x2 && hall->y1 < r.y2 && r.y1 < hall->y2;
+}
+
+static Rect roomRect(const Cell *cell) {
+  return (Rect){ cell->x1, cell->y1, cell->x2, cell->y2 };
+}
+
+static Rect growRect(Rect a, Rect b) {
+  return (Rect){ MIN(a.x1, b.x1), MIN(a.y1, b.y1), MAX(a.x2, b.x2), MAX(a.y2, b.y2) };
+}
+
+// Leaves whose BSP regions touch `area`, in getLeaves order, leaving out
+// the subtree at `skip`.
+static void leavesNear(Cell *root, Rect bounds, Rect area, const Cell *skip, RegionLeaves *out) {
+  RegionLeaves stack = {0};
+  da_append(&stack, ((RegionLeaf){ root, bounds }));
+
+  while (stack.count > 0) {
+    RegionLeaf top = stack.items[--stack.count];
+    Cell *cell = top.cell;
+    if (cell == skip || !rectsTouch(top.region, area)) continue;
+
+    if (cell->left == NULL) {
+      da_append(out, top);
+      continue;
+    }
+
+    Rect left = top.region, right = top.region;
+    if (cell->splitOnX) left.x2 = right.x1 = cell->split;
+    else left.y2 = right.y1 = cell->split;
+    da_append(&stack, ((RegionLeaf){ cell->right, right }));
+    da_append(&stack, ((RegionLeaf){ cell->left, left }));
+  }
+  free(stack.items);
+}
+
+// Frees the inner nodes below `cell` but not its leaves, which the caller
+// still holds.
+static void pruneInner(Cell *cell) {
+  CellWalk walk = {0};
+  cellWalkBegin(&walk, cell, false);
+  for (Cell *c; (c = cellWalkNext(&walk)) != NULL;) {
+    if (c != cell && c->left != NULL) free(c);
+  }
+  cellWalkEnd(&walk);
+  cell->left = cell->right = NULL;
+}
+
+// Swaps the fresh leaves below `cell` for the old leaf cells, in order.
+// Post-order yields the leaves left to right and each parent after both of
+// its children, so a parent can swap its leaves once the walk is past them.
+static void adoptLeaves(Cell *cell, RegionLeaves *old) {
+  CellWalk walk = {0};
+  cellWalkBegin(&walk, cell, true);
+
+  size_t next = 0;
+  for (Cell *c; (c = cellWalkNext(&walk)) != NULL;) {
+    // Fresh leaves are about to go, so their index can hold their place
+    // among the old ones until then
+    if (c->left == NULL) {
+      c->index = next++;
+      continue;
+    }
+
+    Cell **children[2] = { &c->left, &c->right };
+    for (size_t i = 0; i < 2; i++) {
+      Cell *child = *children[i];
+      if (child->left != NULL) continue;
+
+      Cell *leaf = old->items[child->index].cell;
+      leaf->x1 = child->x1; leaf->y1 = child->y1;
+      leaf->x2 = child->x2; leaf->y2 = child->y2;
+      freeCell(child);
+      free(child);
+      *children[i] = leaf;
+    }
+  }
+  cellWalkEnd(&walk);
+}
+
+// Rooms a corridor between any two of the given rooms could run into, for
+// the router to avoid. Corridors stay inside the box around their two rooms.
+static void buildLocalRooms(Map *map, CellArray *owners, Bvh *bvh) {
+  Rect area = roomRect(owners->items[0]);
+  da_foreach(Cell *, owner, owners) {
+    RoomEdgeArray edges = cellEdges(map, *owner);
+    area = growRect(area, roomRect(*owner));
+    da_foreach(RoomEdge, edge, &edges) area = growRect(area, roomRect(map->cells.items[edge->to]));
+  }
+
+  size_t capacity = owners->count;
+  Cell **rooms = NULL;
+  size_t found;
+  do {
+    capacity *= 2;
+    rooms = realloc(rooms, capacity * sizeof(Cell *));
+    ASSERT(rooms != NULL && "Buy more RAM lol");
+  } while ((found = queryRooms(map, area, rooms, capacity)) > capacity);
+
+  *bvh = (Bvh){0};
+  for (size_t i = 0; i < found; i++) {
+    BvhItem room = { roomRect(rooms[i]), BVH_ROOM, rooms[i] };
+    da_append(&bvh->items, room);
+  }
+  buildBvhFromItems(bvh);
+  free(rooms);
+}
+
+void rerollSubtree(Map *map, Cell *subtree, uint64_t seed) {
+  mapRequire(map, STAGE_HALLS);
+
+  // Rooms lie inside their regions, so any corner of the subtree's room
+  // steers the walk down to it
+  Rect region = map->bounds;
+  for (Cell *cell = &map->root; cell != subtree;) {
+    ASSERT(cell->left != NULL && "subtree is not part of this map");
+    int32_t coord = cell->splitOnX ? subtree->x1 : subtree->y1;
+    bool left = coord < cell->split;
+    if (cell->splitOnX) *(left ? &region.x2 : &region.x1) = cell->split;
+    else *(left ? &region.y2 : &region.y1) = cell->split;
+    cell = left ? cell->left : cell->right;
+  }
+
+  RegionLeaves inside = {0};
+  leavesNear(subtree, region, region, NULL, &inside);
+
+  // Leaves within hallReach of the region: the border ones touch it, and
+  // only these can own halls that cross it
+  RegionLeaves around = {0};
+  Rect reach = { region.x1 - map->hallReach, region.y1 - map->hallReach,
+                 region.x2 + map->hallReach, region.y2 + map->hallReach };
+  leavesNear(&map->root, map->bounds, reach, subtree, &around);
+
+  CellArray owners = {0};
+  RegionLeaves border = {0};
+  da_foreach(RegionLeaf, leaf, &around) {
+    Cell *cell = leaf->cell;
+    bool touches = rectsTouch(leaf->region, region);
+    bool crosses = false;
+    HallArray halls = cellHalls(map, cell);
+    da_foreach(Hall, hall, &halls) crosses = crosses || hallCrosses(hall, region);
+    if (!touches && !crosses) continue;
+
+    if (touches) da_append(&border, *leaf);
+    da_append(&owners, cell);
+  }
+
+  // Divide the region afresh into the same number of leaves, then move the
+  // new rooms into the old leaf cells so map->cells stays valid
+  pruneInner(subtree);
+  subtree->x1 = region.x1; subtree->y1 = region.y1;
+  subtree->x2 = region.x2; subtree->y2 = region.y2;
+  subtree->split = 0;
+  subtree->splitOnX = false;
+
+  Rng rng = { seed };
+  for (size_t leaves = 1; leaves < inside.count;) {
+    if (devideCell(subtree, map->minCellSize, &rng)) leaves++;
+  }
+  if (subtree->left != NULL) adoptLeaves(subtree, &inside);
+  shrinkCells(subtree, map->minCellSize, &rng);
+
+  // Only the new leaves and the border ones can link into the region, and
+  // each relinks with one descent per direction, as a fresh map does
+  RegionLeaves fresh = {0};
+  leavesNear(subtree, region, region, NULL, &fresh);
+  da_foreach(RegionLeaf, leaf, &fresh) linkCellNeighbours(map, leaf->cell, leaf->region);
+  da_foreach(RegionLeaf, leaf, &border) linkCellNeighbours(map, leaf->cell, leaf->region);
+
+  // Hall draws come from the reroll's generator too, so a reroll only
+  // depends on the map and its seed. The owners' new halls land together at
+  // the end of the graph's hall array, which is what the merge expects.
+  da_foreach(RegionLeaf, leaf, &fresh) da_append(&owners, leaf->cell);
+  Bvh rooms = {0};
+  if (map->routeHalls) buildLocalRooms(map, &owners, &rooms);
+
+  Rng saved = map->rng;
+  map->rng = rng;
+  da_foreach(Cell *, owner, &owners) makeCellHalls(map, *owner, map->routeHalls ? &rooms : NULL);
+  if (map->routeHalls) mergeCellHalls(map, owners.items, owners.count);
+  map->rng = saved;
+  trimRoomGraph(&map->graph);
+
+  if (map->stages & STAGE_WALLS) {
+    freeWalls(&map->walls);
+    map->stages &= ~STAGE_WALLS;
+  }
+
+  freeBvh(&rooms);
+  free(inside.items);
+  free(around.items);
+  free(border.items);
+  free(fresh.items);
+  free(owners.items);
+}
+
+Cell *rerollRegionAt(Map *map, int32_t x, int32_t y) {
+  Cell *region = &map->root;
+  for (Cell *cell = &map->root; cell->left != NULL;) {
+    region = cell;
+    cell = (cell->splitOnX ? x : y) < cell->split ? cell->left : cell->right;
+  }
+  return region;
+}
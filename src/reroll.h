@@ -0,0 +1,25 @@
+#ifndef REROLL_H_
+#define REROLL_H_
+
+#include <stdint.h>
+
+#include "./mapgen.h"
+
+// Regenerates everything below `subtree` from `seed`, for rerolling one
+// region of a map in the editor. The region is divided into as many rooms
+// as it held before, so map->cells keeps its length and order, and the old
+// leaf cells are reused for the new rooms. Outside the subtree only the
+// leaves along its border are touched: their neighbour links into it are
+// redone, and they and any leaf whose halls crossed the region get new
+// halls. Everything else keeps its halls and adjacency, and the work scales
+// with the subtree and its border, not the map.
+//
+// The rooms' old edges and halls are left dead in map->graph, which is
+// compacted once they outnumber the live ones. Walls are dropped and
+// rebuilt by the next mapWalls() call.
+void rerollSubtree(Map *map, Cell *subtree, uint64_t seed);
+// The subtree around the room at a point: the parent of the leaf whose
+// region holds it, or the root when the map is a single room.
+Cell *rerollRegionAt(Map *map, int32_t x, int32_t y);
+
+#endif // REROLL_H_
@@ -0,0 +1,258 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./bvh.h"
+#include "./mapgen.h"
+#include "./router.h"
+#include "./sort.h"
+#include "./utils.h"
+
+// Routing works in a frame where `to` lies right of `from`; vertical pairs
+// are transposed on the way in and out.
+static Rect transposeRect(Rect r, bool transpose) {
+  if (!transpose) return r;
+  return (Rect){ r.y1, r.x1, r.y2, r.x2 };
+}
+
+typedef struct {
+  Rect legs[3];
+  // Leg runs along the pair's axis rather than across it
+  bool along[3];
+  size_t count;
+} Corridor;
+
+static void addLeg(Corridor *corridor, Rect leg, bool along) {
+  if (leg.x2 <= leg.x1 || leg.y2 <= leg.y1) return;
+  corridor->legs[corridor->count] = leg;
+  corridor->along[corridor->count] = along;
+  corridor->count++;
+}
+
+// Leg across the axis at x, joining the row y..y+t to room r. Empty when the
+// row already overlaps the room.
+static Rect crossLeg(int32_t x, int32_t y, int32_t t, Rect room) {
+  if (y + t <= room.y1) return (Rect){ x, y + t, x + t, room.y1 };
+  if (y >= room.y2) return (Rect){ x, room.y2, x + t, y };
+  return (Rect){0};
+}
+
+static bool corridorClear(const Corridor *corridor, bool transpose, const Bvh *rooms,
+                          const Cell *from, const Cell *to) {
+  for (size_t i = 0; i < corridor->count; i++) {
+    Rect leg = transposeRect(corridor->legs[i], transpose);
+    if (bvhAnyOverlap(rooms, leg, from, to)) return false;
+  }
+  return true;
+}
+
+bool routeCorridor(Map *map, Cell *from, Cell *to, bool vertical, const Bvh *rooms,
+                   HallArray *hHalls, HallArray *vHalls) {
+  int32_t t = map->minCellSize;
+  Rect a = transposeRect((Rect){ from->x1, from->y1, from->x2, from->y2 }, vertical);
+  Rect b = transposeRect((Rect){ to->x1, to->y1, to->x2, to->y2 }, vertical);
+
+  if (a.x2 - a.x1 < t || a.y2 - a.y1 < t || b.x2 - b.x1 < t || b.y2 - b.y1 < t) return false;
+
+  // Draw every parameter up front so the RNG stream doesn't depend on which
+  // candidate ends up clear.
+  int32_t xa = RNGBETWEEN(&map->rng, a.x1, a.x2 - t);
+  int32_t ya = RNGBETWEEN(&map->rng, a.y1, a.y2 - t);
+  int32_t xb = RNGBETWEEN(&map->rng, b.x1, b.x2 - t);
+  int32_t yb = RNGBETWEEN(&map->rng, b.y1, b.y2 - t);
+
+  Corridor candidates[3] = {0};
+
+  // Out of from's side, into to's top or bottom
+  addLeg(&candidates[0], (Rect){ a.x2, ya, xb + t, ya + t }, true);
+  addLeg(&candidates[0], crossLeg(xb, ya, t, b), false);
+
+  // Out of from's top or bottom, into to's side
+  addLeg(&candidates[1], crossLeg(xa, yb, t, a), false);
+  addLeg(&candidates[1], (Rect){ xa, yb, b.x1, yb + t }, true);
+
+  // Side to side with a jog halfway across the gap
+  int32_t gap = b.x1 - a.x2;
+  if (gap >= t) {
+    int32_t xm = a.x2 + (gap - t) / 2;
+    addLeg(&candidates[2], (Rect){ a.x2, ya, xm + t, ya + t }, true);
+    addLeg(&candidates[2], (Rect){ xm, MIN(ya, yb), xm + t, MAX(ya, yb) + t }, false);
+    addLeg(&candidates[2], (Rect){ xm, yb, b.x1, yb + t }, true);
+  }
+
+  for (size_t c = 0; c < sizeof(candidates) / sizeof(candidates[0]); c++) {
+    Corridor *corridor = &candidates[c];
+    if (corridor->count == 0 || !corridorClear(corridor, vertical, rooms, from, to)) continue;
+
+    for (size_t i = 0; i < corridor->count; i++) {
+      Rect leg = transposeRect(corridor->legs[i], vertical);
+      Hall hall = { leg.x1, leg.y1, leg.x2, leg.y2 };
+      da_append(corridor->along[i] != vertical ? hHalls : vHalls, hall);
+      map->hallReach = MAX(map->hallReach, hallReach(from, &hall));
+    }
+    return true;
+  }
+  return false;
+}
+
+static int compareHallRefs(const void *pa, const void *pb) {
+  const HallRef *a = pa, *b = pb;
+  if (a->vertical != b->vertical) return a->vertical - b->vertical;
+  if (a->key1 != b->key1) return a->key1 < b->key1 ? -1 : 1;
+  if (a->key2 != b->key2) return a->key2 < b->key2 ? -1 : 1;
+  if (a->lo != b->lo) return a->lo < b->lo ? -1 : 1;
+  if (a->hi != b->hi) return a->hi > b->hi ? -1 : 1;
+  if (a->owner != b->owner) return a->owner < b->owner ? -1 : 1;
+  return 0;
+}
+
+static HallRef makeHallRef(Hall *hall, bool vertical, size_t owner) {
+  if (vertical) return (HallRef){ hall->x1, hall->x2, hall->y1, hall->y2, true, owner, hall };
+  return (HallRef){ hall->y1, hall->y2, hall->x1, hall->x2, false, owner, hall };
+}
+
+// Removed halls are marked with an x1 no real hall can have, then compacted.
+#define HALL_REMOVED INT32_MAX
+
+// Moves the cell's surviving halls down to merge->write. The merged spans
+// sit back to back, so the write position never passes the read one.
+static void compactCellHalls(HallMerge *merge, Cell *cell) {
+  RoomGraph *graph = &merge->map->graph;
+  RoomHalls *span = &graph->hallSpans[cell->index];
+  ASSERT(span->start == merge->end && "merged halls must be the last ones made, in order");
+  merge->end = span->start + span->horizontal + span->vertical;
+
+  Hall *halls = graph->halls.items;
+  uint32_t start = merge->write, read = span->start;
+  uint32_t counts[2] = { span->horizontal, span->vertical };
+  for (size_t axis = 0; axis < 2; axis++) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < counts[axis]; i++, read++) {
+      if (halls[read].x1 == HALL_REMOVED) continue;
+      Hall *hall = &halls[merge->write++];
+      *hall = halls[read];
+      merge->reach = MAX(merge->reach, hallReach(cell, hall));
+      kept++;
+    }
+    counts[axis] = kept;
+  }
+  *span = (RoomHalls){ start, counts[0], counts[1] };
+}
+
+void hallMergeBegin(HallMerge *merge, Map *map, Cell **cells, size_t count) {
+  RoomGraph *graph = &map->graph;
+  uint32_t first = count > 0 ? graph->hallSpans[cells[0]->index].start : graph->halls.count;
+  graph->analysed = false;
+  *merge = (HallMerge){
+    .map = map,
+    .cells = cells,
+    .count = count,
+    .stage = MERGE_GATHER,
+    .open = SIZE_MAX,
+    .write = first,
+    .end = first,
+    // Refined once the halls are gathered
+    .total = 2 * count + sortUnits(3 * count),
+  };
+}
+
+// Within a run of collinear segments sorted by start, anything ending
+// before the furthest end so far is covered by an earlier segment.
+static void sweepHallRef(HallMerge *merge, size_t i) {
+  HallRef *ref = &merge->refs.items[i];
+  HallRef *open = merge->open != SIZE_MAX ? &merge->refs.items[merge->open] : NULL;
+  bool sameLine = open != NULL && open->vertical == ref->vertical
+    && open->key1 == ref->key1 && open->key2 == ref->key2;
+
+  if (sameLine && ref->hi <= merge->cover) {
+    ref->hall->x1 = HALL_REMOVED;
+  } else if (sameLine && open->owner == ref->owner && ref->lo <= open->hi) {
+    open->hi = ref->hi;
+    if (open->vertical) open->hall->y2 = ref->hi; else open->hall->x2 = ref->hi;
+    merge->cover = ref->hi;
+    ref->hall->x1 = HALL_REMOVED;
+  } else {
+    merge->cover = sameLine ? MAX(merge->cover, ref->hi) : ref->hi;
+    merge->open = i;
+  }
+}
+
+bool hallMergeStep(HallMerge *merge) {
+  merge->done++;
+
+  switch (merge->stage) {
+  case MERGE_GATHER: {
+    if (merge->pos < merge->count) {
+      Cell *cell = merge->cells[merge->pos];
+      HallArray hHalls = cellAxisHalls(merge->map, cell, false);
+      HallArray vHalls = cellAxisHalls(merge->map, cell, true);
+      da_foreach(Hall, hall, &hHalls) da_append(&merge->refs, makeHallRef(hall, false, merge->pos));
+      da_foreach(Hall, hall, &vHalls) da_append(&merge->refs, makeHallRef(hall, true, merge->pos));
+      merge->pos++;
+      return true;
+    }
+    sortBegin(&merge->sort, merge->refs.items, merge->refs.count, sizeof(HallRef), compareHallRefs);
+    merge->total = merge->done + sortUnits(merge->refs.count)
+      + merge->refs.count / MERGE_CHUNK + merge->count + 2;
+    merge->stage = MERGE_SORT;
+    return true;
+  }
+  case MERGE_SORT:
+    if (!sortStep(&merge->sort)) {
+      sortEnd(&merge->sort);
+      merge->pos = 0;
+      merge->stage = MERGE_SWEEP;
+    }
+    return true;
+  case MERGE_SWEEP: {
+    size_t end = MIN(merge->pos + MERGE_CHUNK, merge->refs.count);
+    for (; merge->pos < end; merge->pos++) sweepHallRef(merge, merge->pos);
+    if (merge->pos == merge->refs.count) {
+      merge->pos = 0;
+      merge->stage = MERGE_COMPACT;
+    }
+    return true;
+  }
+  case MERGE_COMPACT: {
+    if (merge->pos < merge->count) {
+      compactCellHalls(merge, merge->cells[merge->pos++]);
+      return true;
+    }
+
+    // What the merge removed is dead, or gone when it was the last thing
+    RoomGraph *graph = &merge->map->graph;
+    if (merge->end == graph->halls.count) graph->halls.count = merge->write;
+    else graph->deadHalls += merge->end - merge->write;
+    merge->stage = MERGE_DONE;
+    return false;
+  }
+  case MERGE_DONE:
+    return false;
+  }
+  UNREACHABLE("hallMergeStep");
+}
+
+void hallMergeEnd(HallMerge *merge) {
+  sortEnd(&merge->sort);
+  free(merge->refs.items);
+  *merge = (HallMerge){0};
+}
+
+// Merges within `cells`, then returns the furthest any of their halls reaches.
+static int32_t mergeHallsWithin(Map *map, Cell **cells, size_t count) {
+  HallMerge merge;
+  hallMergeBegin(&merge, map, cells, count);
+  while (hallMergeStep(&merge));
+  int32_t reach = merge.reach;
+  hallMergeEnd(&merge);
+  return reach;
+}
+
+void mergeHalls(Map *map) {
+  map->hallReach = mergeHallsWithin(map, map->cells.items, map->cells.count);
+}
+
+void mergeCellHalls(Map *map, Cell **cells, size_t count) {
+  map->hallReach = MAX(map->hallReach, mergeHallsWithin(map, cells, count));
+}
@@ -0,0 +1,83 @@
+#ifndef ROUTER_H_
+#define ROUTER_H_
+
+#include <stdbool.h>
+
+#include "./bvh.h"
+#include "./mapgen.h"
+#include "./sort.h"
+
+// Corridors for neighbour pairs whose shrunk rooms no longer share enough of
+// an edge for a straight hall. Candidates are L and Z shaped runs of
+// minCellSize-wide segments; the first one that misses every other room in
+// `rooms` is kept. Segments running along the pair's axis go to `hHalls`
+// (or `vHalls` for vertical pairs), the crossing legs to the other array.
+bool routeCorridor(Map *map, Cell *from, Cell *to, bool vertical, const Bvh *rooms,
+                   HallArray *hHalls, HallArray *vHalls);
+
+typedef struct {
+  // Cross-axis span shared by collinear segments, then the run along the axis
+  int32_t key1, key2, lo, hi;
+  bool vertical;
+  size_t owner;
+  Hall *hall;
+} HallRef;
+
+typedef struct {
+  HallRef *items;
+  size_t count;
+  size_t capacity;
+} HallRefArray;
+
+typedef enum {
+  MERGE_GATHER,
+  MERGE_SORT,
+  MERGE_SWEEP,
+  MERGE_COMPACT,
+  MERGE_DONE,
+} MergeStage;
+
+// Segments swept per step
+#define MERGE_CHUNK 4096
+
+// Resumable mergeCellHalls: each step gathers or compacts one cell's halls,
+// takes one SortTask step, or sweeps MERGE_CHUNK sorted segments, so the
+// merge can share frames with the rest of generation.
+struct HallMerge {
+  Map *map;
+  Cell **cells;
+  size_t count;
+  HallRefArray refs;
+  SortTask sort;
+  MergeStage stage;
+  size_t pos;
+  // Segment the sweep may still extend (SIZE_MAX for none) and the furthest
+  // end on its line so far
+  size_t open;
+  int32_t cover;
+  // Furthest any merged hall reaches, once the merge is done
+  int32_t reach;
+  // Compaction: where the next kept hall goes, and where the last span
+  // compacted ended
+  uint32_t write;
+  uint32_t end;
+  // Steps taken, and an estimate of how many it needs in all
+  size_t done;
+  size_t total;
+};
+
+// `cells` must be the last rooms to have had their halls made, in order, so
+// their halls sit together at the end of map->graph.halls.
+void hallMergeBegin(HallMerge *merge, Map *map, Cell **cells, size_t count);
+// Runs one step; returns false once the halls are merged
+bool hallMergeStep(HallMerge *merge);
+void hallMergeEnd(HallMerge *merge);
+
+// Merges collinear overlapping segments of the same leaf and drops segments
+// covered by another leaf's segment.
+void mergeHalls(Map *map);
+// The same over the halls of `cells` only. hallReach is only raised, since
+// halls elsewhere may still reach further.
+void mergeCellHalls(Map *map, Cell **cells, size_t count);
+
+#endif // ROUTER_H_
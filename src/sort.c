@@ -0,0 +1,93 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./sort.h"
+#include "./utils.h"
+
+void sortBegin(SortTask *sort, void *items, size_t count, size_t size, SortCompare compare) {
+  *sort = (SortTask){
+    .items = items,
+    .count = count,
+    .size = size,
+    .compare = compare,
+    .from = items,
+  };
+  if (count > SORT_RUN) {
+    sort->scratch = malloc(count * size);
+    ASSERT(sort->scratch != NULL && "Buy more RAM lol");
+    sort->to = sort->scratch;
+  }
+}
+
+// Points the cursors at the pair starting at sort->lo
+static void sortPair(SortTask *sort) {
+  sort->left = sort->out = sort->lo;
+  sort->right = MIN(sort->lo + sort->width, sort->count);
+}
+
+bool sortStep(SortTask *sort) {
+  size_t size = sort->size;
+
+  if (sort->width == 0) {
+    size_t n = MIN((size_t)SORT_RUN, sort->count - sort->lo);
+    if (n > 0) qsort(sort->items + sort->lo * size, n, size, sort->compare);
+    sort->lo += n;
+    if (sort->lo < sort->count) return true;
+
+    sort->width = SORT_RUN;
+    sort->lo = 0;
+    sortPair(sort);
+    return sort->width < sort->count;
+  }
+
+  if (sort->copyBack) {
+    size_t n = MIN((size_t)SORT_CHUNK, sort->count - sort->lo);
+    memcpy(sort->items + sort->lo * size, sort->scratch + sort->lo * size, n * size);
+    sort->lo += n;
+    return sort->lo < sort->count;
+  }
+
+  size_t mid = MIN(sort->lo + sort->width, sort->count);
+  size_t end = MIN(sort->lo + 2 * sort->width, sort->count);
+  for (size_t moved = 0; moved < SORT_CHUNK && sort->out < end; moved++) {
+    const char *a = sort->from + sort->left * size;
+    const char *b = sort->from + sort->right * size;
+    bool takeLeft = sort->right >= end || (sort->left < mid && sort->compare(a, b) <= 0);
+    memcpy(sort->to + sort->out * size, takeLeft ? a : b, size);
+    if (takeLeft) sort->left++; else sort->right++;
+    sort->out++;
+  }
+  if (sort->out < end) return true;
+
+  sort->lo = end;
+  if (sort->lo < sort->count) {
+    sortPair(sort);
+    return true;
+  }
+
+  // One pass done: the merged runs are twice as long and swap buffers
+  swap(char *, sort->from, sort->to);
+  sort->width *= 2;
+  sort->lo = 0;
+  sortPair(sort);
+  if (sort->width < sort->count) return true;
+
+  if (sort->from == sort->items) return false;
+  sort->copyBack = true;
+  return true;
+}
+
+void sortEnd(SortTask *sort) {
+  free(sort->scratch);
+  *sort = (SortTask){0};
+}
+
+size_t sortUnits(size_t count) {
+  size_t runs = (count + SORT_RUN - 1) / SORT_RUN;
+  size_t passes = 0;
+  for (size_t width = 1; width < runs; width *= 2) passes++;
+  // Every pass merges about runs / 2^pass pairs, which sum to about `runs`
+  return 2 * runs + (passes + 1) * (count / SORT_CHUNK + 1);
+}
@@ -0,0 +1,43 @@
+#ifndef SORT_H_
+#define SORT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bottom-up merge sort that runs in bounded steps, for sorting inside
+// resumable generation. Each step sorts one run of SORT_RUN items or moves
+// at most SORT_CHUNK items through a merge, so no step depends on the array
+// length. Equal items may come out in any order.
+
+#define SORT_RUN 256
+#define SORT_CHUNK 4096
+
+typedef int (*SortCompare)(const void *a, const void *b);
+
+typedef struct {
+  char *items;
+  char *scratch;
+  size_t count;
+  size_t size;
+  SortCompare compare;
+  // Sorted run length being merged; 0 while the first runs are sorted
+  size_t width;
+  // Merging from `from` into `to`, which swap after every pass
+  char *from;
+  char *to;
+  // Start of the current pair (or run), and the cursors inside it
+  size_t lo;
+  size_t left;
+  size_t right;
+  size_t out;
+  bool copyBack;
+} SortTask;
+
+void sortBegin(SortTask *sort, void *items, size_t count, size_t size, SortCompare compare);
+// Runs one step; returns false once `items` is sorted
+bool sortStep(SortTask *sort);
+void sortEnd(SortTask *sort);
+// Rough number of steps, for progress reporting
+size_t sortUnits(size_t count);
+
+#endif // SORT_H_
@@ -8,6 +8,7 @@
 #endif /* ASSERT */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -45,6 +46,24 @@
 #define RANDBETWEENF(min, max)                                                 \
   (rand() % ((int)(max) - (int)(min) + 1) + (int)(min))
 
+// Per-map random generator (splitmix64). Unlike rand() its state is owned by
+// the caller, so maps generated on different threads stay reproducible per seed.
+typedef struct {
+  uint64_t state;
+} Rng;
+
+static inline uint64_t rngNext(Rng *rng) {
+  uint64_t z = (rng->state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+#define RNGBETWEEN(rng, min, max)                                              \
+  ((int)(rngNext(rng) % (uint64_t)((max) - (min) + 1)) + (min))
+#define RNGBETWEENF(rng, min, max)                                             \
+  ((int)(rngNext(rng) % (uint64_t)((int)(max) - (int)(min) + 1)) + (int)(min))
+
 #define TODO(message)                                                          \
   do {                                                                         \
     fprintf(stderr, "%s:%d: TODO: %s\n", __FILE__, __LINE__, message);         \
@@ -109,6 +128,24 @@
     (da)->count = (new_size);                                                  \
   } while (0)
 
+// Trims the capacity down to the count. The items move to a block of exactly
+// that size and the old one is freed, so arrays filled one after another
+// keep reusing the same DA_INIT_CAP block instead of leaving holes.
+#define da_fit(da)                                                             \
+  do {                                                                         \
+    if ((da)->capacity > (da)->count) {                                        \
+      void *fitted = NULL;                                                     \
+      if ((da)->count > 0) {                                                   \
+        fitted = malloc((da)->count * sizeof(*(da)->items));                   \
+        ASSERT(fitted != NULL && "Buy more RAM lol");                          \
+        memcpy(fitted, (da)->items, (da)->count * sizeof(*(da)->items));       \
+      }                                                                        \
+      free((da)->items);                                                       \
+      (da)->items = DECLTYPE_CAST((da)->items) fitted;                         \
+      (da)->capacity = (da)->count;                                            \
+    }                                                                          \
+  } while (0)
+
 #define da_last(da) (da)->items[(ASSERT((da)->count > 0), (da)->count - 1)]
 #define da_remove_unordered(da, i)                                             \
   do {                                                                         \
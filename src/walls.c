@@ -0,0 +1,408 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./mapgen.h"
+#include "./sort.h"
+#include "./utils.h"
+#include "./walls.h"
+
+static void coverUpdate(CoverTree *tree, size_t node, size_t l, size_t r, int32_t lo, int32_t hi, int delta) {
+  if (hi <= tree->coords[l] || tree->coords[r] <= lo) return;
+
+  if (lo <= tree->coords[l] && tree->coords[r] <= hi) {
+    tree->cover[node] += delta;
+  } else {
+    size_t mid = (l + r) / 2;
+    coverUpdate(tree, 2 * node, l, mid, lo, hi, delta);
+    coverUpdate(tree, 2 * node + 1, mid, r, lo, hi, delta);
+  }
+
+  tree->any[node] = tree->cover[node] > 0
+    || (r - l > 1 && (tree->any[2 * node] || tree->any[2 * node + 1]));
+}
+
+// Appends the parts of lo..hi that nothing covers
+static void coverGaps(const CoverTree *tree, size_t node, size_t l, size_t r, int32_t lo, int32_t hi, SpanArray *out) {
+  if (hi <= tree->coords[l] || tree->coords[r] <= lo || tree->cover[node] > 0) return;
+
+  if (!tree->any[node]) {
+    Span span = { MAX(lo, tree->coords[l]), MIN(hi, tree->coords[r]) };
+    da_append(out, span);
+    return;
+  }
+
+  size_t mid = (l + r) / 2;
+  coverGaps(tree, 2 * node, l, mid, lo, hi, out);
+  coverGaps(tree, 2 * node + 1, mid, r, lo, hi, out);
+}
+
+static int compareInt32(const void *pa, const void *pb) {
+  int32_t a = *(const int32_t *)pa, b = *(const int32_t *)pb;
+  return (a > b) - (a < b);
+}
+
+static int compareEdges(const void *pa, const void *pb) {
+  const SweepEdge *a = pa, *b = pb;
+  return (a->at > b->at) - (a->at < b->at);
+}
+
+static int compareSpans(const void *pa, const void *pb) {
+  const Span *a = pa, *b = pb;
+  return (a->lo > b->lo) - (a->lo < b->lo);
+}
+
+// Sorts and joins touching spans so each straight wall comes out whole
+static void mergeSpans(SpanArray *spans) {
+  if (spans->count == 0) return;
+  qsort(spans->items, spans->count, sizeof(Span), compareSpans);
+
+  size_t kept = 0;
+  for (size_t i = 1; i < spans->count; i++) {
+    if (spans->items[i].lo <= spans->items[kept].hi) {
+      spans->items[kept].hi = MAX(spans->items[kept].hi, spans->items[i].hi);
+    } else {
+      spans->items[++kept] = spans->items[i];
+    }
+  }
+  spans->count = kept + 1;
+}
+
+// `floorAfter` is true when the floor lies past the sweep coordinate
+static void emitWalls(Walls *walls, const SpanArray *spans, bool horizontal, int32_t at, bool floorAfter) {
+  da_foreach(Span, span, spans) {
+    WallSegment wall;
+    if (!horizontal) {
+      wall = floorAfter ? (WallSegment){ at, span->lo, at, span->hi }
+                        : (WallSegment){ at, span->hi, at, span->lo };
+    } else {
+      wall = floorAfter ? (WallSegment){ span->hi, at, span->lo, at }
+                        : (WallSegment){ span->lo, at, span->hi, at };
+    }
+    da_append(&walls->segments, wall);
+  }
+}
+
+static int compareWallStarts(const void *pa, const void *pb) {
+  const WallSegment *a = pa, *b = pb;
+  if (a->x1 != b->x1) return (a->x1 > b->x1) - (a->x1 < b->x1);
+  return (a->y1 > b->y1) - (a->y1 < b->y1);
+}
+
+// Total order, so which continuation a corner takes doesn't depend on how
+// equal starts happen to come out of the sort
+static int compareWalls(const void *pa, const void *pb) {
+  const WallSegment *a = pa, *b = pb;
+  int start = compareWallStarts(a, b);
+  if (start != 0) return start;
+  if (a->x2 != b->x2) return (a->x2 > b->x2) - (a->x2 < b->x2);
+  return (a->y2 > b->y2) - (a->y2 < b->y2);
+}
+
+// First segment starting at (x, y) in the start-sorted array, or count
+static size_t findWallStart(const WallSegment *walls, size_t count, int32_t x, int32_t y) {
+  WallSegment key = { x, y, 0, 0 };
+  size_t lo = 0, hi = count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (compareWallStarts(&walls[mid], &key) < 0) lo = mid + 1; else hi = mid;
+  }
+  return lo;
+}
+
+// Rough steps for `count` rectangles, for progress reporting: per axis the
+// edge pass, both sorts, the dedupe and the sweep, then the segment sort and
+// the chaining. Room edges mostly line up, so the sweep's batches are taken
+// to be long and cost about one more pass each.
+static size_t wallTaskUnits(size_t count) {
+  size_t axis = 3 * (2 * count / WALL_CHUNK + 1) + sortUnits(2 * count) * 2
+    + 4 * (2 * count / WALL_SWEEP_EDGES);
+  return 2 * axis + sortUnits(4 * count) + 4 * count / WALL_CHUNK + 2;
+}
+
+void wallTaskBegin(WallTask *task, Walls *walls, const Rect *rects, size_t count) {
+  walls->segments.count = 0;
+  walls->loops.count = 0;
+  *task = (WallTask){
+    .walls = walls,
+    .rects = rects,
+    .count = count,
+    .stage = WALLS_EDGES,
+    .total = wallTaskUnits(count),
+  };
+}
+
+void wallTaskBeginMap(WallTask *task, Map *map) {
+  wallTaskBegin(task, &map->walls, NULL, 0);
+  task->map = map;
+  task->stage = WALLS_GATHER;
+  // Rooms plus about two halls each
+  task->total = map->cells.count + wallTaskUnits(3 * map->cells.count);
+}
+
+// Walls perpendicular to the sweep: vertical ones when sweeping along x,
+// horizontal ones once `horizontal` swaps the axes. The edges at one
+// coordinate form a batch. Entering edges are checked against the coverage
+// before it and leaving ones against the coverage after it, so rectangles
+// that abut there leave no wall between them. Each step runs one pass over
+// at most WALL_SWEEP_EDGES of the batch, or emits its walls.
+static void sweepBatch(WallTask *task) {
+  SweepEdgeArray *edges = &task->edges;
+  CoverTree *tree = &task->tree;
+  int32_t at = edges->items[task->pos].at;
+
+  if (task->pass == SWEEP_EMIT) {
+    mergeSpans(&task->opened);
+    mergeSpans(&task->closed);
+    emitWalls(task->walls, &task->opened, task->horizontal, at, true);
+    emitWalls(task->walls, &task->closed, task->horizontal, at, false);
+    task->opened.count = 0;
+    task->closed.count = 0;
+    task->pos = task->cursor = task->batchEnd;
+    task->pass = SWEEP_OPEN;
+    return;
+  }
+
+  // The first pass finds where the batch ends
+  size_t end = task->pass == SWEEP_OPEN ? edges->count : task->batchEnd;
+  end = MIN(end, task->cursor + WALL_SWEEP_EDGES);
+  for (; task->cursor < end; task->cursor++) {
+    SweepEdge *edge = &edges->items[task->cursor];
+    if (edge->at != at) break;
+
+    switch (task->pass) {
+    case SWEEP_OPEN:
+      if (edge->enter) coverGaps(tree, 1, 0, tree->last, edge->lo, edge->hi, &task->opened);
+      break;
+    case SWEEP_UPDATE:
+      coverUpdate(tree, 1, 0, tree->last, edge->lo, edge->hi, edge->enter ? 1 : -1);
+      break;
+    case SWEEP_CLOSE:
+      if (!edge->enter) coverGaps(tree, 1, 0, tree->last, edge->lo, edge->hi, &task->closed);
+      break;
+    case SWEEP_EMIT:
+      UNREACHABLE("sweepBatch");
+    }
+  }
+
+  if (task->pass == SWEEP_OPEN) {
+    if (task->cursor < edges->count && edges->items[task->cursor].at == at) return;
+    task->batchEnd = task->cursor;
+  } else if (task->cursor < task->batchEnd) {
+    return;
+  }
+  task->pass++;
+  task->cursor = task->pos;
+}
+
+// Every outline vertex has as many walls leaving as arriving, so following
+// unused segments end to start always closes a loop. Where two outlines
+// only touch at a corner either continuation is fine. Follows or skips at
+// most WALL_CHUNK segments; returns false once every loop is chained.
+static bool chainLoops(WallTask *task) {
+  Walls *walls = task->walls;
+  const WallSegment *sorted = walls->segments.items;
+  size_t count = walls->segments.count;
+
+  for (size_t moved = 0; moved < WALL_CHUNK; moved++) {
+    if (task->current == count) {
+      if (task->pos == count) return false;
+      if (task->used[task->pos]) {
+        task->pos++;
+        continue;
+      }
+      task->loop = (WallLoop){ (uint32_t)task->ordered.count, 0 };
+      task->current = task->pos;
+    }
+
+    size_t current = task->current;
+    task->used[current] = true;
+    da_append(&task->ordered, sorted[current]);
+    task->loop.count++;
+
+    size_t next = findWallStart(sorted, count, sorted[current].x2, sorted[current].y2);
+    while (next < count && sorted[next].x1 == sorted[current].x2
+           && sorted[next].y1 == sorted[current].y2 && task->used[next]) {
+      next++;
+    }
+    if (next < count && (sorted[next].x1 != sorted[current].x2 || sorted[next].y1 != sorted[current].y2)) {
+      next = count;
+    }
+    task->current = next;
+    if (next == count) da_append(&walls->loops, task->loop);
+  }
+  return true;
+}
+
+// Starts the sweep along the current axis over the task's rectangles
+static void beginAxis(WallTask *task) {
+  task->edges.count = 0;
+  task->coordCount = 0;
+  task->pos = 0;
+  task->stage = WALLS_EDGES;
+}
+
+// Moves on to the other axis, or to chaining once both are swept
+static void endAxis(WallTask *task) {
+  free(task->tree.cover);
+  free(task->tree.any);
+  task->tree = (CoverTree){0};
+
+  if (!task->horizontal) {
+    task->horizontal = true;
+    beginAxis(task);
+    return;
+  }
+  WallArray *segments = &task->walls->segments;
+  sortBegin(&task->sort, segments->items, segments->count, sizeof(WallSegment), compareWalls);
+  task->stage = WALLS_SORT_SEGMENTS;
+}
+
+bool wallTaskStep(WallTask *task) {
+  task->done++;
+
+  switch (task->stage) {
+  case WALLS_GATHER: {
+    if (task->map != NULL && task->pos < task->map->cells.count) {
+      Cell *cell = task->map->cells.items[task->pos++];
+      HallArray halls = cellHalls(task->map, cell);
+      da_append(&task->owned, ((Rect){ cell->x1, cell->y1, cell->x2, cell->y2 }));
+      da_foreach(Hall, hall, &halls) da_append(&task->owned, ((Rect){ hall->x1, hall->y1, hall->x2, hall->y2 }));
+      return true;
+    }
+    task->rects = task->owned.items;
+    task->count = task->owned.count;
+    task->total = task->done + wallTaskUnits(task->count);
+    beginAxis(task);
+    return true;
+  }
+  case WALLS_EDGES: {
+    if (task->pos == 0) {
+      da_reserve(&task->edges, 2 * task->count);
+      if (task->coords == NULL) {
+        task->coords = malloc(MAX(2 * task->count, (size_t)1) * sizeof(int32_t));
+        ASSERT(task->coords != NULL && "Buy more RAM lol");
+      }
+    }
+
+    size_t end = MIN(task->pos + WALL_CHUNK, task->count);
+    for (; task->pos < end; task->pos++) {
+      Rect r = task->rects[task->pos];
+      if (r.x2 <= r.x1 || r.y2 <= r.y1) continue;
+      if (task->horizontal) r = (Rect){ r.y1, r.x1, r.y2, r.x2 };
+
+      da_append(&task->edges, ((SweepEdge){ r.x1, r.y1, r.y2, true }));
+      da_append(&task->edges, ((SweepEdge){ r.x2, r.y1, r.y2, false }));
+      task->coords[task->coordCount++] = r.y1;
+      task->coords[task->coordCount++] = r.y2;
+    }
+    if (task->pos < task->count) return true;
+
+    if (task->coordCount == 0) {
+      endAxis(task);
+      return true;
+    }
+    sortBegin(&task->sort, task->coords, task->coordCount, sizeof(int32_t), compareInt32);
+    task->stage = WALLS_SORT_COORDS;
+    return true;
+  }
+  case WALLS_SORT_COORDS:
+    if (!sortStep(&task->sort)) {
+      sortEnd(&task->sort);
+      task->unique = 1;
+      task->pos = 1;
+      task->stage = WALLS_UNIQUE;
+    }
+    return true;
+  case WALLS_UNIQUE: {
+    int32_t *coords = task->coords;
+    size_t end = MIN(task->pos + WALL_CHUNK, task->coordCount);
+    for (; task->pos < end; task->pos++) {
+      if (coords[task->pos] != coords[task->unique - 1]) coords[task->unique++] = coords[task->pos];
+    }
+    if (task->pos < task->coordCount) return true;
+
+    sortBegin(&task->sort, task->edges.items, task->edges.count, sizeof(SweepEdge), compareEdges);
+    task->stage = WALLS_SORT_EDGES;
+    return true;
+  }
+  case WALLS_SORT_EDGES:
+    if (!sortStep(&task->sort)) {
+      sortEnd(&task->sort);
+      task->tree = (CoverTree){
+        .coords = task->coords,
+        .last = task->unique - 1,
+        .cover = calloc(4 * task->unique, sizeof(int32_t)),
+        .any = calloc(4 * task->unique, sizeof(bool)),
+      };
+      ASSERT(task->tree.cover != NULL && task->tree.any != NULL && "Buy more RAM lol");
+      task->pos = 0;
+      task->cursor = 0;
+      task->pass = SWEEP_OPEN;
+      task->stage = WALLS_SWEEP;
+    }
+    return true;
+  case WALLS_SWEEP:
+    sweepBatch(task);
+    if (task->pos == task->edges.count) endAxis(task);
+    return true;
+  case WALLS_SORT_SEGMENTS: {
+    if (sortStep(&task->sort)) return true;
+    sortEnd(&task->sort);
+
+    size_t count = task->walls->segments.count;
+    da_reserve(&task->ordered, count);
+    task->used = calloc(MAX(count, (size_t)1), sizeof(bool));
+    ASSERT(task->used != NULL && "Buy more RAM lol");
+    task->current = count;
+    task->pos = 0;
+    task->stage = WALLS_CHAIN;
+    return true;
+  }
+  case WALLS_CHAIN:
+    if (chainLoops(task)) return true;
+    free(task->walls->segments.items);
+    task->walls->segments = task->ordered;
+    task->ordered = (WallArray){0};
+    task->stage = WALLS_DONE;
+    return false;
+  case WALLS_DONE:
+    return false;
+  }
+  UNREACHABLE("wallTaskStep");
+}
+
+void wallTaskEnd(WallTask *task) {
+  sortEnd(&task->sort);
+  free(task->owned.items);
+  free(task->edges.items);
+  free(task->coords);
+  free(task->tree.cover);
+  free(task->tree.any);
+  free(task->opened.items);
+  free(task->closed.items);
+  free(task->ordered.items);
+  free(task->used);
+  *task = (WallTask){0};
+}
+
+void extractWalls(Walls *walls, const Rect *rects, size_t count) {
+  WallTask task;
+  wallTaskBegin(&task, walls, rects, count);
+  while (wallTaskStep(&task));
+  wallTaskEnd(&task);
+}
+
+void extractMapWalls(Map *map) {
+  WallTask task;
+  wallTaskBeginMap(&task, map);
+  while (wallTaskStep(&task));
+  wallTaskEnd(&task);
+}
+
+void freeWalls(Walls *walls) {
+  free(walls->segments.items);
+  free(walls->loops.items);
+  *walls = (Walls){0};
+}
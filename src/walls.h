@@ -0,0 +1,133 @@
+#ifndef WALLS_H_
+#define WALLS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./mapgen.h"
+#include "./sort.h"
+
+// Outline of the union of `rects` by a sweep line over each axis: a segment
+// tree over the other axis counts coverage, and at each edge coordinate the
+// spans whose coverage changes between empty and covered become walls.
+// O((n + k) log n) for n rectangles and k wall pieces.
+void extractWalls(Walls *walls, const Rect *rects, size_t count);
+void extractMapWalls(Map *map);
+void freeWalls(Walls *walls);
+
+typedef struct {
+  int32_t at;
+  int32_t lo;
+  int32_t hi;
+  bool enter;
+} SweepEdge;
+
+typedef struct {
+  SweepEdge *items;
+  size_t count;
+  size_t capacity;
+} SweepEdgeArray;
+
+typedef struct {
+  int32_t lo;
+  int32_t hi;
+} Span;
+
+typedef struct {
+  Span *items;
+  size_t count;
+  size_t capacity;
+} SpanArray;
+
+typedef struct {
+  Rect *items;
+  size_t count;
+  size_t capacity;
+} RectArray;
+
+// Segment tree over the sorted cross-axis coordinates. Node 1 spans
+// coords[0]..coords[last]; `cover` counts edges covering a node's whole range
+// and `any` says whether anything in the subtree is covered.
+typedef struct {
+  int32_t *coords;
+  size_t last;
+  int32_t *cover;
+  bool *any;
+} CoverTree;
+
+typedef enum {
+  WALLS_GATHER,
+  WALLS_EDGES,
+  WALLS_SORT_COORDS,
+  WALLS_UNIQUE,
+  WALLS_SORT_EDGES,
+  WALLS_SWEEP,
+  WALLS_SORT_SEGMENTS,
+  WALLS_CHAIN,
+  WALLS_DONE,
+} WallStage;
+
+typedef enum {
+  SWEEP_OPEN,
+  SWEEP_UPDATE,
+  SWEEP_CLOSE,
+  SWEEP_EMIT,
+} SweepPass;
+
+// Rectangles, coordinates or segments handled per step
+#define WALL_CHUNK 4096
+// Edges of one sweep batch handled per step, which each cost a tree descent
+#define WALL_SWEEP_EDGES 64
+
+// Resumable extractWalls. Each step gathers one cell's rectangles, turns
+// WALL_CHUNK rectangles into edges, takes one SortTask step, sweeps up to
+// WALL_SWEEP_EDGES edges at one coordinate, or chains WALL_CHUNK segments,
+// so tracing can share frames with the rest of generation.
+struct WallTask {
+  Walls *walls;
+  const Rect *rects;
+  size_t count;
+  // Map to gather rooms and halls from, for wallTaskBeginMap
+  const Map *map;
+  RectArray owned;
+
+  WallStage stage;
+  // Sweeping y instead of x
+  bool horizontal;
+  size_t pos;
+  SortTask sort;
+  SweepEdgeArray edges;
+  int32_t *coords;
+  size_t coordCount;
+  size_t unique;
+  CoverTree tree;
+  // Sweep batch: edges pos..batchEnd share a coordinate, and `pass` is at
+  // `cursor`. batchEnd is only known after the first pass
+  SweepPass pass;
+  size_t cursor;
+  size_t batchEnd;
+  SpanArray opened;
+  SpanArray closed;
+
+  // Chaining: loop being followed, and the segment it is at (segment count
+  // between loops)
+  WallArray ordered;
+  bool *used;
+  WallLoop loop;
+  size_t current;
+
+  // Steps taken, and an estimate of how many it needs in all
+  size_t done;
+  size_t total;
+};
+
+// `rects` must outlive the task
+void wallTaskBegin(WallTask *task, Walls *walls, const Rect *rects, size_t count);
+// Traces the map's rooms and halls into map->walls
+void wallTaskBeginMap(WallTask *task, Map *map);
+// Runs one step; returns false once the walls are traced
+bool wallTaskStep(WallTask *task);
+void wallTaskEnd(WallTask *task);
+
+#endif // WALLS_H_
@@ -0,0 +1,204 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/utils.h"
+
+// Checks bvhOverlap, bvhAnyOverlap, bvhRaycast and bvhNearest against a
+// linear scan of the items on random maps, then times the build and each
+// query on a large map, with a linear scan for scale.
+//
+//   bvhbench [rooms=1000000] [queries=100000]
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Rect randomRect(Rng *rng, int32_t world, int32_t maxSide) {
+  int32_t x = RNGBETWEEN(rng, -maxSide, world), y = RNGBETWEEN(rng, -maxSide, world);
+  return (Rect){ x, y, x + RNGBETWEEN(rng, 1, maxSide), y + RNGBETWEEN(rng, 1, maxSide) };
+}
+
+static float randomCoord(Rng *rng, int32_t world) {
+  return (float)RNGBETWEEN(rng, -8 * 16, (world + 8) * 16) / 16;
+}
+
+typedef struct {
+  Rect rect;
+  const void *ignoreA, *ignoreB;
+  float ox, oy, dx, dy, maxDistance;
+} Query;
+
+static Query randomQuery(Rng *rng, const Bvh *bvh, int32_t world, int32_t maxSide) {
+  Query q = { .rect = randomRect(rng, world, maxSide) };
+  if (bvh->items.count > 0) {
+    q.ignoreA = bvh->items.items[rngNext(rng) % bvh->items.count].ptr;
+    q.ignoreB = bvh->items.items[rngNext(rng) % bvh->items.count].ptr;
+  }
+  q.ox = randomCoord(rng, world);
+  q.oy = randomCoord(rng, world);
+  // Axis-aligned rays now and then, which take raySlab's parallel case
+  q.dx = rngNext(rng) % 8 == 0 ? 0 : (float)RNGBETWEEN(rng, -64, 64) / 16;
+  q.dy = q.dx == 0 || rngNext(rng) % 8 == 0 ? (float)RNGBETWEEN(rng, -64, 64) / 16 : 0;
+  if (q.dx == 0 && q.dy == 0) q.dx = 1;
+  q.maxDistance = rngNext(rng) % 4 == 0 ? FLT_MAX : (float)RNGBETWEEN(rng, 1, world);
+  return q;
+}
+
+static size_t linearOverlap(const Bvh *bvh, Rect rect) {
+  size_t found = 0;
+  da_foreach(BvhItem, item, &bvh->items) found += overlaps(item->rect, rect);
+  return found;
+}
+
+static bool linearAnyOverlap(const Bvh *bvh, Rect rect, const void *ignoreA, const void *ignoreB) {
+  da_foreach(BvhItem, item, &bvh->items) {
+    if (item->ptr != ignoreA && item->ptr != ignoreB && overlaps(item->rect, rect)) return true;
+  }
+  return false;
+}
+
+static float linearRaycast(const Bvh *bvh, const Query *q) {
+  BvhRay ray = { q->ox, q->oy, q->dx, q->dy, q->dx != 0 ? 1 / q->dx : 0, q->dy != 0 ? 1 / q->dy : 0 };
+  float best = FLT_MAX;
+  da_foreach(BvhItem, item, &bvh->items) best = MIN(best, rayRect(item->rect, &ray, q->maxDistance));
+  return best;
+}
+
+static float linearNearest(const Bvh *bvh, float x, float y) {
+  float best = FLT_MAX;
+  da_foreach(BvhItem, item, &bvh->items) best = MIN(best, pointRectDistance(item->rect, x, y));
+  return best;
+}
+
+// Ties may pick different items, so hits are compared by distance
+static bool verifyQuery(const Bvh *bvh, const Query *q, BvhItem ***found, size_t *capacity, uint8_t *seen) {
+  size_t count;
+  while ((count = bvhOverlap(bvh, q->rect, *found, *capacity)) > *capacity) {
+    *capacity = 2 * count;
+    *found = realloc(*found, *capacity * sizeof(**found));
+    ASSERT(*found != NULL && "Buy more RAM lol");
+  }
+  bool ok = count == linearOverlap(bvh, q->rect);
+  for (size_t i = 0; i < count; i++) {
+    size_t index = (*found)[i] - bvh->items.items;
+    ok = ok && overlaps((*found)[i]->rect, q->rect) && !seen[index];
+    seen[index] = 1;
+  }
+  for (size_t i = 0; i < count; i++) seen[(*found)[i] - bvh->items.items] = 0;
+
+  ok = ok && bvhAnyOverlap(bvh, q->rect, q->ignoreA, q->ignoreB)
+    == linearAnyOverlap(bvh, q->rect, q->ignoreA, q->ignoreB);
+
+  BvhHit hit;
+  float expected = linearRaycast(bvh, q);
+  bool hitAny = bvhRaycast(bvh, q->ox, q->oy, q->dx, q->dy, q->maxDistance, &hit);
+  ok = ok && hitAny == (expected != FLT_MAX) && (!hitAny || hit.distance == expected);
+
+  expected = linearNearest(bvh, q->ox, q->oy);
+  hitAny = bvhNearest(bvh, q->ox, q->oy, &hit);
+  ok = ok && hitAny == (bvh->items.count > 0) && (!hitAny || hit.distance == expected);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  uint32_t rooms = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  size_t queries = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000;
+
+  // Small maps, routed and straight halls, including one room on its own
+  Rng rng = { 1 };
+  BvhItem **found = NULL;
+  size_t capacity = 0, checked = 0, mismatches = 0;
+  for (uint64_t seed = 1; seed <= 40; seed++) {
+    MapConfig config = MAP_CONFIG_DEFAULT;
+    config.width = config.height = RNGBETWEEN(&rng, 24, 600);
+    config.numRooms = seed == 1 ? 1 : RNGBETWEEN(&rng, 2, 400);
+    config.routeHalls = seed % 2 == 0;
+
+    Map map = initMap(&config, seed);
+    mapRequire(&map, STAGE_HALLS);
+    Bvh bvh;
+    buildBvh(&bvh, &map);
+    uint8_t *seen = calloc(MAX(bvh.items.count, (size_t)1), 1);
+    ASSERT(seen != NULL && "Buy more RAM lol");
+
+    for (size_t i = 0; i < 500; i++) {
+      Query q = randomQuery(&rng, &bvh, config.width, 32);
+      mismatches += !verifyQuery(&bvh, &q, &found, &capacity, seen);
+      checked++;
+    }
+
+    free(seen);
+    freeBvh(&bvh);
+    freeMap(&map);
+  }
+  printf("linear scan: %zu queries, %zu mismatches\n", checked, mismatches);
+
+  MapConfig config = MAP_CONFIG_DEFAULT;
+  config.width = config.height = (int32_t)sqrt((double)rooms * 400) + 2 * config.margin;
+  config.numRooms = rooms;
+
+  Map map = initMap(&config, 1);
+  mapRequire(&map, STAGE_HALLS);
+  Bvh bvh;
+  double start = now();
+  buildBvh(&bvh, &map);
+  double build = now() - start;
+  printf("map: %zu rooms, %zu items, %zu nodes, built in %.1f ms\n", map.cells.count,
+         bvh.items.count, bvh.nodes.count, build * 1000);
+
+  Query *batch = malloc(MAX(queries, (size_t)1) * sizeof(Query));
+  ASSERT(batch != NULL && "Buy more RAM lol");
+  for (size_t i = 0; i < queries; i++) batch[i] = randomQuery(&rng, &bvh, config.width, 32);
+
+  // Sums of the results keep the queries from being optimized away
+  size_t sum = 0;
+  double times[4];
+  start = now();
+  for (size_t i = 0; i < queries; i++) sum += bvhOverlap(&bvh, batch[i].rect, found, capacity);
+  times[0] = now() - start;
+  start = now();
+  for (size_t i = 0; i < queries; i++) {
+    sum += bvhAnyOverlap(&bvh, batch[i].rect, batch[i].ignoreA, batch[i].ignoreB);
+  }
+  times[1] = now() - start;
+  BvhHit hit;
+  start = now();
+  for (size_t i = 0; i < queries; i++) {
+    Query *q = &batch[i];
+    sum += bvhRaycast(&bvh, q->ox, q->oy, q->dx, q->dy, q->maxDistance, &hit);
+  }
+  times[2] = now() - start;
+  start = now();
+  for (size_t i = 0; i < queries; i++) sum += bvhNearest(&bvh, batch[i].ox, batch[i].oy, &hit);
+  times[3] = now() - start;
+
+  // A few linear scans over the same items, for scale
+  size_t linearQueries = MIN(queries, (size_t)20);
+  start = now();
+  for (size_t i = 0; i < linearQueries; i++) sum += linearNearest(&bvh, batch[i].ox, batch[i].oy) != FLT_MAX;
+  double linear = (now() - start) / MAX(linearQueries, (size_t)1);
+
+  const char *names[4] = { "overlap", "any overlap", "raycast", "nearest" };
+  for (size_t k = 0; k < 4; k++) {
+    printf("  %-14s %8.2f us/query\n", names[k], times[k] / MAX(queries, (size_t)1) * 1e6);
+  }
+  printf("  %-14s %8.2f us/query (checksum %zu)\n", "linear nearest", linear * 1e6, sum);
+
+  free(batch);
+  free(found);
+  freeBvh(&bvh);
+  freeMap(&map);
+
+  if (mismatches > 0) {
+    fprintf(stderr, "ERROR: BVH queries differ from a linear scan\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,229 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/raster.c"
+#include "../src/query.c"
+#include "../src/caves.c"
+#include "../src/utils.h"
+
+// Checks the bit-sliced cave step against a plain 3x3 count on random rooms,
+// and carveCaves against a scalar carve of the same seeds, then times both
+// on a map rasterized with caves at each thread count up to the one given,
+// checking every result against the single-thread one.
+//
+//   cavebench [world=4096] [threads=8] [rounds=3]
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// One tile per byte, 1 for wall; everything outside the room is wall.
+static void scalarStep(const uint8_t *cur, uint8_t *next, int w, int h, uint32_t threshold) {
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      uint32_t walls = 0;
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+          int nx = x + dx, ny = y + dy;
+          walls += nx < 0 || ny < 0 || nx >= w || ny >= h || cur[ny * w + nx];
+        }
+      }
+      next[y * w + x] = walls >= threshold;
+    }
+  }
+}
+
+static uint8_t wordBit(const uint64_t *words, size_t stride, int x, int y) {
+  return words[(size_t)y * stride + x / 64] >> (x % 64) & 1;
+}
+
+// caveStep on random rooms of every width class, including partial words
+static bool verifyStep(Rng *rng, size_t *checked) {
+  bool ok = true;
+  for (int i = 0; i < 2000; i++) {
+    int w = RNGBETWEEN(rng, 1, 200), h = RNGBETWEEN(rng, 1, 40);
+    uint32_t threshold = RNGBETWEEN(rng, 0, 10);
+    size_t stride = (w + 63) / 64, words = stride * h;
+    uint64_t tail = w % 64 ? ~0ull << (w % 64) : 0;
+
+    uint64_t *scratch = malloc(4 * words * sizeof(uint64_t));
+    uint8_t *cur = malloc((size_t)w * h), *next = malloc((size_t)w * h);
+    ASSERT(scratch != NULL && cur != NULL && next != NULL && "Buy more RAM lol");
+
+    for (size_t k = 0; k < words; k++) scratch[k] = rngNext(rng);
+    for (int y = 0; y < h; y++) scratch[(size_t)y * stride + stride - 1] |= tail;
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++) cur[y * w + x] = wordBit(scratch, stride, x, y);
+    }
+
+    caveStep(scratch, scratch + words, scratch + 2 * words, scratch + 3 * words, stride, h, threshold);
+    scalarStep(cur, next, w, h, threshold);
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++) ok = ok && wordBit(scratch + words, stride, x, y) == next[y * w + x];
+    }
+    *checked += (size_t)w * h;
+
+    free(scratch);
+    free(cur);
+    free(next);
+  }
+  return ok;
+}
+
+// carveRoom with scalarStep: the same seed and pins, one tile at a time
+static void scalarCarve(Map *map, Grid *grid, const CaveConfig *config) {
+  CaveWords words = {0};
+  CaveHalls halls = {0};
+  uint8_t *cur = NULL, *next = NULL, *pins = NULL;
+
+  for (size_t i = 0; i < map->cells.count; i++) {
+    Cell *cell = map->cells.items[i];
+    Rect room = {
+      MAX(cell->x1, 0), MAX(cell->y1, 0), MIN(cell->x2, grid->width), MIN(cell->y2, grid->height),
+    };
+    int w = room.x2 - room.x1, h = room.y2 - room.y1;
+    if (w <= 0 || h <= 0) continue;
+
+    size_t stride = (w + 63) / 64;
+    da_reserve(&words, 2 * stride * h);
+    uint64_t *seeded = words.items, *pinned = seeded + stride * h;
+    Rng rng = { map->seed ^ (0xD1B54A32D192ED03ull * (i + 1)) };
+    caveSeed(seeded, stride * h, config->fill, &rng);
+    memset(pinned, 0, stride * h * sizeof(uint64_t));
+    cavePins(map, room, pinned, stride, &halls);
+
+    cur = realloc(cur, (size_t)w * h);
+    next = realloc(next, (size_t)w * h);
+    pins = realloc(pins, (size_t)w * h);
+    ASSERT(cur != NULL && next != NULL && pins != NULL && "Buy more RAM lol");
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++) {
+        pins[y * w + x] = wordBit(pinned, stride, x, y);
+        cur[y * w + x] = wordBit(seeded, stride, x, y) && !pins[y * w + x];
+      }
+    }
+
+    for (int k = 0; k < config->iterations; k++) {
+      scalarStep(cur, next, w, h, config->threshold);
+      for (int t = 0; t < w * h; t++) next[t] &= !pins[t];
+      uint8_t *swap = cur;
+      cur = next;
+      next = swap;
+    }
+
+    for (int y = 0; y < h; y++) {
+      uint8_t *tiles = &GRID_AT(grid, room.x1, room.y1 + y);
+      for (int x = 0; x < w; x++) {
+        if (cur[y * w + x] && tiles[x] == TILE_ROOM) tiles[x] = TILE_WALL;
+      }
+    }
+  }
+
+  free(words.items);
+  free(halls.items);
+  free(cur);
+  free(next);
+  free(pins);
+}
+
+static Grid copyGrid(const Grid *grid) {
+  Grid copy = makeGrid(grid->width, grid->height);
+  memcpy(copy.tiles, grid->tiles, (size_t)grid->width * grid->height);
+  return copy;
+}
+
+static bool sameGrid(const Grid *a, const Grid *b) {
+  return a->width == b->width && a->height == b->height
+    && memcmp(a->tiles, b->tiles, (size_t)a->width * a->height) == 0;
+}
+
+int main(int argc, char **argv) {
+  int32_t world = argc > 1 ? atoi(argv[1]) : 4096;
+  size_t threads = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+  int rounds = argc > 3 ? atoi(argv[3]) : 3;
+
+  Rng rng = { 1 };
+  size_t checked = 0;
+  bool stepOk = verifyStep(&rng, &checked);
+  printf("step: %zu tiles %s\n", checked, stepOk ? "match" : "MISMATCH");
+
+  // Whole small maps, with and without routed halls, and a few rules
+  bool carveOk = true;
+  checked = 0;
+  for (uint64_t seed = 1; seed <= 24; seed++) {
+    MapConfig config = MAP_CONFIG_DEFAULT;
+    config.width = RNGBETWEEN(&rng, 24, 400);
+    config.height = RNGBETWEEN(&rng, 24, 400);
+    config.numRooms = RNGBETWEEN(&rng, 2, 40);
+    config.routeHalls = seed % 2 == 0;
+    CaveConfig caves = { RNGBETWEEN(&rng, 30, 60), RNGBETWEEN(&rng, 0, 8), RNGBETWEEN(&rng, 4, 6) };
+
+    Map map = initMap(&config, seed);
+    generateMap(&map);
+    Grid grid, expected;
+    rasterizeMap(&map, &grid);
+    expected = copyGrid(&grid);
+    carveCaves(&map, &grid, &caves, 1 + seed % 4);
+    scalarCarve(&map, &expected, &caves);
+
+    carveOk = sameGrid(&grid, &expected) && carveOk;
+    checked += (size_t)grid.width * grid.height;
+    freeGrid(&grid);
+    freeGrid(&expected);
+    freeMap(&map);
+  }
+  printf("carve: %zu tiles %s\n", checked, carveOk ? "match" : "MISMATCH");
+
+  MapConfig config = MAP_CONFIG_DEFAULT;
+  config.width = config.height = world;
+  config.numRooms = 255;
+  config.caves = true;
+
+  Map map = initMap(&config, 1);
+  generateMap(&map);
+  Grid plain, expected;
+  rasterizeMap(&map, &plain);
+  rasterizeLevel(&map, &expected, 1);
+
+  size_t tiles = (size_t)plain.width * plain.height;
+  Grid scalar = copyGrid(&plain);
+  double start = now();
+  scalarCarve(&map, &scalar, &CAVE_CONFIG_DEFAULT);
+  double scalarTime = now() - start;
+  bool ok = sameGrid(&scalar, &expected);
+  freeGrid(&scalar);
+
+  size_t walls = 0;
+  for (size_t i = 0; i < tiles; i++) walls += expected.tiles[i] == TILE_WALL;
+  printf("map: %dx%d, %zu rooms, %.1f%% wall after carving\n", plain.width, plain.height,
+         map.cells.count, 100.0 * walls / tiles);
+  printf("  scalar:     %8.2f ms, %6.0f Mtiles/s\n", scalarTime * 1000, tiles / scalarTime / 1e6);
+
+  for (size_t t = 1; t <= threads; t *= 2) {
+    double best = 1e9;
+    for (int r = 0; r < rounds; r++) {
+      Grid grid = copyGrid(&plain);
+      start = now();
+      carveCaves(&map, &grid, &CAVE_CONFIG_DEFAULT, t);
+      best = MIN(best, now() - start);
+      if (!sameGrid(&grid, &expected)) ok = false;
+      freeGrid(&grid);
+    }
+    printf("  %2zu threads: %8.2f ms, %6.0f Mtiles/s\n", t, best * 1000, tiles / best / 1e6);
+  }
+
+  freeGrid(&plain);
+  freeGrid(&expected);
+  freeMap(&map);
+
+  if (!stepOk) fprintf(stderr, "ERROR: bit-sliced step differs from the scalar step\n");
+  if (!carveOk) fprintf(stderr, "ERROR: carveCaves differs from the scalar carve\n");
+  if (!ok) fprintf(stderr, "ERROR: caves differ between thread counts or from the scalar carve\n");
+  return stepOk && carveOk && ok ? 0 : 1;
+}
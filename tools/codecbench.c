@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/raster.c"
+#include "../src/codec.c"
+#include "../src/utils.h"
+
+// Reports compression ratio and single-core encode/decode throughput of the
+// map codec on generated maps.
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  size_t maps = argc > 1 ? strtoul(argv[1], NULL, 10) : 16;
+  int32_t world = argc > 2 ? atoi(argv[2]) : 2048;
+  uint32_t rooms = argc > 3 ? strtoul(argv[3], NULL, 10) : 255;
+  int rounds = 20;
+
+  size_t rawTiles = 0, packedTiles = 0, rawRects = 0, packedRects = 0;
+  double encodeTime = 0, decodeTime = 0;
+
+  for (size_t i = 0; i < maps; i++) {
+    MapConfig config = MAP_CONFIG_DEFAULT;
+    config.width = config.height = world;
+    config.numRooms = rooms;
+
+    Map map = initMap(&config, i + 1);
+    generateMap(&map);
+
+    Grid grid;
+    rasterizeMap(&map, &grid);
+
+    String_Builder encoded = {0};
+    double start = now();
+    for (int r = 0; r < rounds; r++) {
+      encoded.count = 0;
+      encodeGrid(&grid, &encoded);
+    }
+    encodeTime += now() - start;
+
+    Grid decoded = makeGrid(grid.width, grid.height);
+    start = now();
+    for (int r = 0; r < rounds; r++) {
+      if (!decodeGridInto(encoded.items, encoded.count, &decoded)) {
+        fprintf(stderr, "ERROR: seed %zu failed to decode\n", i + 1);
+        return 1;
+      }
+    }
+    decodeTime += now() - start;
+
+    if (memcmp(grid.tiles, decoded.tiles, (size_t)grid.width * grid.height) != 0) {
+      fprintf(stderr, "ERROR: seed %zu did not round-trip\n", i + 1);
+      return 1;
+    }
+
+    rawTiles += (size_t)grid.width * grid.height;
+    packedTiles += encoded.count;
+
+    encoded.count = 0;
+    encodeMapRects(&map, &encoded);
+    packedRects += encoded.count;
+    for (size_t c = 0; c < map.cells.count; c++) {
+      rawRects += (1 + cellHalls(&map, map.cells.items[c]).count) * sizeof(Hall);
+    }
+
+    free(encoded.items);
+    freeGrid(&decoded);
+    freeGrid(&grid);
+    freeMap(&map);
+  }
+
+  double decoded = (double)rawTiles * rounds;
+  printf("tiles: %zu -> %zu bytes (%.1fx), encode %.2f GB/s, decode %.2f GB/s\n",
+         rawTiles, packedTiles, (double)rawTiles / packedTiles,
+         decoded / encodeTime / 1e9, decoded / decodeTime / 1e9);
+  printf("rects: %zu -> %zu bytes (%.1fx)\n",
+         rawRects, packedRects, (double)rawRects / packedRects);
+  return 0;
+}
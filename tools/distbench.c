@@ -0,0 +1,175 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/raster.c"
+#include "../src/distance.c"
+#include "../src/utils.h"
+
+// Checks distanceTransform and distancePeak against brute force on small
+// grids, then times the transform on a rasterized map and a random grid at
+// each thread count up to the one given, checking every result against the
+// single-thread one.
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Squared distance to the nearest wall tile, trying every one of them and
+// the ring of walls just outside the grid.
+static int64_t nearestWall(const Grid *grid, int x, int y) {
+  int64_t edge = MIN(MIN(x + 1, grid->width - x), MIN(y + 1, grid->height - y));
+  int64_t best = edge * edge;
+  for (int wy = 0; wy < grid->height; wy++) {
+    for (int wx = 0; wx < grid->width; wx++) {
+      if (GRID_AT(grid, wx, wy) != TILE_WALL) continue;
+      int64_t dx = wx - x, dy = wy - y;
+      best = MIN(best, dx * dx + dy * dy);
+    }
+  }
+  return best;
+}
+
+static uint16_t fixedDistance(int64_t squared) {
+  double scaled = sqrt((double)squared) * DIST_ONE + 0.5;
+  return scaled >= UINT16_MAX ? UINT16_MAX : (uint16_t)scaled;
+}
+
+// Every tile against brute force, and distancePeak over random regions
+// against the largest brute force distance inside them.
+static bool verify(const Grid *grid, Rng *rng, size_t threads) {
+  DistanceField field = makeDistanceField(grid->width, grid->height);
+  distanceTransform(grid, &field, threads);
+
+  uint16_t *expected = malloc((size_t)grid->width * grid->height * sizeof(uint16_t));
+  ASSERT(expected != NULL && "Buy more RAM lol");
+  bool ok = true;
+  for (int y = 0; y < grid->height; y++) {
+    for (int x = 0; x < grid->width; x++) {
+      uint16_t want = GRID_AT(grid, x, y) == TILE_WALL ? 0 : fixedDistance(nearestWall(grid, x, y));
+      expected[(size_t)y * grid->width + x] = want;
+      ok = ok && DIST_AT(&field, x, y) == want;
+    }
+  }
+
+  for (int i = 0; i < 200; i++) {
+    // Regions may hang off the grid, which distancePeak clips
+    int x1 = RNGBETWEEN(rng, -4, grid->width), y1 = RNGBETWEEN(rng, -4, grid->height);
+    Rect region = { x1, y1, x1 + RNGBETWEEN(rng, 1, 24), y1 + RNGBETWEEN(rng, 1, 24) };
+
+    uint16_t best = 0;
+    for (int y = MAX(region.y1, 0); y < MIN(region.y2, grid->height); y++) {
+      for (int x = MAX(region.x1, 0); x < MIN(region.x2, grid->width); x++) {
+        best = MAX(best, expected[(size_t)y * grid->width + x]);
+      }
+    }
+
+    int px = -1, py = -1;
+    bool found = distancePeak(&field, region, &px, &py);
+    if (found != (best > 0)) ok = false;
+    if (found && (px < region.x1 || px >= region.x2 || py < region.y1 || py >= region.y2
+                  || expected[(size_t)py * grid->width + px] != best)) {
+      ok = false;
+    }
+  }
+
+  free(expected);
+  freeDistanceField(&field);
+  return ok;
+}
+
+static bool bench(const char *name, const Grid *grid, size_t maxThreads, int rounds) {
+  size_t tiles = (size_t)grid->width * grid->height;
+  DistanceField expected = makeDistanceField(grid->width, grid->height);
+  DistanceField field = makeDistanceField(grid->width, grid->height);
+
+  distanceTransform(grid, &expected, 1);
+  int px = 0, py = 0;
+  double start = now();
+  distancePeak(&expected, (Rect){ 0, 0, grid->width, grid->height }, &px, &py);
+  double peak = now() - start;
+  printf("%s: %dx%d, peak %.2f at %d,%d found in %.2f ms\n", name, grid->width, grid->height,
+         distanceAt(&expected, px, py), px, py, peak * 1000);
+
+  bool ok = true;
+  for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+    double best = 1e9;
+    for (int r = 0; r < rounds; r++) {
+      start = now();
+      distanceTransform(grid, &field, threads);
+      best = MIN(best, now() - start);
+      if (memcmp(field.dist, expected.dist, tiles * sizeof(uint16_t)) != 0) ok = false;
+    }
+    printf("  %2zu threads: %8.2f ms, %6.0f Mtiles/s\n", threads, best * 1000, tiles / best / 1e6);
+  }
+
+  freeDistanceField(&expected);
+  freeDistanceField(&field);
+  return ok;
+}
+
+static void fillNoise(Grid *grid, Rng *rng, uint32_t wallShare) {
+  for (size_t i = 0; i < (size_t)grid->width * grid->height; i++) {
+    grid->tiles[i] = rngNext(rng) % 100 < wallShare ? TILE_WALL : TILE_ROOM;
+  }
+}
+
+int main(int argc, char **argv) {
+  int32_t world = argc > 1 ? atoi(argv[1]) : 8192;
+  size_t threads = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+  int rounds = argc > 3 ? atoi(argv[3]) : 5;
+
+  // Small maps, sparse and dense noise, and open floor with no walls at all
+  // but the grid's edge, each with a few thread counts
+  Rng rng = { 1 };
+  bool verified = true;
+  size_t checked = 0;
+  for (uint64_t seed = 1; seed <= 24; seed++) {
+    Grid grid;
+    if (seed % 3 == 0) {
+      MapConfig config = MAP_CONFIG_DEFAULT;
+      config.width = RNGBETWEEN(&rng, 24, 96);
+      config.height = RNGBETWEEN(&rng, 24, 96);
+      config.numRooms = RNGBETWEEN(&rng, 2, 24);
+      Map map = initMap(&config, seed);
+      generateMap(&map);
+      rasterizeMap(&map, &grid);
+      freeMap(&map);
+    } else {
+      grid = makeGrid(RNGBETWEEN(&rng, 1, 80), RNGBETWEEN(&rng, 1, 80));
+      fillNoise(&grid, &rng, seed % 3 == 1 ? 2 * seed : 0);
+    }
+    verified = verify(&grid, &rng, 1 + seed % 4) && verified;
+    checked += (size_t)grid.width * grid.height;
+    freeGrid(&grid);
+  }
+  printf("brute force: %zu tiles %s\n", checked, verified ? "match" : "MISMATCH");
+
+  MapConfig config = MAP_CONFIG_DEFAULT;
+  config.width = config.height = world;
+  config.numRooms = 255;
+
+  Map map = initMap(&config, 1);
+  generateMap(&map);
+  Grid grid;
+  rasterizeMap(&map, &grid);
+  freeMap(&map);
+
+  bool ok = bench("map", &grid, threads, rounds);
+  freeGrid(&grid);
+
+  grid = makeGrid(world, world);
+  fillNoise(&grid, &rng, 10);
+  ok = bench("noise", &grid, threads, rounds) && ok;
+  freeGrid(&grid);
+
+  if (!verified) fprintf(stderr, "ERROR: distances differ from brute force\n");
+  if (!ok) fprintf(stderr, "ERROR: distances differ between thread counts\n");
+  return verified && ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/mapgen_fixed.h"
+#include "../src/utils.h"
+
+// Generates maps with a few DEFINE_FIXED_MAPGEN instantiations and with
+// initMap + generateMap (routeHalls off) over a range of seeds, checks that
+// the rooms, neighbours and halls match, and times both generators.
+//
+//   fixedbench [seeds=1000]
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool sameRect(const FixedCell *a, const Cell *b) {
+  return a->x1 == b->x1 && a->y1 == b->y1 && a->x2 == b->x2 && a->y2 == b->y2;
+}
+
+static bool sameHall(const Hall *a, const Hall *b) {
+  return a->x1 == b->x1 && a->y1 == b->y1 && a->x2 == b->x2 && a->y2 == b->y2;
+}
+
+// Room by room: the shrunk rect, then the out edges and halls, which both
+// generators list right neighbours first.
+static bool compareMaps(const Map *map, const FixedMapView *fixed) {
+  if (map->cells.count != *fixed->leafCount) return false;
+
+  uint32_t edge = 0;
+  for (uint32_t i = 0; i < *fixed->leafCount; i++) {
+    const Cell *cell = map->cells.items[i];
+    if (!sameRect(&fixed->nodes[fixed->leaves[i]], cell)) return false;
+
+    RoomEdgeArray edges = cellEdges(map, cell);
+    da_foreach(RoomEdge, e, &edges) {
+      if (edge >= *fixed->neighbourCount) return false;
+      FixedNeighbour *n = &fixed->neighbours[edge++];
+      if (n->from != e->from || n->to != e->to || n->vertical != e->vertical) return false;
+    }
+
+    HallArray halls = cellHalls(map, cell);
+    uint32_t first = fixed->hallOffsets[i];
+    if (halls.count != fixed->hallOffsets[i + 1] - first) return false;
+    for (size_t h = 0; h < halls.count; h++) {
+      if (!sameHall(&halls.items[h], &fixed->halls[first + h])) return false;
+    }
+  }
+  return edge == *fixed->neighbourCount;
+}
+
+// Instantiates a fixed generator along with a check that runs it and the
+// dynamic one with the same settings over seeds 1..seeds.
+#define FIXED_CASE(Name, WIDTH, HEIGHT, MARGIN, ROOMS, MINCELLSIZE, CELLSHIFT)  \
+  DEFINE_FIXED_MAPGEN(Name, WIDTH, HEIGHT, MARGIN, ROOMS, MINCELLSIZE,         \
+                      CELLSHIFT)                                               \
+                                                                               \
+  static Name Name##_map;                                                      \
+                                                                               \
+  static bool Name##_check(size_t seeds) {                                     \
+    MapConfig config = MAP_CONFIG_DEFAULT;                                     \
+    config.width = (WIDTH);                                                    \
+    config.height = (HEIGHT);                                                  \
+    config.margin = (MARGIN);                                                  \
+    config.numRooms = (ROOMS);                                                 \
+    config.minCellSize = (MINCELLSIZE);                                        \
+    config.routeHalls = false;                                                 \
+                                                                               \
+    Name *fixed = &Name##_map;                                                 \
+    FixedMapView view = {                                                      \
+      fixed->nodes, &fixed->nodeCount, fixed->leaves, &fixed->leafCount,       \
+      fixed->neighbours, &fixed->neighbourCount, fixed->halls,                 \
+      fixed->hallOffsets, fixed->stack, &fixed->rng,                           \
+    };                                                                         \
+    size_t mismatches = 0;                                                     \
+    double fixedTime = 0, dynamicTime = 0;                                     \
+    for (uint64_t seed = 1; seed <= seeds; seed++) {                           \
+      double start = now();                                                    \
+      Name##_generate(fixed, seed);                                            \
+      fixedTime += now() - start;                                              \
+                                                                               \
+      start = now();                                                           \
+      Map map = initMap(&config, seed);                                        \
+      generateMap(&map);                                                       \
+      dynamicTime += now() - start;                                            \
+                                                                               \
+      if (!compareMaps(&map, &view)) {                                         \
+        if (mismatches == 0) {                                                 \
+          fprintf(stderr, "ERROR: " #Name " seed %llu differs from generateMap\n", \
+                  (unsigned long long)seed);                                   \
+        }                                                                      \
+        mismatches++;                                                          \
+      }                                                                        \
+      freeMap(&map);                                                           \
+    }                                                                          \
+                                                                               \
+    printf("%-9s %4dx%-4d %3d rooms: %zu seeds, %zu differ, "                  \
+           "fixed %8.2f us, generateMap %8.2f us\n", #Name, (WIDTH), (HEIGHT), \
+           (ROOMS), seeds, mismatches, fixedTime / seeds * 1e6,                \
+           dynamicTime / seeds * 1e6);                                         \
+    return mismatches == 0;                                                    \
+  }
+
+FIXED_CASE(SmallMap, 80, 60, 3, 10, 1, 3)
+FIXED_CASE(MediumMap, 512, 384, 3, 64, 2, 2)
+FIXED_CASE(LargeMap, 2048, 2048, 4, 255, 3, 0)
+
+int main(int argc, char **argv) {
+  size_t seeds = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+
+  bool ok = SmallMap_check(seeds);
+  ok = MediumMap_check(seeds) && ok;
+  ok = LargeMap_check(seeds) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/raster.c"
+#include "../src/flowfield.c"
+#include "../src/utils.h"
+
+// Simulates monsters chasing a wandering player through one shared flow
+// field: each tick the player takes a step, the field is repaired
+// incrementally and every agent takes one O(1) step. A horizon bounds how
+// far the field reaches; 0 leaves it unbounded.
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t randomFloor(const FlowField *field, Rng *rng) {
+  for (;;) {
+    int x = rngNext(rng) % field->width;
+    int y = rngNext(rng) % field->height;
+    uint32_t index = FLOW_INDEX(field, x, y);
+    if (field->cost[index] != 0) return index;
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t agents = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000;
+  size_t ticks = argc > 2 ? strtoul(argv[2], NULL, 10) : 600;
+  int32_t world = argc > 3 ? atoi(argv[3]) : 2048;
+  uint32_t rooms = argc > 4 ? strtoul(argv[4], NULL, 10) : 255;
+  uint16_t horizon = argc > 5 ? atoi(argv[5]) : 0;
+
+  MapConfig config = MAP_CONFIG_DEFAULT;
+  config.width = config.height = world;
+  config.numRooms = rooms;
+
+  Map map = initMap(&config, 1);
+  generateMap(&map);
+  Grid grid;
+  rasterizeMap(&map, &grid);
+  freeMap(&map);
+
+  FlowField field = makeFlowField(&grid);
+  if (horizon > 0) field.horizon = horizon;
+  Rng rng = { 42 };
+  uint32_t player = randomFloor(&field, &rng);
+
+  uint32_t *positions = malloc(agents * sizeof(uint32_t));
+  ASSERT(positions != NULL);
+  for (size_t i = 0; i < agents; i++) positions[i] = randomFloor(&field, &rng);
+
+  double start = now();
+  flowFieldCompute(&field, &player, 1);
+  double fullTime = now() - start;
+
+  double updateTime = 0, stepTime = 0;
+  size_t caught = 0, chasing = 0;
+
+  for (size_t tick = 0; tick < ticks; tick++) {
+    uint32_t moves[4] = { player - 1, player + 1, player - field.stride, player + field.stride };
+    uint32_t next = moves[rngNext(&rng) % 4];
+    if (field.cost[next] == 0) next = player;
+
+    start = now();
+    flowFieldMoveSource(&field, player, next);
+    updateTime += now() - start;
+    player = next;
+
+    start = now();
+    for (size_t i = 0; i < agents; i++) {
+      positions[i] = flowFieldNext(&field, positions[i]);
+    }
+    stepTime += now() - start;
+  }
+
+  for (size_t i = 0; i < agents; i++) {
+    caught += positions[i] == player;
+    chasing += field.dist[positions[i]] != FLOW_UNREACHED;
+  }
+
+  // The repaired field has to match one computed from scratch
+  FlowField check = makeFlowField(&grid);
+  check.horizon = field.horizon;
+  flowFieldCompute(&check, &player, 1);
+  size_t size = (size_t)field.stride * (field.height + 2);
+  bool matches = memcmp(field.dist, check.dist, size * sizeof(uint16_t)) == 0;
+
+  printf("grid:        %dx%d, %zu agents, %zu ticks\n", grid.width, grid.height, agents, ticks);
+  printf("full build:  %.3f ms\n", fullTime * 1000);
+  printf("update:      %.3f ms/tick\n", updateTime / ticks * 1000);
+  printf("rebuilds:    %zu of %zu moves\n", field.rebuilds, ticks);
+  printf("agent steps: %.3f ms/tick, %.1f M steps/s\n",
+         stepTime / ticks * 1000, agents * ticks / stepTime / 1e6);
+  printf("tick rate:   %.0f ticks/s\n", ticks / (updateTime + stepTime));
+  printf("agents:      %zu chasing, %zu caught\n", chasing, caught);
+  printf("incremental: %s\n", matches ? "matches full rebuild" : "MISMATCH");
+
+  freeFlowField(&check);
+  freeFlowField(&field);
+  freeGrid(&grid);
+  free(positions);
+  return matches ? 0 : 1;
+}
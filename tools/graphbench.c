@@ -0,0 +1,77 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/graph.c"
+#include "../src/utils.h"
+
+// Times the room graph and its analytics on maps of growing room counts,
+// reporting nanoseconds per room next to each stage: with every pass linear
+// they should stay flat from a thousand rooms to a million.
+//
+//   graphbench [maxRooms=1000000] [samples=8] [tilesPerRoom=400]
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  uint32_t maxRooms = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  uint32_t samples = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+  uint32_t tilesPerRoom = argc > 3 ? strtoul(argv[3], NULL, 10) : 400;
+
+  printf("%9s %9s %15s %15s %15s %15s %8s %8s %8s %7s\n", "rooms", "edges", "build", "placement",
+         "chokepoints", "betweenness", "distance", "bridges", "cuts", "B/room");
+
+  for (uint32_t rooms = 1000; rooms <= maxRooms; rooms *= 10) {
+    MapConfig config = MAP_CONFIG_DEFAULT;
+    config.width = config.height = (int32_t)sqrt((double)rooms * tilesPerRoom) + 2 * config.margin;
+    config.numRooms = rooms;
+
+    Map map = initMap(&config, 1);
+    mapRequire(&map, STAGE_HALLS);
+    size_t count = map.cells.count;
+
+    double start = now();
+    const RoomGraph *graph = mapRoomGraph(&map);
+    double build = now() - start;
+
+    start = now();
+    RoomPlacement placement = placeEntranceAndExit(graph);
+    double place = now() - start;
+
+    bool *cutRooms = malloc(count * sizeof(bool));
+    bool *bridges = malloc(MAX(graph->edges.count, (size_t)1) * sizeof(bool));
+    float *betweenness = malloc(count * sizeof(float));
+    ASSERT(cutRooms != NULL && bridges != NULL && betweenness != NULL && "Buy more RAM lol");
+
+    start = now();
+    size_t bridgeCount = findChokepoints(graph, cutRooms, bridges);
+    double chokepoints = now() - start;
+
+    start = now();
+    approximateBetweenness(graph, samples, 1, betweenness);
+    double between = now() - start;
+
+    size_t cuts = 0;
+    for (size_t i = 0; i < count; i++) cuts += cutRooms[i];
+
+    double perRoom = 1e9 / count;
+    printf("%9zu %9zu %7.1fms %4.0fns %7.1fms %4.0fns %7.1fms %4.0fns %7.1fms %4.0fns %8u %8zu %8zu %7.0f\n",
+           count, graph->edges.count, build * 1000, build * perRoom, place * 1000, place * perRoom,
+           chokepoints * 1000, chokepoints * perRoom, between * 1000, between * perRoom,
+           placement.distance, bridgeCount, cuts, (double)roomGraphMemoryUsage(graph) / count);
+
+    free(cutRooms);
+    free(bridges);
+    free(betweenness);
+    freeMap(&map);
+  }
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/raster.c"
+#include "../src/label.c"
+#include "../src/utils.h"
+
+// Times connected-component labeling of a rasterized map and of a random
+// half-filled grid (many small, ragged components) at each thread count up
+// to the one given, checking every result against the single-thread one.
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool bench(const char *name, const Grid *grid, size_t maxThreads, int rounds) {
+  size_t tiles = (size_t)grid->width * grid->height;
+  uint32_t *expected = malloc(tiles * sizeof(uint32_t));
+  uint32_t *labels = malloc(tiles * sizeof(uint32_t));
+  ASSERT(expected != NULL && labels != NULL);
+
+  uint32_t count = labelGrid(grid, expected, 1);
+  printf("%s: %dx%d, %u components\n", name, grid->width, grid->height, count);
+
+  bool ok = true;
+  for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+    double best = 1e9;
+    for (int r = 0; r < rounds; r++) {
+      double start = now();
+      uint32_t got = labelGrid(grid, labels, threads);
+      best = MIN(best, now() - start);
+      if (got != count || memcmp(labels, expected, tiles * sizeof(uint32_t)) != 0) ok = false;
+    }
+    printf("  %2zu threads: %8.2f ms, %6.0f Mtiles/s\n", threads, best * 1000, tiles / best / 1e6);
+  }
+
+  free(expected);
+  free(labels);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  int32_t world = argc > 1 ? atoi(argv[1]) : 8192;
+  size_t threads = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+  int rounds = argc > 3 ? atoi(argv[3]) : 5;
+
+  MapConfig config = MAP_CONFIG_DEFAULT;
+  config.width = config.height = world;
+  config.numRooms = 255;
+
+  Map map = initMap(&config, 1);
+  generateMap(&map);
+  Grid grid;
+  rasterizeMap(&map, &grid);
+  freeMap(&map);
+
+  bool ok = bench("map", &grid, threads, rounds);
+  freeGrid(&grid);
+
+  grid = makeGrid(world, world);
+  Rng rng = { 1 };
+  for (size_t i = 0; i < (size_t)world * world; i++) {
+    grid.tiles[i] = rngNext(&rng) & 1 ? TILE_ROOM : TILE_WALL;
+  }
+  ok = bench("noise", &grid, threads, rounds) && ok;
+  freeGrid(&grid);
+
+  if (!ok) {
+    fprintf(stderr, "ERROR: labels differ between thread counts\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,334 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/graph.c"
+#include "../src/utils.h"
+
+// Level-pack QA over many seeds. Workers claim blocks of consecutive seeds,
+// generate each map through its halls (walls are never traced), measure it
+// and drop it, so memory stays at one map and one block per thread however
+// many maps are run. Finished blocks are appended to a columnar summary
+// file as they complete, and histograms are printed once every block is in.
+//
+// File layout, in host byte order like level packs:
+//
+//   StatsHeader
+//   char name[STATS_NAME_SIZE][columnCount]
+//   blocks, in completion order, each:
+//     StatsBlock
+//     uint32_t values[rows] for every column in turn
+//
+// A block's rows are seeds firstSeed, firstSeed + 1, ... so the seed needs
+// no column of its own.
+//
+//   levelstats <out.stats> [count=100000] [first-seed=1] [threads=4] [rooms] [size]
+
+#define STATS_MAGIC "RGVS"
+#define STATS_VERSION 1
+#define STATS_NAME_SIZE 16
+#define BLOCK_ROWS 1024
+// Histogram bins per power of two
+#define HIST_SUBBINS 4
+#define HIST_BINS (30 * HIST_SUBBINS + HIST_SUBBINS)
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t columnCount;
+  uint32_t blockRows;
+} StatsHeader;
+
+typedef struct {
+  uint64_t firstSeed;
+  uint32_t rows;
+  uint32_t reserved;
+} StatsBlock;
+
+typedef enum {
+  COL_ROOMS,
+  COL_HALLS,
+  COL_FLOOR,
+  COL_LARGEST_ROOM,
+  // Rooms outside the largest set of rooms joined by corridors
+  COL_UNREACHABLE,
+  // Hops between the entrance and exit placeEntranceAndExit() picks
+  COL_PATH,
+  COL_BRIDGES,
+  COL_MICROS,
+  COLUMN_COUNT,
+} Column;
+
+static const char *columnNames[COLUMN_COUNT] = {
+  [COL_ROOMS] = "rooms",
+  [COL_HALLS] = "halls",
+  [COL_FLOOR] = "floor",
+  [COL_LARGEST_ROOM] = "largestRoom",
+  [COL_UNREACHABLE] = "unreachable",
+  [COL_PATH] = "path",
+  [COL_BRIDGES] = "bridges",
+  [COL_MICROS] = "micros",
+};
+
+// Log-linear bins: values below HIST_SUBBINS get one each, and every power
+// of two above splits into HIST_SUBBINS equal bins. That keeps the relative
+// error under 25% from single tiles to millions of microseconds with no
+// sizing up front, and per-thread histograms merge by adding bins.
+typedef struct {
+  uint64_t bins[HIST_BINS];
+  uint64_t count;
+  uint64_t sum;
+  uint32_t min;
+  uint32_t max;
+} Histogram;
+
+typedef enum {
+  HIST_ROOM_AREA,
+  HIST_HALLS,
+  HIST_PATH,
+  HIST_MICROS,
+  HIST_COUNT,
+} HistogramKind;
+
+static const char *histogramNames[HIST_COUNT] = {
+  [HIST_ROOM_AREA] = "room area (tiles)",
+  [HIST_HALLS] = "halls per map",
+  [HIST_PATH] = "entrance to exit (rooms)",
+  [HIST_MICROS] = "generation time (us)",
+};
+
+typedef struct {
+  uint32_t values[COLUMN_COUNT][BLOCK_ROWS];
+  uint64_t firstSeed;
+  uint32_t rows;
+} Block;
+
+typedef struct {
+  MapConfig config;
+  uint64_t firstSeed;
+  size_t count;
+  size_t blocks;
+  size_t nextBlock;
+
+  pthread_mutex_t lock;
+  FILE *file;
+  bool ok;
+  size_t bytes;
+} Job;
+
+typedef struct {
+  Job *job;
+  Histogram histograms[HIST_COUNT];
+  uint64_t rooms;
+  size_t failures;
+} Worker;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t histogramBin(uint32_t value) {
+  if (value < HIST_SUBBINS) return value;
+  uint32_t octave = 31 - __builtin_clz(value);
+  return (octave - 1) * HIST_SUBBINS + ((value >> (octave - 2)) & (HIST_SUBBINS - 1));
+}
+
+static uint32_t histogramBinStart(uint32_t bin) {
+  if (bin < HIST_SUBBINS) return bin;
+  uint32_t octave = bin / HIST_SUBBINS + 1;
+  return (HIST_SUBBINS + bin % HIST_SUBBINS) << (octave - 2);
+}
+
+static void histogramAdd(Histogram *h, uint32_t value) {
+  h->bins[histogramBin(value)]++;
+  h->min = h->count == 0 ? value : MIN(h->min, value);
+  h->max = MAX(h->max, value);
+  h->count++;
+  h->sum += value;
+}
+
+static void histogramMerge(Histogram *into, const Histogram *from) {
+  if (from->count == 0) return;
+  for (size_t i = 0; i < HIST_BINS; i++) into->bins[i] += from->bins[i];
+  into->min = into->count == 0 ? from->min : MIN(into->min, from->min);
+  into->max = MAX(into->max, from->max);
+  into->count += from->count;
+  into->sum += from->sum;
+}
+
+static void histogramPrint(const char *name, const Histogram *h) {
+  printf("%s: %llu values, min %u, mean %.1f, max %u\n", name, (unsigned long long)h->count, h->min,
+         h->count > 0 ? (double)h->sum / h->count : 0.0, h->max);
+
+  if (h->count == 0) return;
+
+  uint64_t peak = 1;
+  for (size_t i = 0; i < HIST_BINS; i++) peak = MAX(peak, h->bins[i]);
+  for (uint32_t i = histogramBin(h->min); i <= histogramBin(h->max); i++) {
+    uint32_t lo = histogramBinStart(i);
+    uint32_t hi = i + 1 < HIST_BINS ? histogramBinStart(i + 1) - 1 : UINT32_MAX;
+    char range[32];
+    if (lo == hi) snprintf(range, sizeof(range), "%u", lo);
+    else snprintf(range, sizeof(range), "%u-%u", lo, hi);
+    int bar = (int)(40 * h->bins[i] / peak);
+    printf("  %12s %10llu %.*s\n", range, (unsigned long long)h->bins[i], bar,
+           "########################################");
+  }
+}
+
+// Fills one row of `block` and the worker's histograms from seed `seed`.
+static void measureMap(Worker *w, Block *block, uint32_t row, uint64_t seed) {
+  double start = now();
+  Map map = initMap(&w->job->config, seed);
+  mapRequire(&map, STAGE_HALLS);
+  uint32_t micros = (now() - start) * 1e6;
+
+  uint32_t halls = 0, floorArea = 0, largest = 0;
+  da_foreach(Cell *, cell, &map.cells) {
+    uint32_t area = ((*cell)->x2 - (*cell)->x1) * ((*cell)->y2 - (*cell)->y1);
+    histogramAdd(&w->histograms[HIST_ROOM_AREA], area);
+    floorArea += area;
+    largest = MAX(largest, area);
+    halls += cellHalls(&map, *cell).count;
+  }
+
+  const RoomGraph *graph = mapRoomGraph(&map);
+  RoomPlacement placement = placeEntranceAndExit(graph);
+  bool *cutRooms = malloc(MAX(graph->roomCount, 1u) * sizeof(bool));
+  bool *bridges = malloc(MAX(graph->edges.count, (size_t)1) * sizeof(bool));
+  ASSERT(cutRooms != NULL && bridges != NULL && "Buy more RAM lol");
+  uint32_t bridgeCount = findChokepoints(graph, cutRooms, bridges);
+
+  uint32_t rooms = map.cells.count;
+  uint32_t *values[COLUMN_COUNT];
+  for (size_t c = 0; c < COLUMN_COUNT; c++) values[c] = &block->values[c][row];
+  *values[COL_ROOMS] = rooms;
+  *values[COL_HALLS] = halls;
+  *values[COL_FLOOR] = floorArea;
+  *values[COL_LARGEST_ROOM] = largest;
+  *values[COL_UNREACHABLE] = rooms - placement.reachable;
+  *values[COL_PATH] = placement.distance;
+  *values[COL_BRIDGES] = bridgeCount;
+  *values[COL_MICROS] = micros;
+
+  histogramAdd(&w->histograms[HIST_HALLS], halls);
+  histogramAdd(&w->histograms[HIST_PATH], placement.distance);
+  histogramAdd(&w->histograms[HIST_MICROS], micros);
+  w->rooms += rooms;
+  if (placement.reachable < rooms) w->failures++;
+
+  free(cutRooms);
+  free(bridges);
+  freeMap(&map);
+}
+
+static void *runWorker(void *arg) {
+  Worker *w = arg;
+  Job *job = w->job;
+
+  Block *block = malloc(sizeof(Block));
+  ASSERT(block != NULL && "Buy more RAM lol");
+
+  for (;;) {
+    size_t b = __atomic_fetch_add(&job->nextBlock, 1, __ATOMIC_RELAXED);
+    if (b >= job->blocks) break;
+
+    block->firstSeed = job->firstSeed + b * BLOCK_ROWS;
+    block->rows = MIN(job->count - b * BLOCK_ROWS, (size_t)BLOCK_ROWS);
+    for (uint32_t row = 0; row < block->rows; row++) measureMap(w, block, row, block->firstSeed + row);
+
+    StatsBlock header = { block->firstSeed, block->rows, 0 };
+    pthread_mutex_lock(&job->lock);
+    bool ok = fwrite(&header, sizeof(header), 1, job->file) == 1;
+    for (size_t c = 0; c < COLUMN_COUNT; c++) {
+      ok = ok && fwrite(block->values[c], sizeof(uint32_t), block->rows, job->file) == block->rows;
+    }
+    job->ok = job->ok && ok;
+    job->bytes += sizeof(header) + COLUMN_COUNT * block->rows * sizeof(uint32_t);
+    pthread_mutex_unlock(&job->lock);
+  }
+
+  free(block);
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <out.stats> [count] [first-seed] [threads] [rooms] [size]\n", argv[0]);
+    return 1;
+  }
+
+  const char *path = argv[1];
+  size_t threads = argc > 4 ? strtoul(argv[4], NULL, 10) : 4;
+  Job job = {
+    .config = MAP_CONFIG_DEFAULT,
+    .count = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000,
+    .firstSeed = argc > 3 ? strtoull(argv[3], NULL, 10) : 1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .ok = true,
+  };
+  if (argc > 5) job.config.numRooms = strtoul(argv[5], NULL, 10);
+  if (argc > 6) job.config.width = job.config.height = atoi(argv[6]);
+  threads = MAX(threads, (size_t)1);
+  job.blocks = (job.count + BLOCK_ROWS - 1) / BLOCK_ROWS;
+
+  job.file = fopen(path, "wb");
+  if (job.file == NULL) {
+    fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+    return 1;
+  }
+
+  StatsHeader header = { .version = STATS_VERSION, .columnCount = COLUMN_COUNT, .blockRows = BLOCK_ROWS };
+  memcpy(header.magic, STATS_MAGIC, 4);
+  char names[COLUMN_COUNT][STATS_NAME_SIZE] = {0};
+  for (size_t c = 0; c < COLUMN_COUNT; c++) strncpy(names[c], columnNames[c], STATS_NAME_SIZE - 1);
+  job.ok = fwrite(&header, sizeof(header), 1, job.file) == 1 && fwrite(names, sizeof(names), 1, job.file) == 1;
+  job.bytes = sizeof(header) + sizeof(names);
+
+  Worker *workers = calloc(threads, sizeof(Worker));
+  pthread_t *pool = malloc(threads * sizeof(pthread_t));
+  ASSERT(workers != NULL && pool != NULL && "Buy more RAM lol");
+
+  double start = now();
+  for (size_t i = 0; i < threads; i++) {
+    workers[i].job = &job;
+    if (i > 0) pthread_create(&pool[i], NULL, runWorker, &workers[i]);
+  }
+  runWorker(&workers[0]);
+  for (size_t i = 1; i < threads; i++) pthread_join(pool[i], NULL);
+  double elapsed = now() - start;
+
+  bool ok = fclose(job.file) == 0 && job.ok;
+
+  Histogram histograms[HIST_COUNT] = {0};
+  uint64_t totalRooms = 0;
+  size_t failures = 0;
+  for (size_t t = 0; t < threads; t++) {
+    for (size_t i = 0; i < HIST_COUNT; i++) histogramMerge(&histograms[i], &workers[t].histograms[i]);
+    totalRooms += workers[t].rooms;
+    failures += workers[t].failures;
+  }
+
+  for (size_t i = 0; i < HIST_COUNT; i++) histogramPrint(histogramNames[i], &histograms[i]);
+  printf("connectivity failures: %zu of %zu maps (%.3f%%)\n", failures, job.count,
+         job.count > 0 ? 100.0 * failures / job.count : 0.0);
+  printf("%zu maps (%llu rooms) in %.2f s on %zu threads: %.0f maps/s, %.0f rooms/s, %zu bytes written\n",
+         job.count, (unsigned long long)totalRooms, elapsed, threads, job.count / elapsed,
+         totalRooms / elapsed, job.bytes);
+
+  free(workers);
+  free(pool);
+
+  if (!ok) {
+    fprintf(stderr, "ERROR: could not write %s\n", path);
+    return 1;
+  }
+  return 0;
+}
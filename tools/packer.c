@@ -0,0 +1,210 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/mapio.c"
+#include "../src/pack.c"
+#include "../src/utils.h"
+
+// Builds a level pack from consecutive seeds. Workers generate and serialize
+// maps in parallel; the main thread appends them to the pack in seed order.
+// With --verify the pack is then reopened, every seed is looked up and
+// loaded, and each map is checked against a freshly generated one.
+
+typedef struct {
+  String_Builder data;
+  PackEntry entry;
+  bool ready;
+} Slot;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  Slot *slots;
+  size_t count;
+  size_t next;
+  size_t written;
+  size_t window;
+  uint64_t firstSeed;
+  MapConfig config;
+} Job;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker(void *arg) {
+  Job *job = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    while (job->next < job->count && job->next >= job->written + job->window) {
+      pthread_cond_wait(&job->changed, &job->lock);
+    }
+    size_t i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->count) return NULL;
+
+    Map map = initMap(&job->config, job->firstSeed + i);
+    generateMap(&map);
+
+    Slot *slot = &job->slots[i % job->window];
+    slot->data.count = 0;
+    serializeMap(&map, &slot->data);
+    slot->entry = summarizeMap(&map);
+    freeMap(&map);
+
+    pthread_mutex_lock(&job->lock);
+    slot->ready = true;
+    pthread_cond_broadcast(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+  }
+}
+
+static bool sameSummary(const PackEntry *a, const PackEntry *b) {
+  return a->seed == b->seed && a->numRooms == b->numRooms && a->numHalls == b->numHalls
+    && a->x1 == b->x1 && a->y1 == b->y1 && a->x2 == b->x2 && a->y2 == b->y2;
+}
+
+// Goes through the reader side only: packFindSeed for every seed, then the
+// stored bytes, the loaded map serialized again and the entry summary, each
+// against the same seed generated from scratch.
+static bool verifyPack(const char *path, const Job *job) {
+  Pack pack;
+  if (!packOpen(&pack, path)) {
+    fprintf(stderr, "ERROR: could not open %s\n", path);
+    return false;
+  }
+
+  bool ok = pack.header->count == job->count;
+  String_Builder expected = {0}, loaded = {0};
+  double start = now(), lookups = 0;
+
+  for (size_t i = 0; ok && i < job->count; i++) {
+    uint64_t seed = job->firstSeed + i;
+    double lookupStart = now();
+    int64_t index = packFindSeed(&pack, seed);
+    Map map;
+    bool found = index == (int64_t)i && packLoadMap(&pack, index, &map);
+    lookups += now() - lookupStart;
+    if (!found) {
+      fprintf(stderr, "ERROR: seed %llu is missing from %s\n", (unsigned long long)seed, path);
+      ok = false;
+      break;
+    }
+
+    Map fresh = initMap(&job->config, seed);
+    generateMap(&fresh);
+    expected.count = loaded.count = 0;
+    serializeMap(&fresh, &expected);
+    serializeMap(&map, &loaded);
+    PackEntry summary = summarizeMap(&fresh);
+
+    size_t size = 0;
+    const void *stored = packEntryData(&pack, index, &size);
+    ok = stored != NULL && size == expected.count && memcmp(stored, expected.items, size) == 0
+      && loaded.count == expected.count && memcmp(loaded.items, expected.items, loaded.count) == 0
+      && sameSummary(&pack.entries[index], &summary);
+    if (!ok) fprintf(stderr, "ERROR: seed %llu does not match a fresh map\n", (unsigned long long)seed);
+
+    freeMap(&fresh);
+    freeMap(&map);
+  }
+  if (ok && packFindSeed(&pack, job->firstSeed + job->count) != -1) {
+    fprintf(stderr, "ERROR: %s finds a seed it does not hold\n", path);
+    ok = false;
+  }
+
+  if (ok) {
+    printf("verified %zu maps in %.3fs, %.1f us per lookup and load\n",
+           job->count, now() - start, lookups / MAX(job->count, (size_t)1) * 1e6);
+  }
+  free(expected.items);
+  free(loaded.items);
+  packClose(&pack);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  bool verify = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--verify") != 0) continue;
+    verify = true;
+    memmove(&argv[i], &argv[i + 1], (argc - i) * sizeof(*argv));
+    argc--;
+    i--;
+  }
+
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s [--verify] <out.pack> <count> [first-seed] [threads] [rooms] [min-cell-size]\n", argv[0]);
+    return 1;
+  }
+
+  const char *path = argv[1];
+  size_t threads = argc > 4 ? strtoul(argv[4], NULL, 10) : 4;
+  Job job = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .changed = PTHREAD_COND_INITIALIZER,
+    .count = strtoul(argv[2], NULL, 10),
+    .firstSeed = argc > 3 ? strtoull(argv[3], NULL, 10) : 1,
+    .config = MAP_CONFIG_DEFAULT,
+  };
+  if (argc > 5) job.config.numRooms = atoi(argv[5]);
+  if (argc > 6) job.config.minCellSize = atoi(argv[6]);
+  if (threads == 0) threads = 1;
+  job.window = 4 * threads;
+  job.slots = calloc(job.window, sizeof(*job.slots));
+
+  PackWriter writer;
+  if (!packWriterOpen(&writer, path)) {
+    fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+    return 1;
+  }
+
+  double start = now();
+
+  pthread_t *pool = malloc(threads * sizeof(*pool));
+  for (size_t t = 0; t < threads; t++) pthread_create(&pool[t], NULL, worker, &job);
+
+  bool ok = true;
+  for (size_t i = 0; i < job.count; i++) {
+    Slot *slot = &job.slots[i % job.window];
+
+    pthread_mutex_lock(&job.lock);
+    while (!slot->ready) pthread_cond_wait(&job.changed, &job.lock);
+    pthread_mutex_unlock(&job.lock);
+
+    ok = ok && packWriterAdd(&writer, slot->entry, slot->data.items, slot->data.count);
+
+    pthread_mutex_lock(&job.lock);
+    slot->ready = false;
+    job.written++;
+    pthread_cond_broadcast(&job.changed);
+    pthread_mutex_unlock(&job.lock);
+  }
+
+  for (size_t t = 0; t < threads; t++) pthread_join(pool[t], NULL);
+  ok = packWriterFinish(&writer) && ok;
+
+  double seconds = now() - start;
+
+  for (size_t i = 0; i < job.window; i++) free(job.slots[i].data.items);
+  free(job.slots);
+  free(pool);
+
+  if (!ok) {
+    fprintf(stderr, "ERROR: could not write %s\n", path);
+    return 1;
+  }
+
+  printf("packed %zu maps into %s in %.3fs (%.0f maps/s)\n",
+         job.count, path, seconds, job.count / seconds);
+  return verify && !verifyPack(path, &job) ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/placement.c"
+#include "../src/utils.h"
+
+// Checks that placeInRooms keeps every point inside its room and at least
+// the radius away from every other point of that room, and that a seed
+// always places the same points, then times placement on a large map.
+//
+//   placebench [world=4096] [rooms=255] [rounds=5]
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int comparePointsX(const void *pa, const void *pb) {
+  const PlacedPoint *a = pa, *b = pb;
+  return (a->x > b->x) - (a->x < b->x);
+}
+
+// Sorts each room's points by x and compares every pair closer than the
+// radius on that axis.
+static bool checkSpacing(const Map *map, const PlacementConfig *config, PlacementArray *points) {
+  int64_t r2 = (int64_t)config->radius * config->radius;
+  size_t start = 0;
+  bool ok = true;
+
+  while (start < points->count) {
+    uint32_t room = points->items[start].room;
+    size_t end = start;
+    while (end < points->count && points->items[end].room == room) end++;
+
+    const Cell *cell = map->cells.items[room];
+    for (size_t i = start; i < end; i++) {
+      int32_t tx = points->items[i].x >> PLACE_SHIFT, ty = points->items[i].y >> PLACE_SHIFT;
+      ok = ok && tx >= cell->x1 && tx < cell->x2 && ty >= cell->y1 && ty < cell->y2;
+    }
+
+    qsort(&points->items[start], end - start, sizeof(PlacedPoint), comparePointsX);
+    for (size_t i = start; i < end; i++) {
+      for (size_t j = i + 1; j < end && points->items[j].x - points->items[i].x < config->radius; j++) {
+        int64_t dx = points->items[j].x - points->items[i].x;
+        int64_t dy = points->items[j].y - points->items[i].y;
+        ok = ok && dx * dx + dy * dy >= r2;
+      }
+    }
+    start = end;
+  }
+  return ok;
+}
+
+// Places into a freshly generated map, so nothing carries over between runs
+static void placeSeed(const MapConfig *mapConfig, uint64_t seed, const PlacementConfig *config,
+                      PlacementArray *out, Map *kept) {
+  Map map = initMap(mapConfig, seed);
+  generateMap(&map);
+  out->count = 0;
+  placeInRooms(&map, config, out);
+  if (kept != NULL) *kept = map; else freeMap(&map);
+}
+
+static bool samePoints(const PlacementArray *a, const PlacementArray *b) {
+  return a->count == b->count && memcmp(a->items, b->items, a->count * sizeof(PlacedPoint)) == 0;
+}
+
+int main(int argc, char **argv) {
+  int32_t world = argc > 1 ? atoi(argv[1]) : 4096;
+  uint32_t rooms = argc > 2 ? strtoul(argv[2], NULL, 10) : 255;
+  int rounds = argc > 3 ? atoi(argv[3]) : 5;
+
+  // Small maps with radii from barely over the minimum to wider than most
+  // rooms, each placed twice from scratch and once more on the same map
+  Rng rng = { 1 };
+  PlacementArray first = {0}, second = {0};
+  bool spaced = true, repeated = true;
+  size_t checked = 0;
+  for (uint64_t seed = 1; seed <= 64; seed++) {
+    MapConfig mapConfig = MAP_CONFIG_DEFAULT;
+    mapConfig.width = RNGBETWEEN(&rng, 24, 400);
+    mapConfig.height = RNGBETWEEN(&rng, 24, 400);
+    mapConfig.numRooms = RNGBETWEEN(&rng, 2, 60);
+    PlacementConfig config = { RNGBETWEEN(&rng, 2, 12 * PLACE_ONE), RNGBETWEEN(&rng, 1, 40) };
+
+    Map map;
+    placeSeed(&mapConfig, seed, &config, &first, &map);
+    placeSeed(&mapConfig, seed, &config, &second, NULL);
+    repeated = samePoints(&first, &second) && repeated;
+    second.count = 0;
+    placeInRooms(&map, &config, &second);
+    repeated = samePoints(&first, &second) && repeated;
+
+    spaced = checkSpacing(&map, &config, &first) && spaced;
+    checked += first.count;
+    freeMap(&map);
+  }
+  printf("small maps: %zu points, spacing %s, repeats %s\n", checked,
+         spaced ? "ok" : "VIOLATED", repeated ? "match" : "MISMATCH");
+
+  MapConfig mapConfig = MAP_CONFIG_DEFAULT;
+  mapConfig.width = mapConfig.height = world;
+  mapConfig.numRooms = rooms;
+  PlacementConfig config = PLACEMENT_CONFIG_DEFAULT;
+
+  Map map;
+  placeSeed(&mapConfig, 1, &config, &first, &map);
+  double best = 1e9;
+  for (int r = 0; r < rounds; r++) {
+    second.count = 0;
+    double start = now();
+    placeInRooms(&map, &config, &second);
+    best = MIN(best, now() - start);
+    repeated = samePoints(&first, &second) && repeated;
+  }
+
+  size_t area = 0;
+  da_foreach(Cell *, cell, &map.cells) area += (size_t)((*cell)->x2 - (*cell)->x1) * ((*cell)->y2 - (*cell)->y1);
+  printf("map: %dx%d, %zu rooms, %zu tiles of floor\n", world, world, map.cells.count, area);
+  printf("  %zu points in %.2f ms, %.1f Mpoints/s, %.1f tiles per point\n", second.count,
+         best * 1000, second.count / best / 1e6, (double)area / second.count);
+
+  spaced = checkSpacing(&map, &config, &first) && spaced;
+  freeMap(&map);
+  free(first.items);
+  free(second.items);
+
+  if (!spaced) fprintf(stderr, "ERROR: points outside their room or closer than the radius\n");
+  if (!repeated) fprintf(stderr, "ERROR: the same seed placed different points\n");
+  return spaced && repeated ? 0 : 1;
+}
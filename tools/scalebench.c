@@ -0,0 +1,148 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mapgen.c"
+#include "../src/mapio.c"
+#include "../src/utils.h"
+
+// Generates maps of growing room counts on worlds that grow with them, one
+// stage at a time through mapRequire(), and times each stage together with
+// a serialize/deserialize round trip and the walk drawCell() makes over the
+// rooms and halls, minus the drawing. The loaded map must serialize back to
+// the same bytes and rebuild the same room graph. Heap bytes per room should
+// stay flat as the room count grows.
+//
+//   scalebench [maxRooms=1000000] [tilesPerRoom=400] [routeHalls=1]
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const struct {
+  const char *name;
+  uint8_t stage;
+} stages[] = {
+  { "divide", STAGE_DIVIDED },
+  { "neighbours", STAGE_NEIGHBOURS },
+  { "shrink", STAGE_SHRUNK },
+  { "halls", STAGE_HALLS },
+  { "walls", STAGE_WALLS },
+};
+
+#define STAGE_COUNT (sizeof(stages) / sizeof(stages[0]))
+
+// drawCell() without raylib: the same walk and reads, with the rectangles
+// it would draw summed up so none of it is optimized away.
+static uint64_t walkCells(const Map *map, Cell *cell, int cellSize) {
+  CellWalk walk = {0};
+  uint64_t sum = 0;
+  cellWalkBegin(&walk, cell, false);
+
+  for (Cell *c; (c = cellWalkNext(&walk)) != NULL;) {
+    if (c->left != NULL) continue;
+    sum += (uint64_t)(c->x1 * cellSize) + c->y1 * cellSize + (c->x2 - c->x1) * cellSize
+      + (c->y2 - c->y1) * cellSize;
+
+    HallArray halls = cellHalls(map, c);
+    da_foreach(Hall, hall, &halls) {
+      sum += (uint64_t)(MIN(hall->x1, hall->x2) * cellSize) + MIN(hall->y1, hall->y2) * cellSize
+        + (hall->x2 - hall->x1) * cellSize + (hall->y2 - hall->y1) * cellSize;
+    }
+  }
+  cellWalkEnd(&walk);
+  return sum;
+}
+
+// Neighbour lists, including the shared boundary stretches the loader
+// recomputes rather than reads
+static bool sameGraph(const Map *a, const Map *b) {
+  if (a->cells.count != b->cells.count) return false;
+  for (size_t i = 0; i < a->cells.count; i++) {
+    RoomEdgeArray ea = cellEdges(a, a->cells.items[i]);
+    RoomEdgeArray eb = cellEdges(b, b->cells.items[i]);
+    if (ea.count != eb.count) return false;
+    for (size_t e = 0; e < ea.count; e++) {
+      RoomEdge *x = &ea.items[e], *y = &eb.items[e];
+      if (x->from != y->from || x->to != y->to || x->vertical != y->vertical
+          || x->lo != y->lo || x->hi != y->hi) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t maxRooms = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  uint32_t tilesPerRoom = argc > 2 ? strtoul(argv[2], NULL, 10) : 400;
+  bool routeHalls = argc > 3 ? atoi(argv[3]) != 0 : true;
+
+  printf("%9s %7s", "rooms", "world");
+  for (size_t s = 0; s < STAGE_COUNT; s++) printf(" %10s", stages[s].name);
+  printf(" %10s %10s %10s %10s %9s\n", "save", "load", "draw", "total", "B/room");
+
+  bool ok = true;
+  for (uint32_t rooms = 1000; rooms <= maxRooms; rooms *= 10) {
+    MapConfig config = MAP_CONFIG_DEFAULT;
+    config.width = config.height = (int32_t)sqrt((double)rooms * tilesPerRoom) + 2 * config.margin;
+    config.numRooms = rooms;
+    config.routeHalls = routeHalls;
+
+    Map map = initMap(&config, 1);
+    double times[STAGE_COUNT], total = 0;
+    for (size_t s = 0; s < STAGE_COUNT; s++) {
+      double start = now();
+      mapRequire(&map, stages[s].stage);
+      times[s] = now() - start;
+      total += times[s];
+    }
+    size_t bytes = mapMemoryUsage(&map);
+
+    String_Builder sb = {0};
+    double start = now();
+    serializeMap(&map, &sb);
+    double save = now() - start;
+
+    Map loaded;
+    start = now();
+    bool loadedOk = deserializeMap(sb.items, sb.count, &loaded);
+    double load = now() - start;
+    if (loadedOk) {
+      String_Builder again = {0};
+      serializeMap(&loaded, &again);
+      if (again.count != sb.count || memcmp(again.items, sb.items, sb.count) != 0
+          || !sameGraph(&map, &loaded)) {
+        ok = false;
+      }
+      free(again.items);
+    } else {
+      ok = false;
+    }
+
+    start = now();
+    uint64_t drawn = walkCells(&map, &map.root, config.cellSize);
+    double draw = now() - start;
+
+    printf("%9zu %7d", map.cells.count, config.width);
+    for (size_t s = 0; s < STAGE_COUNT; s++) printf(" %8.1fms", times[s] * 1000);
+    printf(" %8.1fms %8.1fms %8.1fms %8.1fms %9.0f\n", save * 1000, load * 1000, draw * 1000,
+           total * 1000, (double)bytes / map.cells.count);
+    if (drawn == 0) ok = false;
+
+    if (loadedOk) freeMap(&loaded);
+    freeMap(&map);
+    free(sb.items);
+  }
+
+  if (!ok) {
+    fprintf(stderr, "ERROR: a map did not survive the serialize/deserialize round trip\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,421 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/mapgen.c"
+#include "../src/query.c"
+#include "../src/utils.h"
+
+// Searches seeds for levels that meet design constraints. Candidates are
+// generated with MapGenTask one work unit at a time and every constraint is
+// checked as soon as a finished phase can decide it, so most seeds are
+// dropped long before their halls are built; walls are never traced.
+//
+//   DIVIDE      regions too small for a big room cap the big room count
+//   NEIGHBOURS  with straight halls only, a region with one neighbour can
+//               only become a dead end
+//   SHRINK      big rooms are counted exactly
+//   MERGE       path length and dead ends on the corridor graph
+//
+// The start is the first room and the exit the room the most corridors away
+// from it. A dead end is a room with a single corridor out.
+
+typedef struct {
+  MapConfig config;
+  uint32_t minBigRooms;
+  int32_t minArea;
+  uint32_t minPath;
+  int32_t maxDeadEnds;
+} Constraints;
+
+typedef struct {
+  uint64_t seed;
+  uint32_t bigRooms;
+  uint32_t path;
+  uint32_t deadEnds;
+} Match;
+
+typedef struct {
+  Match *items;
+  size_t count;
+  size_t capacity;
+} Matches;
+
+typedef struct {
+  const Constraints *constraints;
+  uint64_t *nextSeed;
+  uint64_t lastSeed;
+  size_t want;
+  pthread_mutex_t *lock;
+  Matches *matches;
+  // Candidates rejected once each phase finished
+  size_t rejected[GEN_DONE];
+  size_t tried;
+} Searcher;
+
+typedef struct {
+  const void *key;
+  uint32_t index;
+} Slot;
+
+typedef struct {
+  Slot *items;
+  size_t count;
+  size_t capacity;
+} Slots;
+
+typedef struct {
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} Indices;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compareSlots(const void *pa, const void *pb) {
+  const Slot *a = pa, *b = pb;
+  if (a->key != b->key) return (uintptr_t)a->key < (uintptr_t)b->key ? -1 : 1;
+  return 0;
+}
+
+static uint32_t slotIndex(const Slots *slots, const void *key) {
+  Slot probe = { key, 0 };
+  Slot *slot = bsearch(&probe, slots->items, slots->count, sizeof(Slot), compareSlots);
+  ASSERT(slot != NULL);
+  return slot->index;
+}
+
+// Shares an edge or overlaps; touching only at a corner doesn't count.
+static bool touching(int32_t ax1, int32_t ay1, int32_t ax2, int32_t ay2,
+                     int32_t bx1, int32_t by1, int32_t bx2, int32_t by2) {
+  if (ax1 > bx2 || bx1 > ax2 || ay1 > by2 || by1 > ay2) return false;
+  return (ax1 < bx2 && bx1 < ax2) || (ay1 < by2 && by1 < ay2);
+}
+
+static uint32_t findRoot(uint32_t *parents, uint32_t i) {
+  while (parents[i] != i) i = parents[i] = parents[parents[i]];
+  return i;
+}
+
+typedef struct {
+  Slots roomSlots;
+  Slots hallSlots;
+  uint32_t *parents;
+  // Room-corridor incidences, as room index then corridor root pairs
+  Indices links;
+  Indices offsets;
+  Indices edges;
+  Indices queue;
+  // Neighbour links per room, for the dead end bound
+  Indices degrees;
+  uint32_t *dist;
+  Hall **halls;
+  size_t hallCapacity;
+  Cell **rooms;
+  size_t roomCapacity;
+} CorridorGraph;
+
+static void freeCorridorGraph(CorridorGraph *g) {
+  free(g->roomSlots.items);
+  free(g->hallSlots.items);
+  free(g->parents);
+  free(g->links.items);
+  free(g->offsets.items);
+  free(g->edges.items);
+  free(g->queue.items);
+  free(g->degrees.items);
+  free(g->dist);
+  free(g->halls);
+  free(g->rooms);
+}
+
+// Range queries report the full match count, so grow and retry until the
+// buffer holds every match.
+static size_t nearbyHalls(CorridorGraph *g, Map *map, Rect rect) {
+  size_t found;
+  while ((found = queryHalls(map, rect, g->halls, g->hallCapacity)) > g->hallCapacity) {
+    g->hallCapacity = found;
+    g->halls = realloc(g->halls, found * sizeof(Hall *));
+    ASSERT(g->halls != NULL && "Buy more RAM lol");
+  }
+  return found;
+}
+
+static size_t nearbyRooms(CorridorGraph *g, Map *map, Rect rect) {
+  size_t found;
+  while ((found = queryRooms(map, rect, g->rooms, g->roomCapacity)) > g->roomCapacity) {
+    g->roomCapacity = found;
+    g->rooms = realloc(g->rooms, found * sizeof(Cell *));
+    ASSERT(g->rooms != NULL && "Buy more RAM lol");
+  }
+  return found;
+}
+
+// Halls that touch form corridors; rooms link to every corridor touching
+// them. Room-to-room distance is half the distance in that bipartite graph.
+static void measureCorridors(CorridorGraph *g, Map *map, uint32_t *path, uint32_t *deadEnds) {
+  uint32_t roomCount = map->cells.count;
+  g->roomSlots.count = g->hallSlots.count = g->links.count = 0;
+
+  for (uint32_t i = 0; i < roomCount; i++) da_append(&g->roomSlots, ((Slot){ map->cells.items[i], i }));
+  uint32_t hallCount = 0;
+  for (uint32_t i = 0; i < roomCount; i++) {
+    HallArray halls = cellHalls(map, map->cells.items[i]);
+    da_foreach(Hall, hall, &halls) da_append(&g->hallSlots, ((Slot){ hall, hallCount++ }));
+  }
+  qsort(g->roomSlots.items, g->roomSlots.count, sizeof(Slot), compareSlots);
+  qsort(g->hallSlots.items, g->hallSlots.count, sizeof(Slot), compareSlots);
+
+  g->parents = realloc(g->parents, (hallCount + 1) * sizeof(uint32_t));
+  ASSERT(g->parents != NULL && "Buy more RAM lol");
+  for (uint32_t i = 0; i < hallCount; i++) g->parents[i] = i;
+
+  for (size_t s = 0; s < g->hallSlots.count; s++) {
+    const Hall *hall = g->hallSlots.items[s].key;
+    uint32_t a = g->hallSlots.items[s].index;
+    Rect around = { hall->x1 - 1, hall->y1 - 1, hall->x2 + 1, hall->y2 + 1 };
+
+    size_t found = nearbyHalls(g, map, around);
+    for (size_t k = 0; k < found; k++) {
+      const Hall *other = g->halls[k];
+      if (!touching(hall->x1, hall->y1, hall->x2, hall->y2, other->x1, other->y1, other->x2, other->y2)) continue;
+      uint32_t ra = findRoot(g->parents, a), rb = findRoot(g->parents, slotIndex(&g->hallSlots, other));
+      if (ra != rb) g->parents[MAX(ra, rb)] = MIN(ra, rb);
+    }
+
+    size_t rooms = nearbyRooms(g, map, around);
+    for (size_t k = 0; k < rooms; k++) {
+      Cell *cell = g->rooms[k];
+      if (!touching(hall->x1, hall->y1, hall->x2, hall->y2, cell->x1, cell->y1, cell->x2, cell->y2)) continue;
+      da_append(&g->links, slotIndex(&g->roomSlots, cell));
+      da_append(&g->links, a);
+    }
+  }
+
+  // Bipartite adjacency: rooms are nodes 0..roomCount, corridors follow
+  // under their root hall's index
+  uint32_t nodes = roomCount + hallCount;
+  g->offsets.count = 0;
+  da_reserve(&g->offsets, nodes + 1);
+  memset(g->offsets.items, 0, (nodes + 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < g->links.count; i += 2) {
+    g->links.items[i + 1] = roomCount + findRoot(g->parents, g->links.items[i + 1]);
+    g->offsets.items[g->links.items[i] + 1]++;
+    g->offsets.items[g->links.items[i + 1] + 1]++;
+  }
+  for (uint32_t i = 0; i < nodes; i++) g->offsets.items[i + 1] += g->offsets.items[i];
+
+  g->edges.count = 0;
+  da_reserve(&g->edges, g->offsets.items[nodes]);
+  g->dist = realloc(g->dist, (nodes + 1) * sizeof(uint32_t));
+  ASSERT(g->dist != NULL && "Buy more RAM lol");
+  // dist doubles as each node's fill cursor while the edges are placed
+  memcpy(g->dist, g->offsets.items, nodes * sizeof(uint32_t));
+  for (size_t i = 0; i < g->links.count; i += 2) {
+    uint32_t room = g->links.items[i], corridor = g->links.items[i + 1];
+    g->edges.items[g->dist[room]++] = corridor;
+    g->edges.items[g->dist[corridor]++] = room;
+  }
+
+  // A room touched twice by one corridor still has one way out
+  *deadEnds = 0;
+  for (uint32_t room = 0; room < roomCount; room++) {
+    uint32_t first = UINT32_MAX;
+    bool more = false;
+    for (uint32_t e = g->offsets.items[room]; e < g->offsets.items[room + 1]; e++) {
+      if (first == UINT32_MAX) first = g->edges.items[e];
+      else if (g->edges.items[e] != first) more = true;
+    }
+    if (!more) (*deadEnds)++;
+  }
+
+  for (uint32_t i = 0; i < nodes; i++) g->dist[i] = UINT32_MAX;
+  g->queue.count = 0;
+  da_append(&g->queue, 0);
+  g->dist[0] = 0;
+  uint32_t reached = 0, furthest = 0;
+  for (size_t head = 0; head < g->queue.count; head++) {
+    uint32_t node = g->queue.items[head];
+    if (node < roomCount) {
+      reached++;
+      furthest = MAX(furthest, g->dist[node]);
+    }
+    for (uint32_t e = g->offsets.items[node]; e < g->offsets.items[node + 1]; e++) {
+      uint32_t next = g->edges.items[e];
+      if (g->dist[next] != UINT32_MAX) continue;
+      g->dist[next] = g->dist[node] + 1;
+      da_append(&g->queue, next);
+    }
+  }
+
+  // An unreachable room leaves no path to speak of
+  *path = reached == roomCount ? furthest / 2 : 0;
+}
+
+static int32_t largestRoomArea(const Cell *cell, uint16_t minCellSize) {
+  // shrinkCell keeps at most 9/10 of each side
+  int32_t w = MAX((cell->x2 - cell->x1) * 9 / 10, (int32_t)minCellSize);
+  int32_t h = MAX((cell->y2 - cell->y1) * 9 / 10, (int32_t)minCellSize);
+  return w * h;
+}
+
+// Whether the candidate can still pass once `phase` has finished.
+static bool checkPhase(const Constraints *c, Map *map, GenPhase phase, CorridorGraph *graph, Match *match) {
+  switch (phase) {
+  case GEN_DIVIDE: {
+    uint32_t possible = 0;
+    da_foreach(Cell *, cell, &map->cells) possible += largestRoomArea(*cell, map->minCellSize) >= c->minArea;
+    return possible >= c->minBigRooms;
+  }
+  case GEN_NEIGHBOURS: {
+    // Straight halls only join neighbours, so a region with a single
+    // neighbour ends up with at most one corridor
+    if (c->maxDeadEnds < 0 || map->routeHalls) return true;
+    Indices *degrees = &graph->degrees;
+    da_resize(degrees, map->cells.count);
+    memset(degrees->items, 0, degrees->count * sizeof(uint32_t));
+
+    // Every link is stored once, so one pass over the edges counts both ends
+    int32_t deadEnds = 0;
+    da_foreach(Cell *, cell, &map->cells) {
+      RoomEdgeArray edges = cellEdges(map, *cell);
+      degrees->items[(*cell)->index] += edges.count;
+      da_foreach(RoomEdge, edge, &edges) degrees->items[edge->to]++;
+    }
+    da_foreach(uint32_t, degree, degrees) deadEnds += *degree < 2;
+    return deadEnds <= c->maxDeadEnds;
+  }
+  case GEN_SHRINK: {
+    match->bigRooms = 0;
+    da_foreach(Cell *, cell, &map->cells) {
+      match->bigRooms += ((*cell)->x2 - (*cell)->x1) * ((*cell)->y2 - (*cell)->y1) >= c->minArea;
+    }
+    return match->bigRooms >= c->minBigRooms;
+  }
+  case GEN_HALLS:
+    return true;
+  case GEN_MERGE:
+    if (c->minPath == 0 && c->maxDeadEnds < 0) return true;
+    measureCorridors(graph, map, &match->path, &match->deadEnds);
+    return match->path >= c->minPath && (c->maxDeadEnds < 0 || (int32_t)match->deadEnds <= c->maxDeadEnds);
+  default:
+    return true;
+  }
+}
+
+static void *searchSeeds(void *arg) {
+  Searcher *s = arg;
+  const Constraints *c = s->constraints;
+  CorridorGraph graph = {0};
+
+  for (;;) {
+    uint64_t seed = __atomic_fetch_add(s->nextSeed, 1, __ATOMIC_RELAXED);
+    if (seed >= s->lastSeed) break;
+    s->tried++;
+
+    Map map = initMap(&c->config, seed);
+    MapGenTask task;
+    mapGenBegin(&task, &map);
+    Match match = { .seed = seed };
+
+    // A phase is finished once the task has moved past it
+    GenPhase checked = GEN_DIVIDE;
+    bool passed = true;
+    while (passed && checked < GEN_WALLS) {
+      mapGenAdvance(&task, 1);
+      for (; passed && checked < task.phase && checked < GEN_WALLS; checked++) {
+        passed = checkPhase(c, &map, checked, &graph, &match);
+        if (!passed) s->rejected[checked]++;
+      }
+    }
+
+    mapGenAbort(&task);
+    freeMap(&map);
+    if (!passed) continue;
+
+    pthread_mutex_lock(s->lock);
+    da_append(s->matches, match);
+    // Stop handing out seeds once enough levels were found
+    if (s->matches->count >= s->want) __atomic_store_n(s->nextSeed, s->lastSeed, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(s->lock);
+  }
+
+  freeCorridorGraph(&graph);
+  return NULL;
+}
+
+static int compareMatches(const void *pa, const void *pb) {
+  const Match *a = pa, *b = pb;
+  if (a->seed != b->seed) return a->seed < b->seed ? -1 : 1;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  Constraints c = { .config = MAP_CONFIG_DEFAULT };
+  c.config.numRooms = argc > 1 ? atoi(argv[1]) : 60;
+  c.minBigRooms = argc > 2 ? atoi(argv[2]) : 40;
+  c.minArea = argc > 3 ? atoi(argv[3]) : 20;
+  c.minPath = argc > 4 ? atoi(argv[4]) : 8;
+  c.maxDeadEnds = argc > 5 ? atoi(argv[5]) : -1;
+  size_t want = argc > 6 ? strtoul(argv[6], NULL, 10) : 10;
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t threads = argc > 7 ? strtoul(argv[7], NULL, 10) : (size_t)MAX(cores, 1L);
+  c.config.width = c.config.height = argc > 8 ? atoi(argv[8]) : 200;
+  uint64_t limit = argc > 9 ? strtoull(argv[9], NULL, 10) : 1000000;
+
+  threads = MAX(threads, (size_t)1);
+  printf("%u rooms on %dx%d: >= %u rooms of >= %d tiles, path >= %u",
+         c.config.numRooms, c.config.width, c.config.height, c.minBigRooms, c.minArea, c.minPath);
+  if (c.maxDeadEnds >= 0) printf(", <= %d dead ends", c.maxDeadEnds);
+  printf("\n");
+
+  uint64_t nextSeed = 1;
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  Matches matches = {0};
+  Searcher *searchers = calloc(threads, sizeof(Searcher));
+  pthread_t *pool = malloc(threads * sizeof(pthread_t));
+  ASSERT(searchers != NULL && pool != NULL);
+
+  double start = now();
+  for (size_t i = 0; i < threads; i++) {
+    searchers[i] = (Searcher){ &c, &nextSeed, 1 + limit, want, &lock, &matches, {0}, 0 };
+    if (i > 0) pthread_create(&pool[i], NULL, searchSeeds, &searchers[i]);
+  }
+  searchSeeds(&searchers[0]);
+  for (size_t i = 1; i < threads; i++) pthread_join(pool[i], NULL);
+  double elapsed = now() - start;
+
+  size_t tried = 0, rejected[GEN_DONE] = {0};
+  for (size_t i = 0; i < threads; i++) {
+    tried += searchers[i].tried;
+    for (int p = 0; p < GEN_DONE; p++) rejected[p] += searchers[i].rejected[p];
+  }
+
+  // Every seed handed out before the search stopped was finished, so the
+  // lowest `want` matches are the same whatever the thread count
+  qsort(matches.items, matches.count, sizeof(Match), compareMatches);
+  matches.count = MIN(matches.count, want);
+  da_foreach(Match, m, &matches) {
+    printf("seed %llu: %u big rooms, path %u, %u dead ends\n",
+           (unsigned long long)m->seed, m->bigRooms, m->path, m->deadEnds);
+  }
+
+  printf("%zu candidates in %.2f s on %zu threads: %.0f candidates/s, %zu found\n",
+         tried, elapsed, threads, tried / elapsed, matches.count);
+  for (int p = GEN_DIVIDE; p < GEN_WALLS; p++) {
+    if (rejected[p] > 0) printf("  rejected after %-18s %zu\n", mapGenPhaseName(p), rejected[p]);
+  }
+
+  free(matches.items);
+  free(searchers);
+  free(pool);
+  return 0;
+}